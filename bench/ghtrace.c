@@ -0,0 +1,298 @@
+/*
+ * =====================================================================================
+ * ghtrace: Syscall counter and per-file latency tracer for gh benchmarks
+ * =====================================================================================
+ *
+ * Runs a command under ptrace, following every thread it creates, and reports:
+ *   - the total number of system calls and a per-call breakdown
+ *   - per-file latency, measured from the openat() entry to the matching close()
+ *     for every descriptor that was read from (directories are skipped)
+ *
+ *   ghtrace [-p <prefix>] [-o <report>] -- <command> [args...]
+ *
+ * Options:
+ *   -p <prefix>     Only time files whose opened path starts with <prefix>
+ *   -o <report>     Write the report to <report> instead of stderr
+ *
+ * The report is line oriented ("key value") so bench/run.sh can parse it.
+ * File descriptors are tracked per traced program, which assumes the command
+ * does not fork; gh never does. Tracing slows every syscall down, so latency
+ * figures are comparable between gh versions but not to untraced wall time.
+ *
+ * COMPILATION:
+ * gcc -O2 -o ghtrace bench/ghtrace.c
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <elf.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+#define SYSCALL_MAX 1024
+#define FD_MAX 65536
+#define THREADS_MAX 4096
+
+typedef struct {
+    pid_t tid;
+    int in_syscall;
+    long nr;
+    long arg0, arg1;
+    uint64_t t_entry;
+} thread_state;
+
+static thread_state threads[THREADS_MAX];
+static int thread_count;
+static unsigned long long syscall_counts[SYSCALL_MAX];
+static unsigned long long syscall_total;
+static uint64_t *fd_open_ns;
+static unsigned char *fd_was_read;
+static uint64_t *latencies;
+static size_t latency_count, latency_cap;
+static const char *path_prefix;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static thread_state *thread_get(pid_t tid, int *created) {
+    for (int i = 0; i < thread_count; i++) {
+        if (threads[i].tid == tid) return &threads[i];
+    }
+    *created = 1;
+    if (thread_count == THREADS_MAX) return NULL;
+    thread_state *t = &threads[thread_count++];
+    memset(t, 0, sizeof(*t));
+    t->tid = tid;
+    return t;
+}
+
+static void thread_drop(pid_t tid) {
+    for (int i = 0; i < thread_count; i++) {
+        if (threads[i].tid == tid) {
+            threads[i] = threads[--thread_count];
+            return;
+        }
+    }
+}
+
+/**
+ * read_regs: Fetches syscall number, first two arguments and return value
+ * from a stopped thread.
+ */
+static int read_regs(pid_t tid, long *nr, long *arg0, long *arg1, long *ret) {
+#if defined(__x86_64__)
+    struct user_regs_struct r;
+    if (ptrace(PTRACE_GETREGS, tid, NULL, &r) != 0) return -1;
+    *nr = (long)r.orig_rax;
+    *arg0 = (long)r.rdi;
+    *arg1 = (long)r.rsi;
+    *ret = (long)r.rax;
+#elif defined(__aarch64__)
+    struct user_pt_regs r;
+    struct iovec iov = { &r, sizeof(r) };
+    if (ptrace(PTRACE_GETREGSET, tid, (void *)NT_PRSTATUS, &iov) != 0) return -1;
+    *nr = (long)r.regs[8];
+    *arg0 = (long)r.regs[0];
+    *arg1 = (long)r.regs[1];
+    *ret = (long)r.regs[0];
+#else
+#error "ghtrace supports x86_64 and aarch64"
+#endif
+    return 0;
+}
+
+static int path_matches(pid_t tid, long addr) {
+    if (!path_prefix) return 1;
+    size_t len = strlen(path_prefix);
+    char buf[4096];
+    if (len >= sizeof(buf)) return 0;
+    for (size_t off = 0; off < len; off += sizeof(long)) {
+        errno = 0;
+        long word = ptrace(PTRACE_PEEKDATA, tid, (void *)(addr + (long)off), NULL);
+        if (errno != 0) return 0;
+        memcpy(buf + off, &word, sizeof(long) <= sizeof(buf) - off ? sizeof(long) : sizeof(buf) - off);
+    }
+    return memcmp(buf, path_prefix, len) == 0;
+}
+
+static void latency_push(uint64_t ns) {
+    if (latency_count == latency_cap) {
+        latency_cap = latency_cap ? latency_cap * 2 : 4096;
+        latencies = realloc(latencies, latency_cap * sizeof(uint64_t));
+        if (!latencies) exit(1);
+    }
+    latencies[latency_count++] = ns;
+}
+
+static void on_syscall_stop(pid_t tid, thread_state *t) {
+    long nr, arg0, arg1, ret;
+    if (read_regs(tid, &nr, &arg0, &arg1, &ret) != 0) return;
+
+    if (!t->in_syscall) {
+        t->in_syscall = 1;
+        t->nr = nr;
+        t->arg0 = arg0;
+        t->arg1 = arg1;
+        t->t_entry = now_ns();
+        syscall_total++;
+        if (nr >= 0 && nr < SYSCALL_MAX) syscall_counts[nr]++;
+
+        if (arg0 < 0 || arg0 >= FD_MAX || !fd_open_ns[arg0]) return;
+        if (nr == SYS_read || nr == SYS_pread64) {
+            fd_was_read[arg0] = 1;
+        } else if (nr == SYS_close) {
+            if (fd_was_read[arg0]) latency_push(t->t_entry - fd_open_ns[arg0]);
+            fd_open_ns[arg0] = 0;
+            fd_was_read[arg0] = 0;
+        }
+        return;
+    }
+
+    t->in_syscall = 0;
+    long path = -1;
+    if (t->nr == SYS_openat) path = t->arg1;
+#ifdef SYS_open
+    if (t->nr == SYS_open) path = t->arg0;
+#endif
+    if (path != -1 && ret >= 0 && ret < FD_MAX && path_matches(tid, path)) fd_open_ns[ret] = t->t_entry;
+}
+
+static const char *syscall_name(long nr) {
+    static const struct { long nr; const char *name; } names[] = {
+        { SYS_read, "read" }, { SYS_pread64, "pread64" }, { SYS_write, "write" },
+        { SYS_openat, "openat" }, { SYS_close, "close" }, { SYS_lseek, "lseek" },
+        { SYS_fstat, "fstat" }, { SYS_newfstatat, "newfstatat" }, { SYS_statx, "statx" },
+        { SYS_getdents64, "getdents64" }, { SYS_mmap, "mmap" }, { SYS_munmap, "munmap" },
+        { SYS_futex, "futex" }, { SYS_brk, "brk" }, { SYS_fadvise64, "fadvise64" },
+        { SYS_io_uring_enter, "io_uring_enter" }, { SYS_clone, "clone" },
+#ifdef SYS_open
+        { SYS_open, "open" },
+#endif
+#ifdef SYS_stat
+        { SYS_stat, "stat" }, { SYS_lstat, "lstat" },
+#endif
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (names[i].nr == nr) return names[i].name;
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(FILE *out) {
+    qsort(latencies, latency_count, sizeof(uint64_t), cmp_u64);
+    fprintf(out, "syscalls %llu\n", syscall_total);
+    fprintf(out, "files %zu\n", latency_count);
+    if (latency_count) {
+        fprintf(out, "latency_p50_ns %llu\n", (unsigned long long)latencies[latency_count / 2]);
+        fprintf(out, "latency_p99_ns %llu\n", (unsigned long long)latencies[(latency_count * 99) / 100]);
+        fprintf(out, "latency_max_ns %llu\n", (unsigned long long)latencies[latency_count - 1]);
+    }
+    for (long nr = 0; nr < SYSCALL_MAX; nr++) {
+        if (!syscall_counts[nr]) continue;
+        const char *name = syscall_name(nr);
+        if (name) fprintf(out, "sys_%s %llu\n", name, syscall_counts[nr]);
+        else fprintf(out, "sys_%ld %llu\n", nr, syscall_counts[nr]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *report_path = NULL;
+    int i = 1;
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) path_prefix = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) report_path = argv[++i];
+        else if (strcmp(argv[i], "--") == 0) { i++; break; }
+        else break;
+    }
+    if (i >= argc) {
+        fprintf(stderr, "Usage: ghtrace [-p prefix] [-o report] -- <command> [args...]\n");
+        return 1;
+    }
+
+    fd_open_ns = calloc(FD_MAX, sizeof(uint64_t));
+    fd_was_read = calloc(FD_MAX, 1);
+    if (!fd_open_ns || !fd_was_read) return 1;
+
+    pid_t child = fork();
+    if (child == -1) {
+        perror("fork");
+        return 1;
+    }
+    if (child == 0) {
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        execvp(argv[i], &argv[i]);
+        perror(argv[i]);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(child, &status, 0) != child || !WIFSTOPPED(status)) {
+        fprintf(stderr, "ghtrace: failed to start %s\n", argv[i]);
+        return 1;
+    }
+    ptrace(PTRACE_SETOPTIONS, child, NULL,
+           (void *)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL));
+    int created = 0;
+    thread_get(child, &created);
+    ptrace(PTRACE_SYSCALL, child, NULL, NULL);
+
+    int exit_code = 1;
+    for (;;) {
+        pid_t tid = waitpid(-1, &status, __WALL);
+        if (tid == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            if (tid == child) exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            thread_drop(tid);
+            continue;
+        }
+        if (!WIFSTOPPED(status)) continue;
+
+        created = 0;
+        thread_state *t = thread_get(tid, &created);
+        int sig = WSTOPSIG(status);
+        int deliver = 0;
+
+        if (sig == (SIGTRAP | 0x80)) {
+            if (t) on_syscall_stop(tid, t);
+        } else if (status >> 16) {
+            // PTRACE_EVENT_CLONE: the new thread reports itself separately
+        } else if (sig == SIGSTOP && created) {
+            // Initial stop of a freshly cloned thread
+        } else {
+            deliver = sig;
+        }
+        ptrace(PTRACE_SYSCALL, tid, NULL, (void *)(long)deliver);
+    }
+
+    FILE *out = stderr;
+    if (report_path && !(out = fopen(report_path, "w"))) {
+        perror(report_path);
+        return 1;
+    }
+    report(out);
+    if (out != stderr) fclose(out);
+    return exit_code;
+}
@@ -0,0 +1,454 @@
+/*
+ * =====================================================================================
+ * micro: Microbenchmarks and regression gate for the libgh hot paths
+ * =====================================================================================
+ *
+ * Times the pieces bench/run.sh only sees end to end:
+ *   kernel/<algo>/16K       one hash kernel update over a 16KB sample
+ *   ext/<names>             gh_is_media_file() over a seeded name distribution
+ *                           ("library": mostly video, "mixed": a photo/document tree)
+ *   file/<layout>/<size>    gh_hash_path() on a file in tmpfs, so open, fstat,
+ *                           pread and close are measured without the disk
+ *   full/<path>/8M          gh_hash_full_path() on a file in tmpfs, through mmap
+ *                           and through the two streaming buffers (GH_NO_MMAP)
+ *
+ *   micro [options]
+ *
+ * Options:
+ *   -r <reps>       Timed repetitions per benchmark (default 15)
+ *   -t <ms>         Target duration of one repetition (default 20)
+ *   -d <dir>        Directory for the file benchmarks (default /dev/shm)
+ *   -f <filter>     Only run benchmarks whose name contains <filter>
+ *   -o <file>       Write the results as JSON to <file>
+ *   -b <baseline>   Compare against a JSON file written by -o
+ *   -p <percent>    Slowdown that counts as a regression (default 10)
+ *
+ * Every benchmark first calibrates how many calls fill -t milliseconds, then
+ * times -r repetitions of that many calls. It reports the mean ns/call with a
+ * 95% confidence interval (Student's t over the repetitions) and ns/byte of
+ * input. A benchmark regresses when its mean is more than -p percent slower than
+ * the baseline and the two confidence intervals do not overlap, so noise alone
+ * does not fail the gate, and so does a baseline benchmark the run no longer has.
+ * Exit status: 0 ok, 1 usage or setup error (or -f matching nothing), 2 regression.
+ *
+ * COMPILATION:
+ * gcc -O3 -march=native -o micro bench/micro.c libgh.c -pthread -lm
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#include "../libgh.h"
+
+#define MAX_BENCH 32
+#define NAME_COUNT 4096
+#define NAME_LEN 64
+#define TMPFS_MAGIC 0x01021994
+
+typedef struct bench bench;
+
+struct bench {
+    char name[48];
+    uint64_t (*run)(bench *b, uint64_t calls);   // Returns a value the compiler cannot drop
+    double bytes;             // Input bytes per call, 0 when ns/byte means nothing
+    const gh_algo *algo;
+    gh_options opt;
+    const unsigned char *data;
+    const char (*names)[NAME_LEN];
+    char path[4096];
+    // Results
+    uint64_t calls;           // Calls per repetition
+    double mean, ci;          // ns/call and its 95% half-width
+};
+
+typedef struct {
+    char name[48];
+    double mean, ci;
+} baseline_entry;
+
+static volatile uint64_t sink;
+static bench benches[MAX_BENCH];
+static char name_sets[2][NAME_COUNT][NAME_LEN];
+static unsigned char data[GH_CHUNK_SIZE] __attribute__((aligned(64)));
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ================= STATISTICS ================= */
+
+/* t_95: Two-sided 95% Student's t quantile for df degrees of freedom. */
+static double t_95(int df) {
+    static const double t[] = {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if (df < 1) return 0;
+    if (df <= 30) return t[df];
+    return df <= 60 ? 2.000 : 1.960;
+}
+
+/* measure: Calibrates b->calls to fill target_ns, then fills b->mean and b->ci. */
+static void measure(bench *b, int reps, uint64_t target_ns) {
+    uint64_t calls = 1;
+    for (;;) {
+        uint64_t t0 = clock_ns();
+        sink += b->run(b, calls);
+        uint64_t dt = clock_ns() - t0;
+        if (dt >= target_ns || calls >= (1ULL << 40)) break;
+        // Jump close to the target once a round is long enough to be trusted
+        if (dt > target_ns / 16) calls = calls * target_ns / dt + 1;
+        else calls *= 8;
+    }
+    b->calls = calls;
+
+    double sum = 0, sq = 0;
+    for (int r = 0; r < reps; r++) {
+        uint64_t t0 = clock_ns();
+        sink += b->run(b, calls);
+        double ns = (double)(clock_ns() - t0) / (double)calls;
+        sum += ns;
+        sq += ns * ns;
+    }
+    b->mean = sum / reps;
+    double var = reps > 1 ? (sq - sum * sum / reps) / (reps - 1) : 0;
+    b->ci = var > 0 ? t_95(reps - 1) * sqrt(var / reps) : 0;
+}
+
+/* ================= BENCHMARKS ================= */
+
+static uint64_t run_kernel(bench *b, uint64_t calls) {
+    unsigned long long h = b->algo->seed(GH_CHUNK_SIZE);
+    for (uint64_t i = 0; i < calls; i++) h = b->algo->update(h, b->data, GH_CHUNK_SIZE);
+    return h;
+}
+
+static uint64_t run_ext(bench *b, uint64_t calls) {
+    uint64_t hits = 0;
+    for (uint64_t i = 0; i < calls; i++) hits += (uint64_t)gh_is_media_file(b->names[i % NAME_COUNT]);
+    return hits;
+}
+
+static uint64_t run_file(bench *b, uint64_t calls) {
+    uint64_t h = 0;
+    gh_result res;
+    for (uint64_t i = 0; i < calls; i++) h += gh_hash_path(&b->opt, b->path, &res);
+    return h;
+}
+
+static uint64_t run_full(bench *b, uint64_t calls) {
+    uint64_t h = 0;
+    gh_result res;
+    for (uint64_t i = 0; i < calls; i++) {
+        gh_hash_full_path(&b->opt, b->path, &res);
+        h += res.full_hash;
+    }
+    return h;
+}
+
+/*
+ * make_names: Fills names with seeded file names. video_pct percent carry a video
+ * extension (some upper case); the rest are subtitles, metadata, images,
+ * documents and names without an extension, which all have to be rejected.
+ */
+static void make_names(char names[NAME_COUNT][NAME_LEN], int video_pct) {
+    static const char *video[] = { "mkv", "mp4", "avi", "mov", "m4v", "ts", "webm", "MKV", "MP4", "m2ts" };
+    static const char *other[] = { "srt", "nfo", "jpg", "JPG", "png", "txt", "pdf", "sub", "idx", "json", "heic", "" };
+    static const char *words[] = { "The", "Show", "Night", "Return", "Of", "Movie", "Part", "Home", "Lost", "City" };
+    static const char *tags[] = { "1080p", "2160p", "WEB-DL", "BluRay", "x264", "x265", "HDR", "DTS", "IMG", "DSC" };
+
+    for (int i = 0; i < NAME_COUNT; i++) {
+        char *buf = names[i];
+        int len = 0;
+        int nwords = 1 + (int)(rng_next() % 4);
+        for (int w = 0; w < nwords; w++) len += snprintf(buf + len, NAME_LEN - (size_t)len, "%s.", words[rng_next() % 10]);
+        if (rng_next() % 2) len += snprintf(buf + len, NAME_LEN - (size_t)len, "S%02uE%02u.", (unsigned)(rng_next() % 12), (unsigned)(rng_next() % 24));
+        len += snprintf(buf + len, NAME_LEN - (size_t)len, "%s", tags[rng_next() % 10]);
+        const char *ext = (int)(rng_next() % 100) < video_pct ? video[rng_next() % 10] : other[rng_next() % 12];
+        if (*ext) snprintf(buf + len, NAME_LEN - (size_t)len, ".%s", ext);
+    }
+}
+
+/* make_file: Writes size bytes of data (repeated), or only the sampled regions when sparse. */
+static int make_file(const char *path, uint64_t size, const unsigned char *data, int sparse) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return -1;
+    int rc = ftruncate(fd, (off_t)size);
+    if (sparse) {
+        int64_t offsets[GH_SAMPLE_MAX];
+        int n = gh_sample_layout(GH_LAYOUT_V2, size, offsets);
+        for (int i = 0; i < n && rc == 0; i++) {
+            if (pwrite(fd, data, GH_CHUNK_SIZE, (off_t)offsets[i]) != GH_CHUNK_SIZE) rc = -1;
+        }
+        n = gh_sample_offsets(size, offsets);
+        for (int i = 0; i < n && rc == 0; i++) {
+            if (pwrite(fd, data, GH_CHUNK_SIZE, (off_t)offsets[i]) != GH_CHUNK_SIZE) rc = -1;
+        }
+    } else {
+        for (uint64_t off = 0; off < size && rc == 0; off += GH_CHUNK_SIZE) {
+            size_t len = size - off < GH_CHUNK_SIZE ? (size_t)(size - off) : GH_CHUNK_SIZE;
+            if (pwrite(fd, data, len, (off_t)off) != (ssize_t)len) rc = -1;
+        }
+    }
+    if (close(fd) != 0) rc = -1;
+    return rc;
+}
+
+static void cleanup(char created[][4096], int n, const char *dir) {
+    for (int i = 0; i < n; i++) unlink(created[i]);
+    rmdir(dir);
+}
+
+/* ================= BASELINE ================= */
+
+/* load_baseline: Reads the "name", "ns_per_call" and "ci95" of every benchmark line written by write_json(). */
+static int load_baseline(const char *path, baseline_entry *out, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char line[512];
+    int n = 0;
+    while (n < max && fgets(line, sizeof(line), f)) {
+        char *name = strstr(line, "\"name\": \"");
+        char *mean = strstr(line, "\"ns_per_call\": ");
+        char *ci = strstr(line, "\"ci95\": ");
+        if (!name || !mean || !ci) continue;
+        name += 9;
+        char *end = strchr(name, '"');
+        if (!end || (size_t)(end - name) >= sizeof(out[n].name)) continue;
+        memcpy(out[n].name, name, (size_t)(end - name));
+        out[n].name[end - name] = '\0';
+        out[n].mean = strtod(mean + 15, NULL);
+        out[n].ci = strtod(ci + 8, NULL);
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+static int write_json(const char *path, bench *b, int n, int reps, uint64_t target_ns) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "{\"micro\": 1, \"vec64\": \"%s\", \"reps\": %d, \"target_ms\": %llu, \"benchmarks\": [\n",
+            gh_vec64_impl(), reps, (unsigned long long)(target_ns / 1000000));
+    for (int i = 0; i < n; i++) {
+        fprintf(f, " {\"name\": \"%s\", \"calls\": %llu, \"ns_per_call\": %.3f, \"ci95\": %.3f, \"ns_per_byte\": %.6f}%s\n",
+                b[i].name, (unsigned long long)b[i].calls, b[i].mean, b[i].ci,
+                b[i].bytes > 0 ? b[i].mean / b[i].bytes : 0, i + 1 < n ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* ================= MAIN ================= */
+
+static void usage(void) {
+    fprintf(stderr, "Usage: micro [-r reps] [-t ms] [-d dir] [-f filter] [-o results.json] [-b baseline.json] [-p percent]\n");
+}
+
+int main(int argc, char *argv[]) {
+    int reps = 15;
+    long target_ms = 20;
+    const char *dir = "/dev/shm";
+    const char *filter = NULL;
+    const char *json = NULL;
+    const char *baseline = NULL;
+    double max_pct = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            target_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            json = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            max_pct = atof(argv[++i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (reps < 2 || target_ms < 1 || max_pct < 0) {
+        usage();
+        return 1;
+    }
+    uint64_t target_ns = (uint64_t)target_ms * 1000000ULL;
+
+    baseline_entry base[MAX_BENCH];
+    int nbase = 0;
+    if (baseline && (nbase = load_baseline(baseline, base, MAX_BENCH)) <= 0) {
+        fprintf(stderr, "micro: no benchmarks in %s\n", baseline);
+        return 1;
+    }
+
+    struct statfs sfs;
+    if (statfs(dir, &sfs) != 0 || sfs.f_type != TMPFS_MAGIC) {
+        fprintf(stderr, "micro: warning: %s is not tmpfs, file benchmarks include the page cache lookup of a disk filesystem\n", dir);
+    }
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s/gh-micro.XXXXXX", dir);
+    if (!mkdtemp(tmp)) {
+        fprintf(stderr, "micro: cannot create a directory in %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    rng_state = 1;
+    for (size_t i = 0; i < GH_CHUNK_SIZE; i += 8) {
+        uint64_t v = rng_next();
+        memcpy(data + i, &v, 8);
+    }
+
+    int n = 0;
+
+    static const char *kernels[] = { "fnv1a", "vec64" };
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        bench *b = &benches[n++];
+        snprintf(b->name, sizeof(b->name), "kernel/%s/16K", kernels[k]);
+        b->run = run_kernel;
+        b->algo = gh_algo_find(kernels[k]);
+        b->data = data;
+        b->bytes = GH_CHUNK_SIZE;
+    }
+
+    static const struct { const char *name; int video_pct; } sets[] = { { "library", 85 }, { "mixed", 10 } };
+    for (size_t s = 0; s < sizeof(sets) / sizeof(sets[0]); s++) {
+        bench *b = &benches[n++];
+        snprintf(b->name, sizeof(b->name), "ext/%s", sets[s].name);
+        b->run = run_ext;
+        make_names(name_sets[s], sets[s].video_pct);
+        b->names = (const char (*)[NAME_LEN])name_sets[s];
+    }
+
+    static const struct { const char *name; uint64_t size; unsigned layout; int sparse; } files[] = {
+        { "v1/8K", 8 << 10, GH_LAYOUT_V1, 0 },
+        { "v1/1M", 1 << 20, GH_LAYOUT_V1, 0 },
+        { "v1/4G", 4ULL << 30, GH_LAYOUT_V1, 1 },
+        { "v2/4G", 4ULL << 30, GH_LAYOUT_V2, 1 },
+    };
+    char created[8][4096];
+    int ncreated = 0;
+    int setup_errno = 0;
+    for (size_t f = 0; f < sizeof(files) / sizeof(files[0]); f++) {
+        bench *b = &benches[n++];
+        snprintf(b->name, sizeof(b->name), "file/%s", files[f].name);
+        snprintf(b->path, sizeof(b->path), "%s/f%zu.mkv", tmp, f);
+        snprintf(created[ncreated++], sizeof(created[0]), "%s", b->path);
+        b->run = run_file;
+        b->opt.layout = files[f].layout;
+        if (!setup_errno && make_file(b->path, files[f].size, data, files[f].sparse) != 0) setup_errno = errno;
+        gh_result res;
+        if (!gh_hash_path(&b->opt, b->path, &res) && !setup_errno) setup_errno = res.error ? res.error : EIO;
+        b->bytes = (double)res.bytes_read;   // Sampled bytes, not the file size
+    }
+    // The mmap path and the two-buffer streaming path of the same file
+    snprintf(created[ncreated], sizeof(created[0]), "%s/full.mkv", tmp);
+    if (!setup_errno && make_file(created[ncreated], 8 << 20, data, 0) != 0) setup_errno = errno;
+    static const struct { const char *name; unsigned flags; } full[] = { { "mmap", 0 }, { "stream", GH_NO_MMAP } };
+    for (size_t f = 0; f < sizeof(full) / sizeof(full[0]); f++) {
+        bench *b = &benches[n++];
+        snprintf(b->name, sizeof(b->name), "full/%s/8M", full[f].name);
+        snprintf(b->path, sizeof(b->path), "%s", created[ncreated]);
+        b->run = run_full;
+        b->opt.flags = full[f].flags;
+        b->bytes = 8 << 20;
+    }
+    ncreated++;
+    if (setup_errno) {
+        fprintf(stderr, "micro: cannot set up the test files in %s: %s\n", tmp, strerror(setup_errno));
+        cleanup(created, ncreated, tmp);
+        return 1;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        if (!filter || strstr(benches[i].name, filter)) benches[kept++] = benches[i];
+    }
+    n = kept;
+    if (n == 0) {
+        fprintf(stderr, "micro: no benchmark matches '%s'\n", filter);
+        cleanup(created, ncreated, tmp);
+        return 1;
+    }
+
+    printf("vec64:  %s\n", gh_vec64_impl());
+    printf("runs:   %d x %ld ms per benchmark\n\n", reps, target_ms);
+    printf("%-18s %12s %12s %9s %10s%s\n", "benchmark", "calls/rep", "ns/call", "+-95%", "ns/byte", baseline ? "   vs baseline" : "");
+    int regressions = 0;
+    for (int i = 0; i < n; i++) {
+        bench *b = &benches[i];
+        measure(b, reps, target_ns);
+        printf("%-18s %12llu %12.1f %9.1f ", b->name, (unsigned long long)b->calls, b->mean, b->ci);
+        if (b->bytes > 0) printf("%10.4f", b->mean / b->bytes);
+        else printf("%10s", "-");
+        if (baseline) {
+            baseline_entry *e = NULL;
+            for (int j = 0; j < nbase; j++) {
+                if (strcmp(base[j].name, b->name) == 0) { e = &base[j]; break; }
+            }
+            if (!e || e->mean <= 0) {
+                printf("   new");
+            } else {
+                double pct = (b->mean / e->mean - 1) * 100;
+                int slower = pct > max_pct && b->mean - b->ci > e->mean + e->ci;
+                printf("   %+6.1f%%%s", pct, slower ? "  REGRESSED" : "");
+                regressions += slower;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    cleanup(created, ncreated, tmp);
+
+    // A baseline benchmark that no longer runs would otherwise pass the gate unnoticed
+    int missing = 0;
+    for (int j = 0; j < nbase; j++) {
+        if (filter && !strstr(base[j].name, filter)) continue;
+        int found = 0;
+        for (int i = 0; i < n && !found; i++) found = strcmp(base[j].name, benches[i].name) == 0;
+        if (!found) {
+            fprintf(stderr, "micro: %s is in the baseline but was not run\n", base[j].name);
+            missing++;
+        }
+    }
+
+    if (json && write_json(json, benches, n, reps, target_ns) != 0) {
+        fprintf(stderr, "micro: cannot write %s: %s\n", json, strerror(errno));
+        return 1;
+    }
+    if (baseline) {
+        printf("\n%d regression%s over %.0f%%, %d missing against %s\n", regressions, regressions == 1 ? "" : "s", max_pct, missing, baseline);
+        if (regressions || missing) return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,272 @@
+/*
+ * =====================================================================================
+ * mkcorpus: Reproducible synthetic media tree for benchmarking gh
+ * =====================================================================================
+ *
+ * Builds N files spread over a balanced directory tree. Sizes and contents
+ * come from a seeded PRNG, so the same arguments always give the same tree.
+ *
+ *   mkcorpus [options] <dir>        Generate the corpus into <dir>
+ *   mkcorpus --evict <dir>          Drop the page cache for every file under <dir>
+ *
+ * Options:
+ *   -n <files>      Number of files (default 2000)
+ *   -s <dist>       Size distribution:
+ *                     fixed:<size>
+ *                     uniform:<min>:<max>
+ *                     lognormal:<median>:<sigma>   (default lognormal:256K:1.5)
+ *                   Sizes accept K, M and G suffixes.
+ *   -f <fanout>     Files per leaf directory and subdirectories per level (default 100)
+ *   --sparse        Only write small markers at head/middle/tail, leave holes elsewhere
+ *   --dense         Write every byte (default)
+ *   --seed <n>      PRNG seed (default 1)
+ *
+ * A manifest (.mkcorpus) records the parameters; bench/run.sh uses it to decide
+ * whether an existing corpus can be reused.
+ *
+ * COMPILATION:
+ * gcc -O2 -o mkcorpus bench/mkcorpus.c -lm
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+#define WRITE_BUF_SIZE (1 << 20)
+#define MARKER_SIZE 64
+
+enum { DIST_FIXED, DIST_UNIFORM, DIST_LOGNORMAL };
+
+typedef struct {
+    int kind;
+    double a, b;
+} size_dist;
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double rng_unit(void) {
+    return (double)(rng_next() >> 11) / 9007199254740992.0;   // [0, 1)
+}
+
+static int parse_size(const char *s, double *out) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1;
+    switch (*end) {
+        case 'k': case 'K': v *= 1024.0; end++; break;
+        case 'm': case 'M': v *= 1048576.0; end++; break;
+        case 'g': case 'G': v *= 1073741824.0; end++; break;
+        default: break;
+    }
+    if (*end != '\0' && *end != ':') return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_dist(const char *spec, size_dist *d) {
+    const char *arg = strchr(spec, ':');
+    if (!arg) return -1;
+    arg++;
+    if (strncmp(spec, "fixed:", 6) == 0) {
+        d->kind = DIST_FIXED;
+        return parse_size(arg, &d->a);
+    }
+    const char *second = strchr(arg, ':');
+    if (!second) return -1;
+    if (strncmp(spec, "uniform:", 8) == 0) {
+        d->kind = DIST_UNIFORM;
+        if (parse_size(arg, &d->a) != 0 || parse_size(second + 1, &d->b) != 0 || d->b < d->a) return -1;
+        return 0;
+    }
+    if (strncmp(spec, "lognormal:", 10) == 0) {
+        d->kind = DIST_LOGNORMAL;
+        if (parse_size(arg, &d->a) != 0) return -1;
+        d->b = strtod(second + 1, NULL);
+        return d->b > 0 ? 0 : -1;
+    }
+    return -1;
+}
+
+static uint64_t draw_size(const size_dist *d) {
+    switch (d->kind) {
+        case DIST_FIXED:
+            return (uint64_t)d->a;
+        case DIST_UNIFORM:
+            return (uint64_t)(d->a + rng_unit() * (d->b - d->a));
+        default: {
+            // Box-Muller; both draws are always consumed to keep the stream stable
+            double u1 = rng_unit(), u2 = rng_unit();
+            double z = sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * M_PI * u2);
+            return (uint64_t)(d->a * exp(d->b * z));
+        }
+    }
+}
+
+static void fill_random(unsigned char *buf, size_t len, uint64_t seed) {
+    uint64_t x = seed | 1;
+    for (size_t i = 0; i + 8 <= len; i += 8) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        memcpy(buf + i, &x, 8);
+    }
+    for (size_t i = len & ~(size_t)7; i < len; i++) buf[i] = (unsigned char)(x >> (8 * (i & 7)));
+}
+
+static int mkdir_p(char *path) {
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+/**
+ * write_file: Creates one corpus file. Dense files get pseudo-random bytes
+ * everywhere; sparse files only get unique markers where gh samples.
+ */
+static int write_file(const char *path, uint64_t size, uint64_t seed, int sparse, unsigned char *buf) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return -1;
+    int rc = 0;
+
+    if (sparse) {
+        if (ftruncate(fd, (off_t)size) != 0) rc = -1;
+        uint64_t offsets[3] = { 0, size / 2, size > MARKER_SIZE ? size - MARKER_SIZE : 0 };
+        for (int i = 0; i < 3 && rc == 0 && size > 0; i++) {
+            size_t len = size < MARKER_SIZE ? (size_t)size : MARKER_SIZE;
+            fill_random(buf, len, seed + (uint64_t)i);
+            if (pwrite(fd, buf, len, (off_t)offsets[i]) != (ssize_t)len) rc = -1;
+        }
+    } else {
+        for (uint64_t off = 0; off < size && rc == 0; off += WRITE_BUF_SIZE) {
+            size_t len = size - off < WRITE_BUF_SIZE ? (size_t)(size - off) : WRITE_BUF_SIZE;
+            fill_random(buf, len, seed ^ (off * 0x9E3779B97F4A7C15ULL));
+            if (write(fd, buf, len) != (ssize_t)len) rc = -1;
+        }
+    }
+    if (close(fd) != 0) rc = -1;
+    return rc;
+}
+
+static int evict_one(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)ftw;
+    if (type != FTW_F) return 0;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return 0;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: mkcorpus [-n files] [-s dist] [-f fanout] [--sparse|--dense] [--seed n] <dir>\n");
+    fprintf(stderr, "       mkcorpus --evict <dir>\n");
+    fprintf(stderr, "  dist: fixed:<size> | uniform:<min>:<max> | lognormal:<median>:<sigma>\n");
+}
+
+int main(int argc, char *argv[]) {
+    long files = 2000;
+    long fanout = 100;
+    int sparse = 0;
+    uint64_t seed = 1;
+    const char *dist_spec = "lognormal:256K:1.5";
+    const char *dir = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--evict") == 0 && i + 1 < argc) {
+            return nftw(argv[i + 1], evict_one, 64, FTW_PHYS) == 0 ? 0 : 1;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            files = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            dist_spec = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            fanout = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--sparse") == 0) {
+            sparse = 1;
+        } else if (strcmp(argv[i], "--dense") == 0) {
+            sparse = 0;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && !dir) {
+            dir = argv[i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    size_dist dist;
+    if (!dir || files < 1 || fanout < 2 || parse_dist(dist_spec, &dist) != 0) {
+        usage();
+        return 1;
+    }
+
+    // Depth of the directory tree: enough base-fanout digits for the leaf index
+    long leaves = (files + fanout - 1) / fanout;
+    int depth = 0;
+    for (long span = 1; span < leaves; span *= fanout) depth++;
+
+    unsigned char *buf = malloc(WRITE_BUF_SIZE);
+    char path[4096];
+    if (!buf) return 1;
+    rng_state = seed;
+
+    uint64_t total = 0;
+    for (long i = 0; i < files; i++) {
+        int len = snprintf(path, sizeof(path), "%s", dir);
+        long leaf = i / fanout;
+        long digits[64];
+        for (int d = depth - 1; d >= 0; d--) {
+            digits[d] = leaf % fanout;
+            leaf /= fanout;
+        }
+        for (int d = 0; d < depth; d++) len += snprintf(path + len, sizeof(path) - (size_t)len, "/d%03ld", digits[d]);
+        if (mkdir_p(path) != 0) {
+            fprintf(stderr, "mkcorpus: cannot create %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        snprintf(path + len, sizeof(path) - (size_t)len, "/f%07ld.mkv", i);
+
+        uint64_t size = draw_size(&dist);
+        if (write_file(path, size, rng_next(), sparse, buf) != 0) {
+            fprintf(stderr, "mkcorpus: cannot write %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        total += size;
+    }
+    free(buf);
+
+    snprintf(path, sizeof(path), "%s/.mkcorpus", dir);
+    FILE *m = fopen(path, "w");
+    if (!m) return 1;
+    fprintf(m, "files=%ld dist=%s fanout=%ld sparse=%d seed=%llu bytes=%llu\n",
+            files, dist_spec, fanout, sparse, (unsigned long long)seed, (unsigned long long)total);
+    fclose(m);
+
+    printf("%ld files, %.2f MB, depth %d\n", files, total / 1048576.0, depth);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#!/usr/bin/env bash
+# =====================================================================================
+# bench/run.sh: Reproducible cold/warm page-cache benchmark for gh
+# =====================================================================================
+#
+# Builds gh and the bench tools, generates (or reuses) a synthetic corpus,
+# then does timed runs with the page cache dropped ("cold") and populated
+# ("warm"). Per-file latency percentiles come from gh's own --stats-json of
+# the median run; one extra ptrace run per mode counts syscalls.
+#
+#   bench/run.sh [options] [-- <extra gh options>]
+#
+# Options:
+#   -n <files>      Number of files (default 2000)
+#   -s <dist>       Size distribution, see bench/mkcorpus.c (default lognormal:256K:1.5)
+#   -f <fanout>     Directory fan-out (default 100)
+#   --sparse        Sparse corpus files (holes between the sampled regions)
+#   --seed <n>      Corpus seed (default 1)
+#   -r <runs>       Timed runs per mode (default 5)
+#   -d <dir>        Work directory for binaries and corpora (default $TMPDIR/gh-bench)
+#   -g <gh>         Benchmark this gh binary instead of building ./gh.c
+#   -o <file>       Also write the results as JSON to <file>
+#
+# Cold runs use /proc/sys/vm/drop_caches when it is writable (root). Otherwise
+# every corpus file gets POSIX_FADV_DONTNEED, which evicts file data but leaves
+# dentries and inodes cached.
+# =====================================================================================
+
+set -euo pipefail
+
+here="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+root="$(dirname "$here")"
+
+files=2000
+dist="lognormal:256K:1.5"
+fanout=100
+sparse=""
+seed=1
+runs=5
+work="${TMPDIR:-/tmp}/gh-bench"
+gh=""
+json=""
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        -n) files="$2"; shift 2 ;;
+        -s) dist="$2"; shift 2 ;;
+        -f) fanout="$2"; shift 2 ;;
+        --sparse) sparse="--sparse"; shift ;;
+        --seed) seed="$2"; shift 2 ;;
+        -r) runs="$2"; shift 2 ;;
+        -d) work="$2"; shift 2 ;;
+        -g) gh="$2"; shift 2 ;;
+        -o) json="$2"; shift 2 ;;
+        --) shift; break ;;
+        -h|--help) sed -n '2,27p' "$0" | sed 's/^# \{0,1\}//'; exit 0 ;;
+        *) echo "Error: unknown option $1" >&2; exit 1 ;;
+    esac
+done
+gh_opts=("$@")
+
+mkdir -p "$work/bin"
+cc="${CC:-gcc}"
+"$cc" -O2 -o "$work/bin/mkcorpus" "$here/mkcorpus.c" -lm
+"$cc" -O2 -o "$work/bin/ghtrace" "$here/ghtrace.c"
+if [ -z "$gh" ]; then
+    "$cc" -O3 -march=native -o "$work/bin/gh" "$root/gh.c" "$root/libgh.c" -pthread
+    gh="$work/bin/gh"
+fi
+
+# Corpora are keyed on their parameters so different shapes can coexist
+key="n${files}_f${fanout}_s$(echo "$dist" | tr ':' '_')_seed${seed}${sparse:+_sparse}"
+corpus="$work/corpus-$key"
+manifest="files=$files dist=$dist fanout=$fanout sparse=$([ -n "$sparse" ] && echo 1 || echo 0) seed=$seed"
+if [ ! -f "$corpus/.mkcorpus" ] || ! grep -q "^$manifest " "$corpus/.mkcorpus"; then
+    rm -rf "$corpus"
+    echo "Generating corpus in $corpus"
+    "$work/bin/mkcorpus" -n "$files" -s "$dist" -f "$fanout" $sparse --seed "$seed" "$corpus"
+fi
+bytes="$(sed -n 's/.* bytes=\([0-9]*\).*/\1/p' "$corpus/.mkcorpus")"
+
+drop_caches() {
+    sync
+    if [ -w /proc/sys/vm/drop_caches ]; then
+        echo 3 > /proc/sys/vm/drop_caches
+    else
+        "$work/bin/mkcorpus" --evict "$corpus"
+    fi
+}
+
+now_ns() { date +%s%N; }
+
+# json_field <file> <key>: first numeric value of "key" in a one-line JSON file
+json_field() {
+    sed -n "s/.*\"$2\": \([0-9.]*\).*/\1/p" "$1"
+}
+
+# run_mode <cold|warm>: prints "median_ms files_per_s p50_us p99_us syscalls_per_file"
+run_mode() {
+    local mode="$1" times=() t0 t1
+    [ "$mode" = warm ] && "$gh" -r "${gh_opts[@]}" "$corpus" > /dev/null
+    for r in $(seq "$runs"); do
+        [ "$mode" = cold ] && drop_caches
+        t0="$(now_ns)"
+        "$gh" -r --stats-json "${gh_opts[@]}" "$corpus" | tail -n 1 > "$work/stats-$mode-$r.json"
+        t1="$(now_ns)"
+        times+=("$(( (t1 - t0) / 1000 )) $r")
+    done
+    local median_us median_run
+    read -r median_us median_run < <(printf '%s\n' "${times[@]}" | sort -n | awk '{a[NR]=$0} END {print a[int((NR + 1) / 2)]}')
+    cp "$work/stats-$mode-$median_run.json" "$work/stats-$mode.json"
+
+    [ "$mode" = cold ] && drop_caches
+    local report="$work/trace-$mode.txt"
+    "$work/bin/ghtrace" -p "$corpus/" -o "$report" -- "$gh" -r "${gh_opts[@]}" "$corpus" > /dev/null
+
+    local p50 p99 syscalls
+    p50="$(json_field "$work/stats-$mode.json" p50)"
+    p99="$(json_field "$work/stats-$mode.json" p99)"
+    syscalls="$(awk '$1 == "syscalls" {print $2}' "$report")"
+    awk -v us="$median_us" -v files="$files" -v p50="${p50:-0}" -v p99="${p99:-0}" -v sc="$syscalls" 'BEGIN {
+        printf "%.3f %.0f %.1f %.1f %.2f\n", us / 1000, files / (us / 1e6), p50 / 1000, p99 / 1000, sc / files
+    }'
+}
+
+echo "gh:     $gh ${gh_opts[*]}"
+echo "corpus: $files files, $(( bytes / 1048576 )) MB, fan-out $fanout, $dist${sparse:+, sparse}"
+echo "runs:   $runs per mode"
+echo
+printf '%-6s %12s %12s %10s %10s %14s\n' mode median_ms files/s p50_us p99_us syscalls/file
+results=()
+for mode in cold warm; do
+    read -r ms fps p50 p99 spf < <(run_mode "$mode")
+    printf '%-6s %12s %12s %10s %10s %14s\n' "$mode" "$ms" "$fps" "$p50" "$p99" "$spf"
+    results+=("\"$mode\": {\"median_ms\": $ms, \"files_per_s\": $fps, \"p50_us\": $p50, \"p99_us\": $p99, \"syscalls_per_file\": $spf}")
+done
+echo
+echo "Latency: gh --stats-json of the median run ($work/stats-*.json)."
+echo "Syscalls: a separate ptrace run ($work/trace-*.txt)."
+
+if [ -n "$json" ]; then
+    {
+        printf '{"files": %s, "bytes": %s, "dist": "%s", "fanout": %s, "sparse": %s, "seed": %s, "runs": %s,\n' \
+            "$files" "$bytes" "$dist" "$fanout" "$([ -n "$sparse" ] && echo true || echo false)" "$seed" "$runs"
+        printf ' %s,\n %s}\n' "${results[0]}" "${results[1]}"
+    } > "$json"
+fi
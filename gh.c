@@ -20,13 +20,150 @@
  * disk, which is nearly instantaneous on SSDs.
  * 
  * COMPILATION:
- * gcc -O3 -march=native -flto -o gh gh2.c
+ * gcc -O3 -march=native -flto -o gh gh.c libgh.c -pthread
  * =====================================================================================
  */
 
 /*
 VERSION HISTORY:
 
+v0.48
+-Path Buffers: The classic walker (gh_walk*) and the --watch tree scan keep one path buffer per walk. Each level appends "/name" and truncates it again on the way out, replacing a PATH_MAX buffer and a full snprintf per directory entry and recursion level. Paths are no longer cut off at PATH_MAX by the walker.
+-Reused Buffers: libgh hashes into aligned sample buffers that each thread keeps for its next file instead of a 20KB stack array, and --full streams through two 8MB buffers per thread instead of allocating (and page-faulting) both for every file: streaming six 10-15MB files got 13% faster. Worker pool slots keep their path buffer, so queuing a file no longer strdup()s and frees its path. A steady-state scan allocates nothing per file on these paths.
+
+v0.47
+-Memory Limit: Added --mem-limit <size> (e.g. 512M, 4G) for --dupes on trees whose index does not fit in RAM. The size prefilter and the duplicate index each get half of it. A limited table keeps fixed 64-byte records (size, hash, dev, ino, mtime, arrival order, path offset) at the front of one buffer and the paths at its back. When the two meet, the records are heapsorted in place and written with their paths as a sorted run to an unlinked file in $TMPDIR. A final k-way merge replays the runs in (size, hash) order, one group at a time, through the usual prefilter and report code, including --confirm and hard link handling. Its read buffers (at least 16KB per run) come out of the same limit; when there are more runs than fit, they are first merged into fewer, longer ones in extra passes.
+-Bounded: Peak RSS follows the flag instead of the file count: a 120,000-file scan peaks at 10MB with --mem-limit 8M against 46MB without. Groups are then reported by size and hash instead of first-seen order; the files within a group keep the order they were found in, and a summary line tells how much was spilled.
+
+v0.46
+-Compare Mode: Added --compare <a> <b>, which reads two logs (text, NDJSON or binary, any mix, one kernel) and reports every file that changed, moved (same hash under a new path), was added or was removed, in path order, with a tally. Exits 1 if the logs differ, so a replication job can check two sites without diffing 10M-line logs by hand.
+-Compact Records: Both logs stay mapped and each line becomes a 32-byte record pointing at its path in the mapping; only escaped NDJSON paths are decoded, into 1MB blocks. Each side is sorted by path once, and two linear merges pair up the paths and then the hashes found on one side only. Two 2M-line text logs compare in 2 seconds. --verify and --merge read logs through the same parser.
+
+v0.45
+-Hard Links: Recursive scans and --files-from keep the (st_dev, st_ino) of every file in an open-addressing set. A second path to an inode that is already hashed, or on its way through the workers, takes that hash and is printed without being opened. --dupes no longer counts hard links as extra copies: a size group of links to one inode is not opened, --confirm does not compare links, and the summary says how many members were links.
+-Follow Symlinks: Added -L/--follow. Both walkers follow symbolic links to files and directories; a directory whose inode was already walked is skipped, so link cycles and links to a tree that is also scanned directly are walked once.
+
+v0.44
+-Progress Reporter: The progress bar of -s is back, and --progress shows it in any mode. A reporter thread redraws one stderr line 10 times a second with files/s and MB/s (logical size) over the last two seconds; once every file is counted, a bar, the count and an ETA follow. The parallel walker (-W) lists ahead of the hashers and reports when the last tree is fully listed, so the ETA shows up early in a scan, not at its end. Without a terminal it prints one line a second instead.
+-Hot Path: The walker, the hasher and the writer only bump counters in a block of their own with relaxed stores, like the --stats blocks; nothing on the per-file path formats text or writes to the terminal, and there is no counting pre-pass.
+
+v0.43
+-Prefetch: Added --prefetch <K> for single-threaded runs, e.g. on kernels or containers without io_uring. The hasher keeps K files ahead of itself already open, with POSIX_FADV_WILLNEED issued on their sample ranges, so their reads are in flight while the current file is hashed. A cold scan of 1500 files ran 1.8x faster with K = 32. Output order is unchanged.
+-Shared Tail: scan_hash(), the elevator and the prefetcher publish results through one scan_emit(), and hash_fd_stat() hashes a descriptor that is already open with the usual --stats accounting.
+
+v0.42
+-Elevator: Added --elevator for spinning disks. Files from the walker, --files-from, --dupes and --verify are gathered 256 at a time, opened, and each sample is located on disk with FIEMAP (falling back to the inode number where the filesystem cannot tell). All sample reads of the window are then issued in one ascending sweep per device instead of three seeks per file in readdir order. Readahead is turned off so nothing is read between the sorted samples.
+-Resequenced Output: Hashes are assembled and printed in the order the files were queued, so every output format, --verify and the cache see exactly what a walk-order run produces. With --full, whole files are streamed in the order of their first block. The sweep runs on one thread; -j, --io and --watch do not apply.
+
+v0.41
+-Sampling Layout v2: Added --layout v1|v2. v2 aligns every sample to 4KB, so a sample no longer straddles an extra block on HDDs and network storage, and takes more samples on large files: 3 below 512MB, plus one at 512MB and at every doubling (11 at 100GB, 16 at most), evenly spaced from the head to the last 16KB. All samples of a file are requested with WILLNEED in one batch before the first read; the io_uring engine already submits them together.
+-Recorded Layout: v1 stays the default and its hashes are unchanged. v2 logs name the kernel "<kernel>-v2" (NDJSON records carry "layout":2), caches key v2 fingerprints apart, and --verify/--merge take the layout from the log and refuse to mix layouts.
+
+v0.40
+-Full Hash: Added --full, which hashes every byte instead of the three samples, for settling sparse collisions (remuxes, tail-padded files) without a separate sha256sum pass. It reuses the walker, the worker pool and every output format; the digest is the chosen kernel run over 1MB blocks, seeded with the size as usual, so vec64 keeps up with fast devices.
+-Streaming I/O: Local files are mmap'd in 64MB windows with MADV_SEQUENTIAL, the next window requested while the current one is hashed. --remote, --pagecache drop/direct and --watch read into two 8MB aligned buffers instead, one filled by a helper thread while the other is hashed.
+-Sparse In Passing: gh_hash_full_path() captures the sample ranges as they stream by, so libgh callers get the sparse fingerprint of the same bytes in res.hash alongside res.full_hash.
+-Labelled Digests: Logs name the kernel "<kernel>-full" (NDJSON records carry "full":true) and the cache keys full digests apart, so --verify and --merge pick the mode up from the log and never compare a digest with a fingerprint.
+
+v0.39
+-Sharding: Added --shard i/N so several machines sharing a mount can split one scan. Each file goes to the shard picked by FNV-1a (plus a 64-bit finalizer) of its path below the scanned root, so shares are balanced per file rather than per directory, identical on every node whatever the mount point is called, and stable across runs. A file named on the command line is its own root and goes by its file name, with or without -r; --files-from entries use the path as listed. Text logs record the shard in their header.
+-Cheap Skips: Every node still lists the whole tree, but files of other shards are dropped before they are hashed, and --files-from entries before they are stat'ed. --dupes and --watch refuse --shard, since duplicates and changes span shards.
+-Merge: Added --merge, which reads per-shard logs (text, NDJSON, binary, any mix, one kernel) and writes a single result sorted by path in the chosen --format, so the combined log does not depend on how the work was split. It shares the log reader with --verify.
+-Option Table: The second pass over argv and --merge step over option values through one option_has_value() list.
+
+v0.38
+-Extension Filter: Added --ext <list> and --exclude-ext <list> (comma-separated, any case, dot optional), so disc images, MXF and camera raw formats such as .iso, .vob, .mxf, .r3d and .braw can be scanned, and unwanted defaults dropped.
+-Constant-Time Lookup: The filter is compiled at startup into a gh_ext_set, an open-addressing table of extensions packed into 64-bit integers. A name check is one strrchr, a pack of at most 8 bytes and usually a single compare, replacing the strncpy, tolower and twelve strcmp calls per directory entry.
+-Before Stat: The classic walker now filters on d_name and d_type (gh_walk_ext), so files with other extensions, symlinks and special files are never lstat'ed; directories and DT_UNKNOWN entries still are. On a tree of 2,000 documents around one video, a scan goes from 2,002 lstat calls to 2. The parallel walker already read d_type and now uses the same table.
+
+v0.37
+-Verify Mode: Added --verify <log>, which rehashes every file of a previous run and reports mismatches, missing and unreadable files, so bit-rot and swapped files show up without diffing logs by hand. It reads text logs (both the "<hash>  <path>" lines and the File/Path/Hash blocks), --format ndjson and --format binary, and uses the kernel the log was written with. Exits 1 if anything differs.
+-Parallel: Files go through the worker pool (-j, 8 workers by default; --io uring and --remote work too) in log order, so the report follows the log. The fingerprint cache is bypassed, since bit-rot does not change the size or mtime it keys on.
+-Size First: NDJSON and binary logs record the size, so every file is stat'ed before it is queued and one whose size changed is reported without being read. A --watch log that lists a file several times is checked against its last line.
+-Fail Fast: --fail-fast stops queuing files at the first problem, for CI-style integrity gates over large archives. Files that were never checked are counted in the summary.
+
+v0.36
+-Machine-Readable Output: Added --format <text|ndjson|binary>. Pipelines no longer have to strip ANSI colors and guess where a path with spaces ends. Records go to the -l file, or to stdout when there is no log (the progress bar, summary and warnings then go to stderr).
+-NDJSON: One object per file with hash, size, dev, ino, mtime_ns and path, plus the group number under --dupes. Paths are escaped per JSON, so any byte sequence survives.
+-Binary: A gh_record_header (magic, byte order, kernel, version) and then 8-byte aligned, length-prefixed gh_records laid out in libgh.h, so a consumer can mmap the file and walk it without parsing. A --watch daemon appends to its log after a restart only if the existing header matches.
+-No Extra Syscalls: The size, device, inode and mtime come from the fstat the hash already did, and cache hits reuse the stat that found them.
+
+v0.35
+-Embeddable Library: The sampling, the hash kernels and the classic walker moved to libgh.c/libgh.h, so players and ingest services can fingerprint in-process instead of spawning gh and parsing its colored output. gh_hash_path() and gh_hash_fd() hash one file, and gh_hash_many() hashes a batch (optionally walking directories) and reports each result to a callback.
+-No Global State: Kernel, --pagecache and --remote travel in a gh_options, and size, device, inode, mtime, I/O counters and (with GH_TIMING) per-phase times come back in a gh_result. The library never touches log_fp, silent_mode or any other CLI setting, so its calls are reentrant.
+-Thin CLI: gh now links libgh. hash_path_stat() wraps gh_hash_path() and turns the gh_result into --stats counters, process_path_recursive() is a gh_walk() visitor, and the io_uring engine builds on the same gh_sample_offsets()/gh_dio_*() helpers. Build with: gcc -O3 -march=native -flto -o gh gh.c libgh.c -pthread
+
+v0.34
+-Page Cache Policy: Added --pagecache <keep|drop|direct>. On a box that also streams media, a scan no longer pushes the hot segments of other files out of memory.
+-Drop: The samples are read with RWF_DONTCACHE (Linux 6.14+), which drops only the pages the read brought in. Older kernels and filesystems without it read normally and drop the three ranges with POSIX_FADV_DONTNEED. Readahead is turned off so nothing else is left behind. --confirm drops the files it compares.
+-Direct: The samples are read with O_DIRECT into a buffer aligned to 4KB. Each read is widened to the offset alignment reported by statx (STATX_DIOALIGN, 4KB when unknown), and only the exact 16KB sample inside it is hashed, so hashes are identical to buffered reads. Filesystems that refuse O_DIRECT fall back to drop. Both I/O engines support it.
+
+v0.33
+-Single Pass: The argument pre-scan is gone. Options are still read first, but paths are no longer copied, resolved with realpath or split with basename/dirname before hashing starts. Each file is opened and resolved once, when its turn comes.
+-Lazy Separator Width: The dashed and double lines grow with the longest File/Path printed so far, instead of being sized in advance from every argument.
+-Resolve Only When Shown: realpath now runs only for the File/Path block and for --dupes, which lists absolute paths. File and directory names are taken from the resolved path in place, with no extra PATH_MAX copies. Missing files are reported when they fail to open.
+
+v0.32
+-Remote Storage Mode: Added --remote for NFS, SMB and FUSE mounts. Each file gets POSIX_FADV_RANDOM, so the kernel stops reading ahead into data gh never uses, and a WILLNEED hint for each of the three sample ranges. The mount can fetch all three in parallel instead of in three sequential round trips.
+-Adaptive Concurrency: With --remote, the pool starts 64 workers (or -j N) but only lets 4 claim work. The writer measures throughput every 500ms and keeps adding workers while each step gains at least 5%. It steps back when a step does not help, and probes upward again every few seconds. The level it settled at is printed after the Summary.
+
+v0.31
+-Watch Daemon: Added --watch. After the usual recursive scan, gh stays running and rehashes only files that are closed after writing or renamed into the tree. Directories that appear later are watched and scanned, and renamed directories keep their watches.
+-No Lost Changes: The inotify watches are set before the initial scan, so edits made while it runs are queued. If the event queue overflows, the trees are rescanned (cheap with --cache).
+-Result Delivery: Each result is flushed to stdout and appended to the log (-l is opened in append mode). --socket <path> also streams "<hash>  <path>" lines to every client of a unix socket. SIGINT/SIGTERM stop the daemon cleanly and print the usual Summary.
+
+v0.30
+-Streaming Path Lists: Added --files-from <file> (newline-separated, "-" for stdin) and --stdin0 (NUL-separated, for find -print0). Paths are hashed while the list is still being read. There is no pre-pass and no argv limit, and memory only grows to fit the longest single path.
+-Pipelined: With -j or --io uring the list feeds the worker pool directly, and the pool's bounded ring throttles the reader. Listed directories are walked when -r is given.
+-Idle Flush: When the producer stalls, buffered results are flushed after at most 200ms, by the reader or by the idle writer thread, so downstream consumers see them promptly.
+
+v0.29
+-Run Statistics: Added --stats. After the Summary line gh prints the time spent walking, opening, reading, hashing and writing output, counts of directories, opens, reads, bytes read and failures, and a log-scale histogram of per-file hash latency with p50/p90/p99.
+-Per-Thread Counters: Every thread owns its counter block and only ever writes to it, so the hot path takes no locks and no atomics. The blocks are summed after the threads are joined, and a per-thread table is printed when more than one thread took part.
+-JSON Output: --stats-json prints the same data as a single JSON line for scripts. bench/run.sh now takes its latency figures from it.
+
+v0.28
+-Size Prefilter: In --dupes mode the walkers no longer hash files as they find them. Every candidate is first grouped by the st_size the walk already has. Once the walk is done, only files in size groups with two or more members are sent to sample hashing, and a file with a unique size is never opened.
+-Stat-Aware Walks: The parallel walker (-W) now also calls fstatat for regular files when the prefilter needs their size.
+-Filter Report: The summary says how many files were skipped for having a unique size. --no-size-filter restores streaming hashing, which keeps less in memory.
+
+v0.27
+-Duplicate Finder: Added -d/--dupes. Instead of printing every file, results are collected into an in-memory (hash, size) -> file list table while the scan runs. Only groups with two or more members are reported, one "<hash>  <path>" line per file and a blank line between groups, in the order the groups were first seen.
+-Staged Confirmation: --confirm compares every colliding group byte-for-byte and splits it into classes of truly identical files. Only the colliding files are ever read in full.
+-Duplicate Summary: The report ends with the number of groups, duplicate files and the space the extra copies occupy.
+
+v0.26
+-Buffered Output: stdout and the log file now use 1MB stdio buffers. The per-call fflush in smart_printf is gone, replaced by out_tick(), which flushes when the buffer fills or 200ms after the last flush.
+-No printf on the Hot Path: print_simple_output() formats the hash with a lookup table and writes each line in one unlocked stdio call per sink. print_separator() builds the whole line in memory instead of calling printf once per character.
+-Writer Thread: With -j/--io uring, a dedicated writer thread is the only consumer of finished jobs. Workers just mark a slot done. The writer takes the pool lock only long enough to collect a batch, then formats and writes it unlocked.
+
+v0.25
+-Pluggable Hash Kernels: Added --algo <fnv1a|vec64>. Every engine now seeds and feeds the hash through a hash_algo table instead of calling fnv1a_hash() directly.
+-vec64 Kernel: An xxh3-style striped hash. It keeps eight 64-bit accumulators, runs a 32x32->64 multiply-accumulate per 64-byte stripe, scrambles every 1KB and does a 128-bit folding merge at the end. AVX2 (picked at runtime) and NEON paths produce bit-identical results to the portable code.
+-FNV-1a Stays Default: Existing logs remain comparable. The algorithm is written to the log header ("Algorithm: ...") and is part of the fingerprint cache key, so results from different kernels never mix.
+
+v0.24
+-Parallel Walker: Added -W/--walk-threads <N>. The new traversal engine lists directories with getdents64 relative to directory fds (openat/fstatat) and trusts d_type. It only calls fstatat when the filesystem reports DT_UNKNOWN or when the cache needs the metadata.
+-Work Stealing: Each walk thread owns a deque of pending directories and steals from the others when it runs dry, so wide trees are listed in parallel.
+-Same Output Order: The listings are emitted depth-first in readdir order, exactly like the classic walker. The emitter lists a directory itself if no walk thread has reached it yet.
+-Scan Context: process_path_recursive() now takes a scan_ctx, and both walkers hand files to scan_file().
+
+v0.23
+-Fingerprint Cache: Added --cache and --cache-file <path>. Results are stored in an mmap'd open-addressing table (default ~/.cache/gh/fingerprints) keyed on device and inode and validated against size and mtime in nanoseconds. When the metadata matches, the sample reads are skipped and the run becomes a stat-only pass.
+-Cache Pruning: Each run stamps the entries it touches. Entries not seen for 30 runs are dropped when the table is saved, and --cache-prune drops every entry this run did not see (use it after scanning the whole tree).
+-Safe Sharing: The table is locked with flock for the length of a run. A second concurrent gh warns and runs without the cache instead of corrupting it.
+
+v0.22
+-io_uring Engine: Added --io <sync|uring>. The uring engine submits openat/statx for many files at once, then the head/mid/tail reads as soon as the size is known, and hashes each file the moment its last chunk arrives. Queue depth per worker is set with --io-depth <N>.
+-Zero Dependencies: The ring is driven through the raw io_uring_setup/io_uring_enter syscalls, so no liburing is needed.
+-Fallback: If the kernel (or a container seccomp profile) refuses io_uring or lacks any of the needed opcodes, gh prints a warning and uses the blocking path.
+-Shared Sample Layout: Both engines take their offsets from sample_offsets(); the blocking path now uses pread instead of lseek + read.
+
+v0.21
+-Worker Pool: Added -j/--jobs <N>. In recursive mode the directory walker now feeds a bounded queue that N hashing threads drain, so several files are in flight at once instead of one.
+-Deterministic Output: Results are re-sequenced through a ring buffer, so the output order is identical to a single-threaded run. -u/--unordered prints results as soon as they finish instead.
+-Thread-Safe Accounting: files_succeeded, files_total and total_size_bytes are only updated while the pool lock is held, at the moment a result is printed.
+
 v0.20
 -Double Separator: The print_separator function now takes a doubled parameter. When -r is used, the line of = characters will be twice as long as the standard width.
 -Size Accumulation: Added total_bytes_processed. Every time a file is successfully hashed, its byte size is added to this total.
@@ -159,7 +296,6 @@ EXAMPLE:
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
-#include <libgen.h>   
 #include <stdlib.h>          
 #include <string.h>
 #include <limits.h>
@@ -168,12 +304,56 @@ EXAMPLE:
 #include <time.h>    
 #include <stdarg.h>
 #include <dirent.h>          // Added for -r functionality
+#include <pthread.h>         // Added for -j worker pool
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/file.h>
+#include <sys/sysmacros.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>     // Added for --watch
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>    // Added for --elevator
+#include <linux/io_uring.h>  // Added for --io uring (raw syscalls, no liburing)
+#include "libgh.h"           // Sampling, hash kernels and the classic walker
 
-// FNV-1a Hash Constants for 64-bit hashing
-#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
-#define FNV_PRIME 0x100000001b3ULL
-#define CHUNK_SIZE 16384                // 16KB sample size per block
-#define VERSION "0.20"
+#define JOBS_MAX 256                    // Upper bound for -j
+#define QUEUE_SLOTS_PER_JOB 64          // Ring slots per worker thread
+#define IO_DEPTH_DEFAULT 32             // Files in flight per io_uring worker
+#define IO_DEPTH_MAX 1024
+#define CACHE_MAGIC "GHCACHE1"
+#define CACHE_MIN_SLOTS 4096            // Initial table size (power of two)
+#define CACHE_KEEP_RUNS 30              // Unseen entries survive this many runs
+#define WALK_THREADS_MAX 64
+#define WALK_FD_BUDGET 256              // Directory fds the walker may hold open
+#define WALK_BUFFER_MAX (1 << 20)       // Listed-but-unemitted entries before walkers pause
+#define DENTS_BUF_SIZE 32768
+#define OUT_BUF_SIZE (1 << 20)          // stdio buffer for stdout and the log
+#define OUT_FLUSH_MS 200                // Max latency before buffered output is flushed
+#define WRITER_BATCH 256                // Jobs the writer thread collects per lock
+#define CONFIRM_BUF_SIZE (1 << 20)      // Read size for --confirm comparisons
+#define LIST_BUF_SIZE 65536            // Initial read buffer for --files-from / --stdin0
+#define REMOTE_JOBS_DEFAULT 64          // Worker ceiling for --remote without -j
+#define SHARDS_MAX 65536                // Upper bound for --shard i/N
+#define VERIFY_JOBS_DEFAULT 8           // Workers for --verify without -j (sample reads wait on I/O, not CPU)
+#define ADAPT_START 4                   // Active workers when --remote starts tuning
+#define ADAPT_WINDOW_MS 500             // Throughput measurement window
+#define ADAPT_MIN_FILES 16              // Completions needed before a window counts
+#define ADAPT_GAIN 1.05                 // Improvement that justifies more workers
+#define ADAPT_PROBE_WINDOWS 10          // Settled windows before probing upward again
+#define WATCH_CLIENTS_MAX 64           // Subscribers on the --socket
+#define WATCH_EVENT_BUF 65536
+#define STATS_SUB_BITS 2                // Latency histogram: 4 buckets per power of two
+#define STATS_BUCKETS (40 << STATS_SUB_BITS)  // Up to 2^40 ns (~18 minutes) per file
+#define PROGRESS_HZ 10                  // Redraws per second of the progress line
+#define PROGRESS_WINDOW 20              // Ticks the rates are averaged over (2 s)
+#define PROGRESS_BAR 35                 // Width of the bar once the total is known
+#define VERSION "0.48"
 #define CURRENT_YEAR 2026
 
 /* ================= ANSI COLORS ================= */
@@ -187,250 +367,5774 @@ EXAMPLE:
 
 FILE *log_fp = NULL;      // Global file pointer for the log file
 int silent_mode = 0;      // Toggle for progress-bar-only terminal output
+enum { FORMAT_TEXT, FORMAT_NDJSON, FORMAT_BINARY };
+int out_format = FORMAT_TEXT;
+FILE *record_fp = NULL;   // --format ndjson/binary: the log file, or the original stdout
+gh_ext_set ext_filter;           // Extensions hashed without -i: the defaults, --ext and --exclude-ext
+gh_options hash_opts = { NULL, GH_PAGECACHE_KEEP, 0, &ext_filter, GH_LAYOUT_V1 };  // Kernel, --pagecache, --remote and --layout; set before any thread starts
+
+typedef struct dupe_table dupe_table;
+dupe_table *dupe_index = NULL;  // Set in --dupes mode; results are collected instead of printed
+typedef struct verify_list verify_list;
+verify_list *verify_index = NULL;  // Set in --verify mode; results are checked against the log instead of printed
+typedef struct inode_set inode_set;
+inode_set *inode_index = NULL;  // Hard-linked files and, with -L, directories already seen; NULL in --verify mode
 
 /* ================= FUNCTION PROTOTYPES ================= */
 void smart_printf(const char *color, const char *prefix, const char *fmt, ...);
 void print_separator(int length, const char* color, char symbol);
-int is_video_file(const char *filename);
-unsigned long long fnv1a_hash(unsigned long long hash, const unsigned char *data, size_t len);
-unsigned long long calculate_video_hash(const char *filename, unsigned long long *out_size);
+void out_init(void);
+void out_attach_log(FILE *fp);
+void out_tick(void);
+void out_flush(void);
+void emit_result(unsigned long long hash, const struct stat *st, const char *path);
+void print_record(unsigned long long hash, const struct stat *st, const char *path, unsigned group);
+int print_record_header(void);
+
+/* ================= HASHING ================= */
+
+unsigned long long hash_path_stat(const char *filename, struct stat *out_st);
+unsigned long long hash_fd_stat(int fd, struct stat *out_st);
+uint32_t algo_variant(void);
+const char *algo_suffix(void);
+int ext_filter_apply(int add, const char *list);
+
+enum { IO_SYNC, IO_URING };
+int uring_supported(void);
+
+#ifndef RWF_DONTCACHE
+#define RWF_DONTCACHE 0x00000080        // Linux 6.14+: uncached buffered reads
+#endif
+
+/* ================= FINGERPRINT CACHE ================= */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t run;          // Incremented on every open
+    uint64_t capacity;     // Slot count, power of two
+    uint64_t count;        // Occupied slots
+} cache_header;
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;
+    uint32_t last_run;     // 0 marks an empty slot
+    uint32_t variant;      // Hash algorithm / sampling scheme the value belongs to
+} cache_entry;
+
+typedef struct {
+    char *path;
+    int fd;
+    int lock_fd;
+    size_t map_size;
+    cache_header *hdr;
+    cache_entry *slots;
+    uint32_t variant;
+    uint64_t hits;
+    uint64_t misses;
+    int read_only;         // Set when the table is full and could not grow
+    pthread_mutex_t lock;
+} fp_cache;
+
+fp_cache *cache_open(const char *path, uint32_t variant);
+int cache_lookup(fp_cache *c, const struct stat *st, unsigned long long *hash);
+void cache_store(fp_cache *c, const struct stat *st, unsigned long long hash);
+void cache_close(fp_cache *c, int prune_unseen);
+unsigned long long hash_with_cache(fp_cache *cache, const char *path, const struct stat *st, struct stat *out_st);
+
+/* ================= DUPLICATE FINDER ================= */
+
+typedef struct dupe_spill dupe_spill;
+
+typedef struct {
+    char *path;
+    size_t next;           // Next member of the same group, or SIZE_MAX
+    uint64_t dev, ino;     // Hard links of one file are one copy (ino 0: unknown)
+} dupe_member;
+
+typedef struct {
+    unsigned long long hash;
+    unsigned long long size;
+    size_t first, last;    // Member list, in the order files were emitted
+    size_t count;
+} dupe_group;
+
+struct dupe_table {
+    dupe_group *groups;    // In first-seen order
+    size_t ngroups, groups_cap;
+    size_t *index;         // Open-addressing table of group numbers + 1 (0 = empty)
+    size_t index_cap;
+    dupe_member *members;
+    size_t nmembers, members_cap;
+    struct stat *stats;    // Per-member metadata, only for the size prefilter
+    int keep_stat;
+    dupe_spill *spill;     // --mem-limit: members go to sorted runs on disk instead, or NULL
+};
+
+dupe_table *dupe_new(int keep_stat, size_t limit);
+int dupe_add(dupe_table *t, unsigned long long hash, unsigned long long size, const char *path, const struct stat *st);
+void dupe_clear(dupe_table *t);
+void dupe_report(dupe_table *t, int confirm);
+int dupe_one_inode(const dupe_table *t, const dupe_group *g);
+void dupe_free(dupe_table *t);
+
+/* ================= DUPE SPILL ================= */
+
+#define SPILL_MIN (4 << 20)             // Smallest buffer a table can spill from
+#define SPILL_READ_MIN (16 << 10)       // Smallest read buffer per run in a merge
+#define SPILL_READ_MAX (1 << 20)
+
+typedef struct {
+    unsigned long long size, hash;      // Sort key, then seq
+    uint64_t dev, ino;
+    int64_t mtime_ns;
+    uint64_t seq;          // Arrival order: a group lists its files in the order they were found
+    uint64_t path;         // Offset of the path in the buffer; on disk the path follows the record
+    uint32_t path_len;     // Without the terminating NUL, which is stored too
+    uint32_t nlink;
+} spill_record;
+
+typedef struct {
+    uint64_t off, end;     // A sorted run in the spill file
+} spill_extent;
+
+typedef struct {
+    uint64_t off, end;     // Unread part of the run in the spill file
+    unsigned char *buf;
+    size_t pos, len, cap;
+    spill_record rec;      // Current record; its path is at buf + pos
+} spill_run;
+
+struct dupe_spill {
+    unsigned char *buf;    // cap bytes: records fill it from the front, paths from the back
+    size_t cap, nrecs, path_used;
+    uint64_t seq;
+    FILE *file;            // Unlinked file that holds the runs
+    uint64_t file_len;
+    spill_extent *runs;
+    size_t nruns, runs_cap;
+    spill_run *merge;      // Runs being merged, at most cap / SPILL_READ_MIN of them
+    size_t nmerge;
+    size_t *heap;          // Merge: runs ordered by their current record
+    size_t nheap;
+    size_t next;           // Final pass without runs: next record of the sorted buffer
+    int failed;
+};
+
+typedef void (*spill_group_fn)(dupe_table *group, dupe_group *g, void *user);
+
+dupe_spill *spill_new(size_t cap);
+int spill_add(dupe_spill *s, unsigned long long hash, unsigned long long size, const char *path, const struct stat *st);
+int spill_groups(dupe_spill *s, int keep_stat, spill_group_fn fn, void *user);
+void spill_free(dupe_spill *s);
+void spill_summary(void);
+
+/* ================= INODE SET ================= */
+
+enum { INODE_EMPTY, INODE_PENDING, INODE_HASHED, INODE_FAILED, INODE_DIR };   // Entry states
+enum { INODE_NONE, INODE_FIRST, INODE_LINK };   // How a queued path relates to the set
+
+typedef struct {
+    uint64_t dev, ino;
+    unsigned long long hash;   // Result of the first link, once INODE_HASHED
+    int state;
+} inode_entry;
+
+typedef struct {
+    char *path;
+    struct stat st;
+} inode_link;
+
+/*
+ * (st_dev, st_ino) of every file with more than one link (every file with -L)
+ * and, with -L, of every directory entered. Later links of a file take the
+ * first one's result instead of being opened. The main thread adds entries,
+ * whoever emits results publishes them, so both go through the lock.
+ */
+struct inode_set {
+    inode_entry *slots;        // Open addressing, power-of-two capacity
+    size_t cap, count;
+    inode_link *parked;        // --unordered: links that came in while the first one was being hashed
+    size_t nparked, parked_cap;
+    unsigned long long links;  // Paths that reused another link's result
+    unsigned long long dirs;   // Directories reached again through a symlink
+    pthread_mutex_t lock;
+};
+
+inode_set *inode_new(void);
+int inode_add(inode_set *s, const struct stat *st, int state, unsigned long long *hash);
+void inode_publish(inode_set *s, uint64_t dev, uint64_t ino, unsigned long long hash);
+unsigned long long inode_hash(inode_set *s, uint64_t dev, uint64_t ino);
+void inode_free(inode_set *s);
+
+/* ================= WORKER POOL ================= */
+
+enum { JOB_FREE, JOB_QUEUED, JOB_CLAIMED, JOB_DONE, JOB_EMITTED };
+
+typedef struct {
+    char *path;            // Owned by the slot and reused by every job that lands in it
+    size_t path_cap;
+    unsigned long long hash;
+    unsigned long long size;
+    struct stat st;        // Filled by the engine that hashed the file
+    int state;
+    int link;              // INODE_FIRST: publish the result; INODE_LINK: take the first link's at emit time
+    uint64_t dev, ino;     // As submitted, for link
+} hash_job;
+
+/* Hill-climbing state for --remote, owned by the writer thread */
+typedef struct {
+    uint64_t window_start;
+    uint64_t window_files;
+    double best_rate;      // Files/s at best_active
+    int best_active;
+    int settled;           // Windows spent at best_active since the last probe
+} pool_tuner;
+
+/*
+ * Jobs live in a ring indexed by a monotonically increasing sequence number:
+ *   tail <= next <= head, where [tail, next) are claimed or finished and
+ *   [next, head) are waiting for a worker (or were completed at submit time
+ *   from the cache, in which case workers skip them).
+ * A slot is only recycled once the tail passes it, which is what keeps the
+ * output in submission order.
+ */
+typedef struct {
+    hash_job *slots;
+    size_t capacity;
+    unsigned long long head;
+    unsigned long long next;
+    unsigned long long tail;
+    int closing;
+    int unordered;
+    pthread_mutex_t lock;
+    pthread_cond_t can_push;
+    pthread_cond_t can_claim;
+    pthread_cond_t can_emit;
+    pthread_cond_t can_activate;   // Parked workers (id >= active) wait here
+    int workers_done;
+    pthread_t writer;
+    pthread_t *threads;
+    int nthreads;
+    int max_active;        // Requested worker count
+    int active;            // Workers allowed to claim jobs; below max_active while tuning
+    int adaptive;
+    int worker_ids;
+    pool_tuner tuner;
+    int io_mode;
+    int io_depth;
+    fp_cache *cache;
+    int *succeeded;
+    int *total;
+    unsigned long long *total_sz;
+} hash_pool;
+
+int pool_start(hash_pool *p, int nthreads, int unordered, int io_mode, int io_depth, fp_cache *cache, int adaptive,
+               int *succeeded, int *total, unsigned long long *total_sz);
+void pool_submit(hash_pool *p, const char *path, const struct stat *st, int link);
+void pool_finish(hash_pool *p);
+
+/* ================= WALKERS ================= */
+
+typedef struct elevator elevator;
+typedef struct prefetch_queue prefetch_queue;
+
+typedef struct {
+    int ignore_ext;
+    hash_pool *pool;
+    fp_cache *cache;
+    dupe_table *sizes;     // Size prefilter for --dupes, or NULL
+    unsigned long long size_skipped;
+    int *succeeded;
+    int *total;
+    unsigned long long *total_sz;
+    uint64_t walk_mark;    // --stats: when process_path_recursive() last handed control to the walker
+    unsigned shard;        // --shard shard/shards; shards == 1 keeps everything
+    unsigned shards;
+    size_t root_len;       // Length of the root being scanned; shards hash the path after it
+    elevator *elev;        // --elevator: files wait here for one sorted sweep of reads, or NULL
+    prefetch_queue *prefetch;  // --prefetch: files opened and requested ahead of the hasher, or NULL
+    int follow;            // -L: walkers follow symlinks, and every file goes through inode_index
+} scan_ctx;
+
+void scan_file(scan_ctx *ctx, const char *path, const struct stat *st);
+int shard_keeps(const scan_ctx *ctx, const char *path);
+void scan_hash(scan_ctx *ctx, const char *path, const struct stat *st);
+void scan_emit(scan_ctx *ctx, unsigned long long h, const struct stat *st, const char *path);
+void size_filter_flush(scan_ctx *ctx);
+void inode_flush(scan_ctx *ctx);
+void process_path_recursive(const char *path, scan_ctx *ctx);
+void walk_tree(const char *path, int nthreads, scan_ctx *ctx);
+int scan_list(int fd, char delim, int recursive, int walk_threads, scan_ctx *ctx);
+
+/* ================= ELEVATOR ================= */
+
+#define ELEVATOR_WINDOW 256    // Files whose sample reads are sorted together
+
+typedef struct {
+    char *path;
+    struct stat st;        // From the walker, then from fstat
+    int has_st;
+    int fd;                // -1 when cached or unreadable
+    int nsamples;
+    int64_t offsets[GH_SAMPLE_MAX];
+    ssize_t got[GH_SAMPLE_MAX];
+    unsigned char *buf;    // nsamples * GH_CHUNK_SIZE in the window arena
+    unsigned long long hash;
+} elevator_file;
+
+typedef struct {
+    uint64_t dev;
+    int located;           // key is a physical offset (FIEMAP), else the inode number
+    uint64_t key;
+    int64_t off;           // Logical offset of the sample
+    unsigned file, sample;
+} elevator_read;
+
+elevator *elevator_new(void);
+void elevator_add(scan_ctx *ctx, const char *path, const struct stat *st);
+void elevator_flush(scan_ctx *ctx);
+void elevator_free(elevator *e);
+
+/* ================= PREFETCH ================= */
+
+#define PREFETCH_MAX 1024      // Deepest --prefetch; every queued file holds a descriptor
+
+prefetch_queue *prefetch_new(size_t depth);
+void prefetch_add(scan_ctx *ctx, const char *path, const struct stat *st);
+void prefetch_flush(scan_ctx *ctx);
+void prefetch_free(prefetch_queue *q);
+
+/* ================= VERIFY ================= */
+
+enum { VERIFY_PENDING, VERIFY_QUEUED, VERIFY_OK, VERIFY_MISMATCH, VERIFY_RESIZED, VERIFY_MISSING, VERIFY_UNREADABLE };
+
+typedef struct {
+    char *path;
+    unsigned long long hash;   // As logged
+    unsigned long long size;   // As logged, if has_size (binary and NDJSON logs)
+    unsigned long long found;  // Hash now, or size now for VERIFY_RESIZED
+    int has_size;
+    int state;
+    uint64_t dev, ino;         // As logged (binary and NDJSON), for --merge
+    int64_t mtime_ns;
+} verify_entry;
+
+struct verify_list {
+    verify_entry *entries; // In log order, one per path
+    size_t count, cap;
+    size_t reported;       // Output side: [0, reported) have been printed
+    const gh_algo *algo;   // Kernel the log names, or NULL
+    int full;              // The log holds --full digests
+    unsigned layout;       // Sampling layout of its fingerprints, 0 if it does not say (v1)
+    int fail_fast;
+    int failed;            // Set on the first problem (atomic: submitter and writer)
+    unsigned long long counts[VERIFY_UNREADABLE + 1];
+    int (*push)(verify_list *v, const char *path, size_t len, const verify_entry *rec);   // Takes parsed entries instead of verify_push() (--compare)
+};
+
+verify_list *verify_load(const char *path);
+int verify_read(verify_list *v, const char *path);
+int verify_dedupe(verify_list *v);
+void verify_run(verify_list *v, scan_ctx *ctx);
+void verify_emit(verify_list *v, unsigned long long hash, const char *path);
+void verify_finish(verify_list *v);
+void verify_free(verify_list *v);
+verify_list *merge_load(char *const *paths, int n);
+void merge_print(const verify_list *v);
+
+/* ================= COMPARE ================= */
+
+#define COMPARE_NONE UINT32_MAX
+#define COMPARE_CHUNK (1 << 20)    // Bytes per block of decoded paths
+
+typedef struct {
+    unsigned long long hash;
+    unsigned long long size;   // As logged, or 0 (text logs)
+    const char *path;          // Into the mapped log, or into a name chunk; not terminated
+    uint32_t len;
+    uint32_t link;             // Log position while loading, then the other side of a move or COMPARE_NONE
+} compare_entry;
+
+typedef struct compare_chunk {
+    struct compare_chunk *next;
+    size_t used, cap;
+    char data[];
+} compare_chunk;
+
+typedef struct {
+    verify_list log;           // Kernel and digest the log names; its entries stay empty
+    compare_entry *entries;    // Sorted by path, one per path
+    size_t count, cap;
+    const char *data;          // The mapped log
+    size_t len;
+    compare_chunk *names;      // Paths that had to be decoded (NDJSON escapes, File/Path blocks)
+} compare_log;
+
+compare_log *compare_load(const char *path, const compare_log *other);
+int compare_run(compare_log *a, compare_log *b, unsigned long long *paths);
+void compare_free(compare_log *c);
+
+/* ================= WATCH DAEMON ================= */
+
+typedef struct {
+    int fd;                      // inotify instance
+    char **dirs;                 // Watched directory path, indexed by watch descriptor
+    int dirs_cap;
+    char **roots;                // Command-line trees, rescanned after a queue overflow
+    int nroots;
+    int listen_fd;               // --socket, or -1
+    const char *socket_path;
+    int clients[WATCH_CLIENTS_MAX];
+    int nclients;
+    uint32_t move_cookie;        // Directory seen leaving in IN_MOVED_FROM
+    char *move_from;
+    int warned_limit;
+} gh_watch;
+
+int watch_init(gh_watch *w, const char *socket_path);
+void watch_tree(gh_watch *w, const char *path, scan_ctx *ctx);
+void watch_run(gh_watch *w, scan_ctx *ctx);
+void watch_free(gh_watch *w);
+
+/* ================= STATISTICS ================= */
+
+enum { PHASE_WALK, PHASE_OPEN, PHASE_READ, PHASE_HASH, PHASE_OUTPUT, PHASE_COUNT };
+enum { STATS_OFF, STATS_TEXT, STATS_JSON };
+
+/*
+ * One block per thread, only ever written by its owner. Blocks are linked
+ * into a registry and summed once every thread has been joined, so the hot
+ * path needs neither locks nor atomics.
+ */
+typedef struct gh_stats {
+    const char *role;
+    int id;
+    uint64_t phase_ns[PHASE_COUNT];
+    uint64_t files;        // Files whose samples were read
+    uint64_t dirs;         // Directories listed
+    uint64_t opens;
+    uint64_t reads;
+    uint64_t bytes_read;
+    uint64_t failures;
+    uint64_t latency[STATS_BUCKETS];  // Per-file open-to-hash time, log scale
+    struct gh_stats *next;
+} gh_stats;
+
+extern int stats_mode;
+extern __thread gh_stats *thread_stats;  // NULL unless --stats is on
+gh_stats *stats_thread(const char *role);
+void stats_latency(gh_stats *s, uint64_t ns);
+void stats_report(double elapsed_ms);
+
+static inline uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
 
 /**
- * print_simple_output: Fulfills: <hash>  <filename>
+ * stats_lap: Charges the time since *mark to phase and moves the mark. No-op without --stats.
  */
-void print_simple_output(unsigned long long hash, const char *filename) {
-    if (!silent_mode) {
-        printf(C_GREEN "%016llx" C_RESET "  %s\n", hash, filename);
-    }
-    if (log_fp) {
-        fprintf(log_fp, "%016llx  %s\n", hash, filename);
-    }
+static inline void stats_lap(gh_stats *s, int phase, uint64_t *mark) {
+    if (!s) return;
+    uint64_t now = stats_now();
+    s->phase_ns[phase] += now - *mark;
+    *mark = now;
+}
+
+/* ================= PROGRESS ================= */
+
+/*
+ * Like gh_stats, one block per thread that counts files, written only by its
+ * owner. The reporter thread sums them with relaxed loads a few times a
+ * second, so the hot path pays two plain stores and never touches the terminal.
+ */
+typedef struct progress_slot {
+    uint64_t found;        // Files the walkers have listed
+    uint64_t queued;       // Files sent to be hashed (the size prefilter parks the rest)
+    uint64_t done;         // Files finished, hashed or failed
+    uint64_t bytes;        // Logical size of the hashed ones
+    struct progress_slot *next;
+} __attribute__((aligned(64))) progress_slot;
+
+extern int progress_mode;
+extern __thread progress_slot *thread_progress;  // NULL unless --progress is on
+progress_slot *progress_thread(void);
+progress_slot *progress_walker(int id);
+void progress_start(void);
+void progress_last_source(void);
+void progress_listed(void);
+void progress_walked(void);
+void progress_stop(void);
+
+static inline void progress_add(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
 }
 
 /**
- * process_path_recursive: Performs hash on other directories recursively
+ * progress_done: Counts one finished file (bytes 0 for a failure). No-op without --progress.
  */
-void process_path_recursive(const char *path, int ignore_ext, int *succeeded, int *total, unsigned long long *total_sz) {
-    struct stat st;
-    if (lstat(path, &st) != 0) return;
+static inline void progress_done(uint64_t bytes) {
+    progress_slot *pg = thread_progress;
+    if (!pg) return;
+    progress_add(&pg->done, 1);
+    progress_add(&pg->bytes, bytes);
+}
 
-    if (S_ISDIR(st.st_mode)) {
-        DIR *dir = opendir(path);
-        if (!dir) return;
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-            char sub_path[PATH_MAX];
-            snprintf(sub_path, sizeof(sub_path), "%s/%s", path, entry->d_name);
-            process_path_recursive(sub_path, ignore_ext, succeeded, total, total_sz);
-        }
-        closedir(dir);
-    } else if (S_ISREG(st.st_mode)) {
-        if (ignore_ext || is_video_file(path)) {
-            unsigned long long sz = 0;
-            unsigned long long h = calculate_video_hash(path, &sz);
-            (*total)++;
-            if (h != 0) {
-                (*succeeded)++;
-                *total_sz += sz;
-                print_simple_output(h, path);
-            }
-        }
+/* ================= OUTPUT ================= */
+
+static char stdout_buf[OUT_BUF_SIZE];
+static char log_buf[OUT_BUF_SIZE];
+static struct timespec last_flush;
+
+/**
+ * out_init: Switches stdout to a large, fully buffered stdio buffer.
+ */
+void out_init(void) {
+    setvbuf(stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+    clock_gettime(CLOCK_MONOTONIC, &last_flush);
+}
+
+/**
+ * out_attach_log: Same for the log file, or the --format record stream when
+ * there is no log. Must run before the first write to fp.
+ */
+void out_attach_log(FILE *fp) {
+    setvbuf(fp, log_buf, _IOFBF, sizeof(log_buf));
+}
+
+/**
+ * out_tick: Flushes both sinks if OUT_FLUSH_MS have passed since the last flush.
+ * Only called by whichever thread currently owns the output.
+ */
+void out_tick(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ms = (now.tv_sec - last_flush.tv_sec) * 1000 + (now.tv_nsec - last_flush.tv_nsec) / 1000000;
+    if (ms < OUT_FLUSH_MS) return;
+    fflush(stdout);
+    if (log_fp) fflush(log_fp);
+    if (record_fp) fflush(record_fp);
+    last_flush = now;
+}
+
+/**
+ * out_flush: Flushes both sinks now, for when the output owner goes idle.
+ */
+void out_flush(void) {
+    fflush(stdout);
+    if (log_fp) fflush(log_fp);
+    if (record_fp) fflush(record_fp);
+    clock_gettime(CLOCK_MONOTONIC, &last_flush);
+}
+
+static inline char *put_hex64(char *p, unsigned long long v) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 15; i >= 0; i--) {
+        p[i] = digits[v & 0xf];
+        v >>= 4;
     }
+    return p + 16;
 }
 
-void smart_printf(const char *color, const char *prefix, const char *fmt, ...) {
-    va_list args;
+/**
+ * print_simple_output: Fulfills: <hash>  <filename>
+ */
+void print_simple_output(unsigned long long hash, const char *filename) {
+    // C_GREEN <16 hex digits> C_RESET "  ", without terminator
+    char line[(sizeof(C_GREEN) - 1) + 16 + (sizeof(C_RESET "  ") - 1)];
+    size_t name_len = strlen(filename);
+
+    char *hex = line + sizeof(C_GREEN) - 1;
+    memcpy(line, C_GREEN, sizeof(C_GREEN) - 1);
+    memcpy(put_hex64(hex, hash), C_RESET "  ", sizeof(C_RESET "  ") - 1);
+
     if (!silent_mode) {
-        printf("%s%s" C_RESET, color, prefix);
-        va_start(args, fmt);
-        vprintf(fmt, args);
-        va_end(args);
+        fwrite_unlocked(line, 1, sizeof(line), stdout);
+        fwrite_unlocked(filename, 1, name_len, stdout);
+        putc_unlocked('\n', stdout);
     }
     if (log_fp) {
-        fprintf(log_fp, "%s", prefix);
-        va_start(args, fmt);
-        vfprintf(log_fp, fmt, args); 
-        va_end(args);
-        fflush(log_fp); 
+        fwrite_unlocked(hex, 1, 16, log_fp);
+        fwrite_unlocked("  ", 1, 2, log_fp);
+        fwrite_unlocked(filename, 1, name_len, log_fp);
+        putc_unlocked('\n', log_fp);
     }
 }
 
-void print_separator(int length, const char* color, char symbol) {
-    if (!silent_mode) {
-        printf("%s", color);
-        for(int i = 0; i < length + 8; i++) {
-            printf("%c", symbol);
+static inline char *put_dec64(char *p, unsigned long long v) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+/* Appends a string literal */
+#define PUT_LIT(p, lit) ((char *)mempcpy((p), (lit), sizeof(lit) - 1))
+
+/**
+ * put_json_string: Quotes and escapes len bytes of s. Needs up to 6 * len + 2 bytes.
+ * Bytes >= 0x80 are copied as they are, so UTF-8 names stay readable.
+ */
+static char *put_json_string(char *p, const char *s, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    *p++ = '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = (char)c;
+        } else if (c < 0x20) {
+            p = PUT_LIT(p, "\\u00");
+            *p++ = digits[c >> 4];
+            *p++ = digits[c & 0xf];
+        } else {
+            *p++ = (char)c;
         }
-        printf(C_RESET "\n");
     }
-    if (log_fp) {
-        for(int i = 0; i < length + 8; i++) fputc(symbol, log_fp);
-        fputc('\n', log_fp);
+    *p++ = '"';
+    return p;
+}
+
+/**
+ * print_record: --format counterpart of print_simple_output(). Writes one
+ * NDJSON line or one gh_record (see libgh.h) to record_fp. group is the
+ * --dupes class, 0 outside of it.
+ */
+void print_record(unsigned long long hash, const struct stat *st, const char *path, unsigned group) {
+    size_t len = strlen(path);
+    int64_t mtime = (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+
+    if (out_format == FORMAT_BINARY) {
+        static const char padding[8];
+        gh_record rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.length = (uint32_t)((sizeof(rec) + len + 1 + 7) & ~(size_t)7);
+        rec.path_len = (uint32_t)len;
+        rec.hash = hash;
+        rec.size = (uint64_t)st->st_size;
+        rec.dev = (uint64_t)st->st_dev;
+        rec.ino = (uint64_t)st->st_ino;
+        rec.mtime_ns = mtime;
+        rec.group = group;
+        fwrite_unlocked(&rec, sizeof(rec), 1, record_fp);
+        fwrite_unlocked(path, 1, len, record_fp);
+        fwrite_unlocked(padding, 1, rec.length - sizeof(rec) - len, record_fp);  // NUL and alignment
+        return;
     }
+
+    char stack_line[1024];
+    size_t cap = 6 * len + 192;
+    char *line = cap <= sizeof(stack_line) ? stack_line : malloc(cap);
+    if (!line) return;
+    char *p = PUT_LIT(line, "{\"hash\":\"");
+    p = put_hex64(p, hash);
+    p = put_dec64(PUT_LIT(p, "\",\"size\":"), (unsigned long long)st->st_size);
+    p = put_dec64(PUT_LIT(p, ",\"dev\":"), (unsigned long long)st->st_dev);
+    p = put_dec64(PUT_LIT(p, ",\"ino\":"), (unsigned long long)st->st_ino);
+    p = PUT_LIT(p, ",\"mtime_ns\":");
+    if (mtime < 0) *p++ = '-';
+    p = put_dec64(p, mtime < 0 ? 0ULL - (unsigned long long)mtime : (unsigned long long)mtime);
+    if (hash_opts.flags & GH_FULL) p = PUT_LIT(p, ",\"full\":true");
+    else if (hash_opts.layout == GH_LAYOUT_V2) p = PUT_LIT(p, ",\"layout\":2");
+    if (group) p = put_dec64(PUT_LIT(p, ",\"group\":"), group);
+    p = put_json_string(PUT_LIT(p, ",\"path\":"), path, len);
+    p = PUT_LIT(p, "}\n");
+    fwrite_unlocked(line, 1, (size_t)(p - line), record_fp);
+    if (line != stack_line) free(line);
 }
 
-int is_video_file(const char *filename) {
-    const char *extensions[] = {".mp4", ".mkv", ".avi", ".mov", ".wmv", ".flv", ".webm", ".m4v", ".mpg", ".mpeg", ".ts", ".m2ts"};
-    int num_exts = sizeof(extensions) / sizeof(extensions[0]);
-    const char *dot = strrchr(filename, '.'); 
-    if (!dot) return 0;
-    
-    char ext_copy[16];
-    strncpy(ext_copy, dot, 15);
-    ext_copy[15] = '\0';
-    for(int i = 0; ext_copy[i]; i++) ext_copy[i] = tolower(ext_copy[i]); 
-    
-    for (int i = 0; i < num_exts; i++) {
-        if (strcmp(ext_copy, extensions[i]) == 0) return 1;
+/**
+ * print_record_header: Starts a --format binary stream. A file that already
+ * holds records (the --watch log is appended to) keeps its header, as long
+ * as it was written with the same kernel and digest. Returns -1 when it was not.
+ */
+int print_record_header(void) {
+    gh_record_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, GH_RECORD_MAGIC, sizeof(h.magic));
+    h.byte_order = GH_RECORD_BYTE_ORDER;
+    h.header_size = sizeof(h);
+    h.format_version = GH_RECORD_VERSION;
+    h.algo_id = algo_variant();
+    snprintf(h.algo, sizeof(h.algo), "%s%s", hash_opts.algo->name, algo_suffix());
+    strncpy(h.version, VERSION, sizeof(h.version) - 1);
+
+    struct stat st;
+    if (fstat(fileno(record_fp), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        gh_record_header old;
+        if (pread(fileno(record_fp), &old, sizeof(old), 0) != (ssize_t)sizeof(old)) return -1;
+        return memcmp(old.magic, h.magic, sizeof(h.magic)) == 0 && old.byte_order == h.byte_order &&
+               old.format_version == h.format_version && old.algo_id == h.algo_id ? 0 : -1;
     }
+    fwrite_unlocked(&h, sizeof(h), 1, record_fp);
     return 0;
 }
 
-unsigned long long fnv1a_hash(unsigned long long hash, const unsigned char *data, size_t len) {
-    for (size_t i = 0; i < len; i++) {
-        hash ^= data[i];
-        hash *= FNV_PRIME;
+/**
+ * emit_result: Final destination of every hashed file: printed as
+ * "<hash>  <path>" (or a --format record), collected for the --dupes report,
+ * or checked against the --verify log.
+ */
+void emit_result(unsigned long long hash, const struct stat *st, const char *path) {
+    if (verify_index) {
+        verify_emit(verify_index, hash, path);
+        return;
     }
-    return hash;
+    if (dupe_index) {
+        if (dupe_add(dupe_index, hash, (unsigned long long)st->st_size, path, st) != 0) {
+            if (dupe_index->spill && dupe_index->spill->failed) {
+                static int reported;   // A failed spill file fails every file after it
+                if (!reported++) fprintf(stderr, C_RED "Error:" C_RESET " Could not index '%s' or any file after it.\n", path);
+            } else if (dupe_index->spill) {
+                fprintf(stderr, C_RED "Error:" C_RESET " Path too long to index within --mem-limit: '%s'\n", path);
+            } else {
+                fprintf(stderr, C_RED "Error:" C_RESET " Out of memory while indexing '%s'\n", path);
+            }
+        }
+        return;
+    }
+    if (record_fp) print_record(hash, st, path, 0);
+    else print_simple_output(hash, path);
 }
 
-unsigned long long calculate_video_hash(const char *filename, unsigned long long *out_size) {
-    int fd = open(filename, O_RDONLY | O_NOATIME); 
-    if (fd == -1) return 0;
-
-    struct stat st;
-    if (fstat(fd, &st) != 0) { close(fd); return 0; }
-    unsigned long long file_size = (unsigned long long)st.st_size;
-    *out_size = file_size;
+int stats_mode = STATS_OFF;
+__thread gh_stats *thread_stats = NULL;
+static gh_stats *stats_registry = NULL;
+static gh_stats **stats_registry_tail = &stats_registry;
+static int stats_nthreads = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *const PHASE_NAMES[PHASE_COUNT] = { "walk", "open", "read", "hash", "output" };
 
-    unsigned long long hash = FNV_OFFSET_BASIS;
-    unsigned char buffer[CHUNK_SIZE];
-    ssize_t bytesRead;
+/**
+ * stats_thread: Registers a counter block for the calling thread and makes it
+ * the thread's thread_stats. Returns NULL when --stats is off.
+ */
+gh_stats *stats_thread(const char *role) {
+    if (stats_mode == STATS_OFF) return NULL;
+    gh_stats *s = calloc(1, sizeof(gh_stats));
+    if (!s) return NULL;
+    s->role = role;
+    pthread_mutex_lock(&stats_lock);
+    s->id = stats_nthreads++;
+    *stats_registry_tail = s;
+    stats_registry_tail = &s->next;
+    pthread_mutex_unlock(&stats_lock);
+    thread_stats = s;
+    return s;
+}
 
-    hash = fnv1a_hash(hash, (unsigned char*)&file_size, sizeof(file_size));
+/**
+ * stats_latency: Counts one file in the histogram. Bucket b covers
+ * [stats_bucket_lo(b), stats_bucket_lo(b + 1)) nanoseconds.
+ */
+void stats_latency(gh_stats *s, uint64_t ns) {
+    int b;
+    if (ns < (1u << STATS_SUB_BITS)) {
+        b = (int)ns;
+    } else {
+        int e = 63 - __builtin_clzll(ns);
+        b = ((e - STATS_SUB_BITS + 1) << STATS_SUB_BITS) + (int)((ns >> (e - STATS_SUB_BITS)) & ((1u << STATS_SUB_BITS) - 1));
+        if (b >= STATS_BUCKETS) b = STATS_BUCKETS - 1;
+    }
+    s->latency[b]++;
+    s->files++;
+}
 
-    bytesRead = read(fd, buffer, CHUNK_SIZE);
-    if (bytesRead > 0) hash = fnv1a_hash(hash, buffer, (size_t)bytesRead);
+static uint64_t stats_bucket_lo(int b) {
+    if (b < (1 << STATS_SUB_BITS)) return (uint64_t)b;
+    int e = (b >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+    uint64_t mantissa = (1u << STATS_SUB_BITS) + (uint64_t)(b & ((1 << STATS_SUB_BITS) - 1));
+    return mantissa << (e - STATS_SUB_BITS);
+}
 
-    if (file_size > CHUNK_SIZE * 3) {
-        lseek(fd, (off_t)(file_size / 2), SEEK_SET);
-        bytesRead = read(fd, buffer, CHUNK_SIZE);
-        if (bytesRead > 0) hash = fnv1a_hash(hash, buffer, (size_t)bytesRead);
+/**
+ * stats_percentile: Latency at quantile q, interpolated inside its bucket.
+ */
+static uint64_t stats_percentile(const gh_stats *s, double q) {
+    uint64_t count = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) count += s->latency[b];
+    if (count == 0) return 0;
+    double rank = q * (double)count, seen = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        if (!s->latency[b]) continue;
+        if (seen + (double)s->latency[b] >= rank) {
+            uint64_t lo = stats_bucket_lo(b), hi = stats_bucket_lo(b + 1);
+            return lo + (uint64_t)((double)(hi - lo) * (rank - seen) / (double)s->latency[b]);
+        }
+        seen += (double)s->latency[b];
     }
+    return 0;
+}
 
-    if (file_size > CHUNK_SIZE) {
-        lseek(fd, -(off_t)CHUNK_SIZE, SEEK_END);
-        bytesRead = read(fd, buffer, CHUNK_SIZE);
-        if (bytesRead > 0) hash = fnv1a_hash(hash, buffer, (size_t)bytesRead);
-    }
+static void stats_add(gh_stats *dst, const gh_stats *src) {
+    for (int i = 0; i < PHASE_COUNT; i++) dst->phase_ns[i] += src->phase_ns[i];
+    for (int b = 0; b < STATS_BUCKETS; b++) dst->latency[b] += src->latency[b];
+    dst->files += src->files;
+    dst->dirs += src->dirs;
+    dst->opens += src->opens;
+    dst->reads += src->reads;
+    dst->bytes_read += src->bytes_read;
+    dst->failures += src->failures;
+}
 
-    close(fd);
-    return hash;
+static const char *stats_fmt_ns(char *buf, size_t len, uint64_t ns) {
+    if (ns < 1000) snprintf(buf, len, "%llu ns", (unsigned long long)ns);
+    else if (ns < 1000000) snprintf(buf, len, "%.1f us", ns / 1e3);
+    else if (ns < 1000000000) snprintf(buf, len, "%.1f ms", ns / 1e6);
+    else snprintf(buf, len, "%.2f s", ns / 1e9);
+    return buf;
 }
 
-/* ================= MAIN ================= */
+/**
+ * stats_printf: One report line, label highlighted on screen and plain in the log.
+ */
+static void stats_printf(const char *label, const char *fmt, ...) {
+    char line[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (*label) printf(C_YELLOW "%s" C_RESET "%s", label, line);
+    else fputs(line, stdout);
+    if (log_fp) fprintf(log_fp, "%s%s", label, line);
+}
 
-int main(int argc, char *argv[]) {
-    setlocale(LC_NUMERIC, "en_US.UTF-8");
-    if (argc < 2) goto usage;
+static void stats_print_json(FILE *out, const gh_stats *total, double elapsed_ms) {
+    fprintf(out, "{\"elapsed_ms\": %.3f, \"threads\": %d, \"phases_ns\": {", elapsed_ms, stats_nthreads);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(out, "%s\"%s\": %llu", i ? ", " : "", PHASE_NAMES[i], (unsigned long long)total->phase_ns[i]);
+    }
+    fprintf(out, "}, \"files\": %llu, \"dirs\": %llu, \"opens\": %llu, \"reads\": %llu, \"bytes_read\": %llu, \"failures\": %llu",
+            (unsigned long long)total->files, (unsigned long long)total->dirs, (unsigned long long)total->opens,
+            (unsigned long long)total->reads, (unsigned long long)total->bytes_read, (unsigned long long)total->failures);
+    fprintf(out, ", \"latency_ns\": {\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"histogram\": [",
+            (unsigned long long)stats_percentile(total, 0.50), (unsigned long long)stats_percentile(total, 0.90),
+            (unsigned long long)stats_percentile(total, 0.99));
+    int first = 1;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        if (!total->latency[b]) continue;
+        fprintf(out, "%s[%llu, %llu, %llu]", first ? "" : ", ", (unsigned long long)stats_bucket_lo(b),
+                (unsigned long long)stats_bucket_lo(b + 1), (unsigned long long)total->latency[b]);
+        first = 0;
+    }
+    fprintf(out, "]}, \"per_thread\": [");
+    for (gh_stats *s = stats_registry; s; s = s->next) {
+        fprintf(out, "%s{\"id\": %d, \"role\": \"%s\", \"files\": %llu, \"dirs\": %llu, \"opens\": %llu, \"reads\": %llu, \"bytes_read\": %llu, \"failures\": %llu",
+                s == stats_registry ? "" : ", ", s->id, s->role, (unsigned long long)s->files, (unsigned long long)s->dirs,
+                (unsigned long long)s->opens, (unsigned long long)s->reads, (unsigned long long)s->bytes_read,
+                (unsigned long long)s->failures);
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            fprintf(out, ", \"%s_ns\": %llu", PHASE_NAMES[i], (unsigned long long)s->phase_ns[i]);
+        }
+        fputc('}', out);
+    }
+    fprintf(out, "]}\n");
+}
 
-    struct timespec start, end;
-    clock_gettime(CLOCK_MONOTONIC, &start);
+/**
+ * stats_report: Prints the merged counters after the Summary line. Every
+ * thread that registered must have been joined by now.
+ */
+void stats_report(double elapsed_ms) {
+    gh_stats total;
+    memset(&total, 0, sizeof(total));
+    for (gh_stats *s = stats_registry; s; s = s->next) stats_add(&total, s);
 
-    int ignore_extension = 0;
-    int recursive_mode = 0;
-    int files_total = 0;
-    int files_succeeded = 0;
-    unsigned long long total_size_bytes = 0;
-    int max_display_len = 15; 
-    char *log_filename = NULL;
+    if (stats_mode == STATS_JSON) {
+        stats_print_json(stdout, &total, elapsed_ms);
+        if (log_fp) stats_print_json(log_fp, &total, elapsed_ms);
+    } else {
+        char a[32], b[32], c[32];
+        stats_printf("Phases: ", "walk %.3f ms, open %.3f ms, read %.3f ms, hash %.3f ms, output %.3f ms (summed over %d thread%s)\n",
+                     total.phase_ns[PHASE_WALK] / 1e6, total.phase_ns[PHASE_OPEN] / 1e6, total.phase_ns[PHASE_READ] / 1e6,
+                     total.phase_ns[PHASE_HASH] / 1e6, total.phase_ns[PHASE_OUTPUT] / 1e6, stats_nthreads,
+                     stats_nthreads == 1 ? "" : "s");
+        stats_printf("Counters: ", "%'llu files, %'llu dirs, %'llu opens, %'llu reads (%'.2f MB), %'llu failures\n",
+                     (unsigned long long)total.files, (unsigned long long)total.dirs, (unsigned long long)total.opens,
+                     (unsigned long long)total.reads, total.bytes_read / 1048576.0, (unsigned long long)total.failures);
+        if (total.files > 0) {
+            stats_printf("Latency: ", "p50 %s, p90 %s, p99 %s\n",
+                         stats_fmt_ns(a, sizeof(a), stats_percentile(&total, 0.50)),
+                         stats_fmt_ns(b, sizeof(b), stats_percentile(&total, 0.90)),
+                         stats_fmt_ns(c, sizeof(c), stats_percentile(&total, 0.99)));
 
-    /* First pass: Parse arguments */
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--ignore") == 0) {
-            ignore_extension = 1;
-        } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--recursive") == 0) {
-            recursive_mode = 1;
-        } else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--log") == 0) {
-            if (i + 1 < argc) log_filename = argv[++i];
-        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--silent") == 0) {
-            silent_mode = 1;
-        } else if (argv[i][0] != '-') {
-            files_total++;
-            char path_copy[PATH_MAX];
-            strncpy(path_copy, argv[i], PATH_MAX - 1);
-            char *base = basename(path_copy);
-            int base_len = strlen(base);
-            if (base_len > max_display_len) max_display_len = base_len;
-
-            char abs_path[PATH_MAX];
-            if (realpath(argv[i], abs_path)) {
-                char *dir = dirname(abs_path);
-                int dir_len = strlen(dir);
-                if (dir_len > max_display_len) max_display_len = dir_len;
+            // One row per power of two between the fastest and slowest file
+            uint64_t octaves[STATS_BUCKETS >> STATS_SUB_BITS] = { 0 }, peak = 0;
+            int lo = -1, hi = -1;
+            for (int k = 0; k < STATS_BUCKETS; k++) {
+                int o = k >> STATS_SUB_BITS;
+                octaves[o] += total.latency[k];
+                if (total.latency[k]) { if (lo < 0) lo = o; hi = o; }
+            }
+            for (int o = lo; o <= hi; o++) if (octaves[o] > peak) peak = octaves[o];
+            for (int o = lo; o <= hi; o++) {
+                char bar[41];
+                int w = (int)((octaves[o] * 40 + peak - 1) / peak);
+                memset(bar, '#', (size_t)w);
+                bar[w] = '\0';
+                stats_printf("", "  %9s - %-9s |%-40s| %'llu\n",
+                             stats_fmt_ns(a, sizeof(a), stats_bucket_lo(o << STATS_SUB_BITS)),
+                             stats_fmt_ns(b, sizeof(b), stats_bucket_lo((o + 1) << STATS_SUB_BITS)),
+                             bar, (unsigned long long)octaves[o]);
+            }
+        }
+        if (stats_nthreads > 1) {
+            stats_printf("Threads:", "\n");
+            for (gh_stats *s = stats_registry; s; s = s->next) {
+                stats_printf("", "  %-6s #%-3d %'9llu files %'7llu dirs %'10llu reads | walk %9.3f  open %9.3f  read %9.3f  hash %9.3f  output %9.3f ms\n",
+                             s->role, s->id, (unsigned long long)s->files, (unsigned long long)s->dirs,
+                             (unsigned long long)s->reads, s->phase_ns[PHASE_WALK] / 1e6, s->phase_ns[PHASE_OPEN] / 1e6,
+                             s->phase_ns[PHASE_READ] / 1e6, s->phase_ns[PHASE_HASH] / 1e6, s->phase_ns[PHASE_OUTPUT] / 1e6);
             }
         }
     }
 
-    if (files_total == 0 && !recursive_mode) goto usage;
-    if (silent_mode && !log_filename) {
-        fprintf(stderr, C_RED "Error:" C_RESET " Silent mode requires a log file (-l).\n");
-        return 1;
+    while (stats_registry) {
+        gh_stats *next = stats_registry->next;
+        free(stats_registry);
+        stats_registry = next;
     }
+    stats_registry_tail = &stats_registry;
+}
 
-    // Initialize Log File
-    if (log_filename) {
-        log_fp = fopen(log_filename, "w");
-        if (!log_fp) {
-            fprintf(stderr, C_RED "Error:" C_RESET " Could not open log file " C_YELLOW "%s\n" C_RESET, log_filename);
-        } else {
-            time_t now = time(NULL);
-            struct tm *t = localtime(&now);
-            char time_str[64];
+int progress_mode = 0;
+__thread progress_slot *thread_progress = NULL;
+
+static struct {
+    progress_slot *slots;
+    progress_slot *walkers[WALK_THREADS_MAX];  // Shared by thread id of every parallel walk
+    pthread_mutex_t lock;  // Guards the lists and the flags below
+    pthread_cond_t wake;
+    pthread_t thread;
+    int running;
+    int last;              // The source being scanned is the final one
+    int listed;            // ...and the walker has listed all of it: found is the total
+    int walked;            // No more files will be queued: queued is the total
+    int stop;
+    int tty;               // Redraw one line in place instead of printing a line per second
+} progress = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+/**
+ * progress_thread: Registers a counter block for the calling thread and makes
+ * it the thread's thread_progress. Returns NULL when --progress is off.
+ */
+progress_slot *progress_thread(void) {
+    if (!progress_mode) return NULL;
+    progress_slot *pg = aligned_alloc(64, sizeof(progress_slot));
+    if (!pg) return NULL;
+    memset(pg, 0, sizeof(*pg));
+    pthread_mutex_lock(&progress.lock);
+    pg->next = progress.slots;
+    progress.slots = pg;
+    pthread_mutex_unlock(&progress.lock);
+    thread_progress = pg;
+    return pg;
+}
+
+/**
+ * progress_walker: Makes the block of walk thread id the calling thread's
+ * thread_progress. Walks run one after another, so reusing the blocks keeps
+ * a --files-from list of many directories from registering threads per line.
+ */
+progress_slot *progress_walker(int id) {
+    if (!progress_mode) return NULL;
+    pthread_mutex_lock(&progress.lock);
+    progress_slot *pg = progress.walkers[id];
+    if (!pg && (pg = aligned_alloc(64, sizeof(progress_slot))) != NULL) {
+        memset(pg, 0, sizeof(*pg));
+        pg->next = progress.slots;
+        progress.slots = progress.walkers[id] = pg;
+    }
+    pthread_mutex_unlock(&progress.lock);
+    thread_progress = pg;
+    return pg;
+}
+
+/**
+ * progress_fmt_eta: Formats a duration in seconds as m:ss or h:mm:ss.
+ */
+static char *progress_fmt_eta(char *buf, size_t cap, double s) {
+    unsigned long long t = (unsigned long long)(s + 0.5);
+    if (t >= 3600) snprintf(buf, cap, "%llu:%02llu:%02llu", t / 3600, t / 60 % 60, t % 60);
+    else snprintf(buf, cap, "%llu:%02llu", t / 60, t % 60);
+    return buf;
+}
+
+/**
+ * progress_draw: Writes one progress line. Rates come from the last
+ * PROGRESS_WINDOW ticks; the bar and the ETA need the final count, so they
+ * appear once the walk is over, or once the parallel walker has listed the
+ * last tree while its files are still being hashed.
+ */
+static void progress_draw(const progress_slot *now, const progress_slot *then, double window_s, int walked, int listed, int last) {
+    double files_s = window_s > 0 ? (now->done - then->done) / window_s : 0;
+    double mb_s = window_s > 0 ? (now->bytes - then->bytes) / 1048576.0 / window_s : 0;
+    uint64_t total = walked ? now->queued : now->found;
+    if (total < now->queued) total = now->queued;
+    if (total < now->done) total = now->done;
+    int known = walked || listed;
+    char text[192], eta[32];
+    int n;
+    if (known) {
+        n = snprintf(text, sizeof(text), "%3d%%  %'llu/%'llu files", total ? (int)(now->done * 100 / total) : 100,
+                     (unsigned long long)now->done, (unsigned long long)total);
+    } else {
+        n = snprintf(text, sizeof(text), "%'llu files, %'llu found so far",
+                     (unsigned long long)now->done, (unsigned long long)now->found);
+    }
+    if (known && !last && files_s > 0) {
+        n += snprintf(text + n, sizeof(text) - n, "  ETA %s", progress_fmt_eta(eta, sizeof(eta), (total - now->done) / files_s));
+    }
+    if (!last) n += snprintf(text + n, sizeof(text) - n, "  %'.0f files/s  %'.1f MB/s", files_s, mb_s);
+    if (n > (int)sizeof(text) - 1) n = (int)sizeof(text) - 1;
+
+    int width = PROGRESS_BAR;
+    if (progress.tty) {
+        // A line that wraps cannot be redrawn with \r, so the bar gives way first
+        struct winsize ws;
+        int cols = ioctl(STDERR_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col ? ws.ws_col : 80;
+        if (n > cols - 1) n = cols - 1;
+        if (width > cols - 1 - n - 3) width = cols - 1 - n - 3;
+    }
+
+    char line[256];
+    int len = 0;
+    if (progress.tty) line[len++] = '\r';
+    if (known && width >= 10) {
+        int fill = total ? (int)(now->done * (uint64_t)width / total) : width;
+        line[len++] = '[';
+        for (int i = 0; i < width; i++) line[len++] = i < fill ? '=' : i == fill ? '>' : ' ';
+        line[len++] = ']';
+        line[len++] = ' ';
+    }
+    memcpy(line + len, text, (size_t)n);
+    len += n;
+    if (progress.tty) {
+        memcpy(line + len, "\033[K", 3);
+        len += 3;
+    }
+    if (!progress.tty || last) line[len++] = '\n';
+    // One write per update, so messages from other threads cannot split it
+    if (write(STDERR_FILENO, line, (size_t)len) < 0) return;
+}
+
+static void *progress_main(void *arg) {
+    (void)arg;
+    progress_slot ring[PROGRESS_WINDOW];
+    uint64_t stamps[PROGRESS_WINDOW];
+    memset(ring, 0, sizeof(ring));
+    for (int i = 0; i < PROGRESS_WINDOW; i++) stamps[i] = stats_now();
+    unsigned tick = 0;
+
+    pthread_mutex_lock(&progress.lock);
+    for (;;) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 1000000000L / PROGRESS_HZ;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (!progress.stop && pthread_cond_timedwait(&progress.wake, &progress.lock, &deadline) != ETIMEDOUT) {}
+
+        progress_slot now;
+        memset(&now, 0, sizeof(now));
+        for (const progress_slot *pg = progress.slots; pg; pg = pg->next) {
+            now.found += __atomic_load_n(&pg->found, __ATOMIC_RELAXED);
+            now.queued += __atomic_load_n(&pg->queued, __ATOMIC_RELAXED);
+            now.done += __atomic_load_n(&pg->done, __ATOMIC_RELAXED);
+            now.bytes += __atomic_load_n(&pg->bytes, __ATOMIC_RELAXED);
+        }
+        int walked = progress.walked, listed = progress.listed, stop = progress.stop;
+        pthread_mutex_unlock(&progress.lock);
+
+        uint64_t t = stats_now();
+        unsigned slot = ++tick % PROGRESS_WINDOW;   // Oldest sample, about to be replaced
+        if (stop || progress.tty || tick % PROGRESS_HZ == 0) {
+            progress_draw(&now, &ring[slot], (t - stamps[slot]) / 1e9, walked, listed, stop);
+        }
+        ring[slot] = now;
+        stamps[slot] = t;
+
+        pthread_mutex_lock(&progress.lock);
+        if (stop) break;
+    }
+    pthread_mutex_unlock(&progress.lock);
+    return NULL;
+}
+
+/**
+ * progress_start: Starts the reporter thread. Threads that count files must
+ * have called progress_thread() by the time they do.
+ */
+void progress_start(void) {
+    if (!progress_mode) return;
+    progress.tty = isatty(STDERR_FILENO);
+    if (pthread_create(&progress.thread, NULL, progress_main, NULL) == 0) progress.running = 1;
+}
+
+/**
+ * progress_last_source: Marks the root or log scanned next as the final
+ * source of files, so progress_listed() can take effect.
+ */
+void progress_last_source(void) {
+    pthread_mutex_lock(&progress.lock);
+    progress.last = 1;
+    pthread_mutex_unlock(&progress.lock);
+}
+
+/**
+ * progress_listed: Called when every file of the current source has been
+ * counted in found, possibly long before they are all queued.
+ */
+void progress_listed(void) {
+    pthread_mutex_lock(&progress.lock);
+    progress.listed = progress.last;
+    pthread_mutex_unlock(&progress.lock);
+}
+
+/**
+ * progress_walked: Tells the reporter that every file has been queued, so the
+ * bar and the ETA can be shown.
+ */
+void progress_walked(void) {
+    pthread_mutex_lock(&progress.lock);
+    progress.walked = 1;
+    pthread_mutex_unlock(&progress.lock);
+}
+
+/**
+ * progress_stop: Draws the final line and joins the reporter. Every thread
+ * that registered a counter block must be done counting.
+ */
+void progress_stop(void) {
+    if (progress.running) {
+        pthread_mutex_lock(&progress.lock);
+        progress.stop = 1;
+        pthread_cond_signal(&progress.wake);
+        pthread_mutex_unlock(&progress.lock);
+        pthread_join(progress.thread, NULL);
+        progress.running = 0;
+    }
+    thread_progress = NULL;
+    while (progress.slots) {
+        progress_slot *next = progress.slots->next;
+        free(progress.slots);
+        progress.slots = next;
+    }
+}
+
+/**
+ * dupe_new: An empty table. With a limit (bytes), members are not kept in
+ * memory but spilled in sorted runs once the limit is reached (--mem-limit).
+ */
+dupe_table *dupe_new(int keep_stat, size_t limit) {
+    dupe_table *t = calloc(1, sizeof(dupe_table));
+    if (!t) return NULL;
+    t->keep_stat = keep_stat;
+    t->index_cap = 1024;
+    t->index = calloc(t->index_cap, sizeof(size_t));
+    if (!t->index || (limit && !(t->spill = spill_new(limit)))) {
+        free(t->index);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+static size_t dupe_slot(unsigned long long hash, unsigned long long size, size_t cap) {
+    unsigned long long k = (hash ^ (size * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+    return (size_t)(k ^ (k >> 32)) & (cap - 1);
+}
+
+static int dupe_grow(dupe_table *t) {
+    size_t cap = t->index_cap * 2;
+    size_t *index = calloc(cap, sizeof(size_t));
+    if (!index) return -1;
+    for (size_t g = 0; g < t->ngroups; g++) {
+        size_t i = dupe_slot(t->groups[g].hash, t->groups[g].size, cap);
+        while (index[i]) i = (i + 1) & (cap - 1);
+        index[i] = g + 1;
+    }
+    free(t->index);
+    t->index = index;
+    t->index_cap = cap;
+    return 0;
+}
+
+/**
+ * dupe_add: Appends path to the group for (hash, size), creating the group if needed.
+ */
+int dupe_add(dupe_table *t, unsigned long long hash, unsigned long long size, const char *path, const struct stat *st) {
+    if (t->spill) return spill_add(t->spill, hash, size, path, st);
+    if (t->nmembers == t->members_cap) {
+        size_t cap = t->members_cap ? t->members_cap * 2 : 1024;
+        dupe_member *m = realloc(t->members, cap * sizeof(dupe_member));
+        if (!m) return -1;
+        t->members = m;
+        if (t->keep_stat) {
+            struct stat *sts = realloc(t->stats, cap * sizeof(struct stat));
+            if (!sts) return -1;
+            t->stats = sts;
+        }
+        t->members_cap = cap;
+    }
+    if ((t->ngroups + 1) * 10 > t->index_cap * 7 && dupe_grow(t) != 0) return -1;
+
+    size_t i = dupe_slot(hash, size, t->index_cap);
+    while (t->index[i]) {
+        dupe_group *g = &t->groups[t->index[i] - 1];
+        if (g->hash == hash && g->size == size) break;
+        i = (i + 1) & (t->index_cap - 1);
+    }
+
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    size_t m = t->nmembers++;
+    t->members[m].path = copy;
+    t->members[m].next = SIZE_MAX;
+    t->members[m].dev = st ? (uint64_t)st->st_dev : 0;
+    t->members[m].ino = st ? (uint64_t)st->st_ino : 0;
+    if (t->keep_stat && st) t->stats[m] = *st;
+
+    if (t->index[i]) {
+        dupe_group *g = &t->groups[t->index[i] - 1];
+        t->members[g->last].next = m;
+        g->last = m;
+        g->count++;
+        return 0;
+    }
+
+    if (t->ngroups == t->groups_cap) {
+        size_t cap = t->groups_cap ? t->groups_cap * 2 : 1024;
+        dupe_group *g = realloc(t->groups, cap * sizeof(dupe_group));
+        if (!g) return -1;
+        t->groups = g;
+        t->groups_cap = cap;
+    }
+    dupe_group *g = &t->groups[t->ngroups++];
+    g->hash = hash;
+    g->size = size;
+    g->first = g->last = m;
+    g->count = 1;
+    t->index[i] = t->ngroups;
+    return 0;
+}
+
+/**
+ * dupe_clear: Empties t for reuse, keeping its allocations.
+ */
+void dupe_clear(dupe_table *t) {
+    for (size_t i = 0; i < t->nmembers; i++) free(t->members[i].path);
+    for (size_t g = 0; g < t->ngroups; g++) {
+        // Slots already cleared may sit in the probe path, so look for the entry itself
+        size_t i = dupe_slot(t->groups[g].hash, t->groups[g].size, t->index_cap);
+        while (t->index[i] != g + 1) i = (i + 1) & (t->index_cap - 1);
+        t->index[i] = 0;
+    }
+    t->nmembers = 0;
+    t->ngroups = 0;
+}
+
+/**
+ * files_identical: Full byte-for-byte comparison. Returns 1 if equal,
+ * 0 if different, -1 on I/O error.
+ */
+static int files_identical(const char *a, const char *b, unsigned char *buf_a, unsigned char *buf_b) {
+    int fa = open(a, O_RDONLY);
+    if (fa == -1) return -1;
+    int fb = open(b, O_RDONLY);
+    if (fb == -1) { close(fa); return -1; }
+    posix_fadvise(fa, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fb, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    int result = 1;
+    for (;;) {
+        ssize_t na = read(fa, buf_a, CONFIRM_BUF_SIZE);
+        ssize_t nb = read(fb, buf_b, CONFIRM_BUF_SIZE);
+        if (na < 0 || nb < 0) { result = -1; break; }
+        if (na != nb || memcmp(buf_a, buf_b, (size_t)na) != 0) { result = 0; break; }
+        if (na == 0) break;
+    }
+    if (hash_opts.pagecache != GH_PAGECACHE_KEEP) {
+        posix_fadvise(fa, 0, 0, POSIX_FADV_DONTNEED);
+        posix_fadvise(fb, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(fa);
+    close(fb);
+    return result;
+}
+
+static void dupe_print_member(dupe_table *t, const dupe_group *g, size_t m, unsigned group) {
+    if (record_fp) print_record(g->hash, &t->stats[m], t->members[m].path, group);
+    else print_simple_output(g->hash, t->members[m].path);
+}
+
+static void dupe_print_gap(void) {
+    if (record_fp) return;   // Records carry their group number instead
+    if (!silent_mode) putchar('\n');
+    if (log_fp) fputc('\n', log_fp);
+}
+
+typedef struct {
+    uint64_t dev, ino;
+} dupe_key;
+
+static int dupe_key_cmp(const void *a, const void *b) {
+    const dupe_key *x = a, *y = b;
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    return x->ino < y->ino ? -1 : x->ino > y->ino;
+}
+
+/**
+ * dupe_distinct: Number of different files among the n members in idx. Hard
+ * links of one file count once, members without an inode number each count.
+ * keys is scratch space for n entries.
+ */
+static size_t dupe_distinct(const dupe_table *t, const size_t *idx, size_t n, dupe_key *keys) {
+    size_t nkeys = 0, distinct = 0;
+    for (size_t j = 0; j < n; j++) {
+        const dupe_member *m = &t->members[idx[j]];
+        if (m->ino == 0) distinct++;
+        else keys[nkeys++] = (dupe_key){ m->dev, m->ino };
+    }
+    qsort(keys, nkeys, sizeof(dupe_key), dupe_key_cmp);
+    for (size_t j = 0; j < nkeys; j++) {
+        if (j == 0 || dupe_key_cmp(&keys[j - 1], &keys[j]) != 0) distinct++;
+    }
+    return distinct;
+}
+
+/**
+ * dupe_one_inode: 1 if every member of g is a link to the same file.
+ */
+int dupe_one_inode(const dupe_table *t, const dupe_group *g) {
+    const dupe_member *first = &t->members[g->first];
+    if (first->ino == 0) return 0;
+    for (size_t m = first->next; m != SIZE_MAX; m = t->members[m].next) {
+        if (t->members[m].dev != first->dev || t->members[m].ino != first->ino) return 0;
+    }
+    return 1;
+}
+
+static int dupe_same_inode(const dupe_table *t, size_t a, size_t b) {
+    return t->members[a].ino != 0 && t->members[a].dev == t->members[b].dev && t->members[a].ino == t->members[b].ino;
+}
+
+typedef struct {
+    int confirm;
+    unsigned char *buf_a, *buf_b;
+    size_t *pending, *klass;   // Scratch sized for the largest group so far
+    dupe_key *keys;
+    size_t cap;
+    int failed;
+    unsigned long long groups, files, wasted, links;
+} dupe_tally;
+
+/* Prints one reported class of g (the nklass members in klass) if it holds two or more different files. */
+static void dupe_report_class(dupe_table *t, const dupe_group *g, const size_t *klass, size_t nklass, dupe_tally *r) {
+    size_t distinct = dupe_distinct(t, klass, nklass, r->keys);
+    if (distinct < 2) return;
+    for (size_t j = 0; j < nklass; j++) dupe_print_member(t, g, klass[j], (unsigned)r->groups + 1);
+    dupe_print_gap();
+    r->groups++;
+    r->files += nklass;
+    r->wasted += g->size * (distinct - 1);
+    r->links += nklass - distinct;
+    out_tick();
+}
+
+/**
+ * dupe_report_group: The part of dupe_report() for one group. With confirm,
+ * the first unclassified file is repeatedly taken as a reference and every
+ * file identical to it is moved into its class.
+ */
+static void dupe_report_group(dupe_table *t, const dupe_group *g, dupe_tally *r) {
+    if (g->count < 2 || r->failed) return;
+    if (g->count > r->cap) {
+        size_t *p = realloc(r->pending, g->count * sizeof(size_t));
+        size_t *k = realloc(r->klass, g->count * sizeof(size_t));
+        dupe_key *ks = realloc(r->keys, g->count * sizeof(dupe_key));
+        if (p) r->pending = p;
+        if (k) r->klass = k;
+        if (ks) r->keys = ks;
+        if (!p || !k || !ks) {
+            r->failed = 1;
+            return;
+        }
+        r->cap = g->count;
+    }
+    size_t *pending = r->pending, *klass = r->klass;
+    size_t npending = 0;
+    for (size_t m = g->first; m != SIZE_MAX; m = t->members[m].next) pending[npending++] = m;
+
+    if (!r->confirm) {
+        dupe_report_class(t, g, pending, npending, r);
+        return;
+    }
+    while (npending >= 2) {
+        size_t ref = pending[0], nklass = 0, nrest = 0;
+        klass[nklass++] = ref;
+        for (size_t j = 1; j < npending; j++) {
+            int same = dupe_same_inode(t, ref, pending[j]) ? 1 : files_identical(t->members[ref].path, t->members[pending[j]].path, r->buf_a, r->buf_b);
+            if (same == 1) klass[nklass++] = pending[j];
+            else if (same == 0) pending[nrest++] = pending[j];
+            else if (!silent_mode) fprintf(stderr, C_RED "Read Error:" C_RESET " '%s' could not be compared\n", t->members[pending[j]].path);
+        }
+        npending = nrest;
+        dupe_report_class(t, g, klass, nklass, r);
+    }
+}
+
+static void dupe_report_spilled(dupe_table *group, dupe_group *g, void *user) {
+    dupe_report_group(group, g, user);
+}
+
+/**
+ * dupe_report: Prints every group with two or more different files. With
+ * confirm, each group is split into classes of byte-identical files first,
+ * and only classes of two or more are printed. Hard links of a file are
+ * listed with it but are not extra copies. Groups come in first-seen order,
+ * or by size and hash from a table that spilled (--mem-limit).
+ */
+void dupe_report(dupe_table *t, int confirm) {
+    dupe_tally r;
+    memset(&r, 0, sizeof(r));
+    r.confirm = confirm;
+    if (confirm) {
+        r.buf_a = malloc(CONFIRM_BUF_SIZE);
+        r.buf_b = malloc(CONFIRM_BUF_SIZE);
+        if (!r.buf_a || !r.buf_b) {
+            fprintf(stderr, C_YELLOW "Warning:" C_RESET " Not enough memory to confirm duplicates, reporting hash matches only.\n");
+            r.confirm = 0;
+        }
+    }
+
+    if (t->spill) {
+        if (spill_groups(t->spill, t->keep_stat, dupe_report_spilled, &r) != 0) r.failed = 1;
+    } else {
+        for (size_t gi = 0; gi < t->ngroups && !r.failed; gi++) dupe_report_group(t, &t->groups[gi], &r);
+    }
+    if (r.failed) fprintf(stderr, C_RED "Error:" C_RESET " The duplicate report is incomplete (out of memory or spill file unreadable).\n");
+
+    double wasted_mb = r.wasted / 1048576.0;
+    const char *how = r.confirm ? "confirmed " : "";
+    char linked[64] = "";
+    if (r.links) snprintf(linked, sizeof(linked), ", %'llu of them hard links", r.links);
+    printf(C_YELLOW "Duplicates: " C_RESET "%'llu %sgroups, %'llu files%s (" C_CYAN "%' .2f" C_RESET " MB in extra copies).\n",
+           r.groups, how, r.files, linked, wasted_mb);
+    if (log_fp) fprintf(log_fp, "Duplicates: %'llu %sgroups, %'llu files%s (%' .2f MB in extra copies).\n", r.groups, how, r.files, linked, wasted_mb);
+
+    free(r.buf_a);
+    free(r.buf_b);
+    free(r.pending);
+    free(r.klass);
+    free(r.keys);
+}
+
+void dupe_free(dupe_table *t) {
+    if (t->spill) spill_free(t->spill);
+    for (size_t i = 0; i < t->nmembers; i++) free(t->members[i].path);
+    free(t->members);
+    free(t->stats);
+    free(t->groups);
+    free(t->index);
+    free(t);
+}
+
+/* ================= DUPE SPILL ================= */
+
+static unsigned long long spill_runs_written = 0, spill_bytes_written = 0, spill_merge_passes = 0;
+
+static int spill_cmp(const spill_record *a, const spill_record *b) {
+    if (a->size != b->size) return a->size < b->size ? -1 : 1;
+    if (a->hash != b->hash) return a->hash < b->hash ? -1 : 1;
+    return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+static void spill_sift(spill_record *a, size_t i, size_t n) {
+    spill_record top = a[i];
+    for (size_t c; (c = 2 * i + 1) < n; i = c) {
+        if (c + 1 < n && spill_cmp(&a[c], &a[c + 1]) < 0) c++;
+        if (spill_cmp(&top, &a[c]) >= 0) break;
+        a[i] = a[c];
+    }
+    a[i] = top;
+}
+
+/* Heapsort, in place: qsort() may allocate a copy of the records, which the limit does not cover. */
+static void spill_sort(spill_record *a, size_t n) {
+    for (size_t i = n / 2; i-- > 0;) spill_sift(a, i, n);
+    while (n > 1) {
+        spill_record top = a[0];
+        a[0] = a[--n];
+        a[n] = top;
+        spill_sift(a, 0, n);
+    }
+}
+
+/* An unlinked file in $TMPDIR (or /tmp) for the runs. */
+static FILE *spill_open(void) {
+    const char *dir = getenv("TMPDIR");
+    if (!dir || !*dir) dir = "/tmp";
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/gh-spill-XXXXXX", dir);
+        fd = mkostemp(path, O_CLOEXEC);
+        if (fd != -1) unlink(path);
+    }
+    if (fd == -1) return NULL;
+    FILE *f = fdopen(fd, "w+");
+    if (!f) close(fd);
+    return f;
+}
+
+/**
+ * spill_new: A spill store with a cap-byte buffer. The spill file is created
+ * up front, so a missing $TMPDIR fails before the scan and not at its first
+ * spill. Returns NULL after printing why.
+ */
+dupe_spill *spill_new(size_t cap) {
+    if (cap < SPILL_MIN) cap = SPILL_MIN;
+    dupe_spill *s = calloc(1, sizeof(dupe_spill));
+    // Pages are only touched as records arrive, so a generous limit costs nothing up front
+    if (!s || !(s->buf = malloc(cap))) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Out of memory.\n");
+        free(s);
+        return NULL;
+    }
+    if (!(s->file = spill_open())) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Could not create a spill file for --mem-limit (%s).\n", strerror(errno));
+        free(s->buf);
+        free(s);
+        return NULL;
+    }
+    s->cap = cap;
+    return s;
+}
+
+/**
+ * spill_write: Sorts the buffered records and appends them to the spill file
+ * as one run, each record followed by its path.
+ */
+static int spill_write(dupe_spill *s) {
+    if (s->nruns == s->runs_cap) {
+        size_t cap = s->runs_cap ? s->runs_cap * 2 : 16;
+        spill_extent *runs = realloc(s->runs, cap * sizeof(spill_extent));
+        if (!runs) return -1;
+        s->runs = runs;
+        s->runs_cap = cap;
+    }
+    spill_record *recs = (spill_record *)s->buf;
+    spill_sort(recs, s->nrecs);
+    spill_extent *run = &s->runs[s->nruns];
+    run->off = s->file_len;
+    for (size_t i = 0; i < s->nrecs; i++) {
+        if (fwrite_unlocked(&recs[i], sizeof(spill_record), 1, s->file) != 1 ||
+            fwrite_unlocked(s->buf + recs[i].path, recs[i].path_len + 1, 1, s->file) != 1) {
+            fprintf(stderr, C_RED "Error:" C_RESET " Could not write the --mem-limit spill file (%s).\n", strerror(errno));
+            return -1;
+        }
+        s->file_len += sizeof(spill_record) + recs[i].path_len + 1;
+    }
+    run->end = s->file_len;
+    s->nruns++;
+    spill_runs_written++;
+    spill_bytes_written += run->end - run->off;
+    s->nrecs = 0;
+    s->path_used = 0;
+    return 0;
+}
+
+/**
+ * spill_add: Buffers one member, writing the buffer out as a sorted run
+ * first if it is full. A path that could never fit the buffer is refused
+ * without failing the store.
+ */
+int spill_add(dupe_spill *s, unsigned long long hash, unsigned long long size, const char *path, const struct stat *st) {
+    if (s->failed) return -1;
+    size_t len = strlen(path);
+    if (sizeof(spill_record) + len + 1 > s->cap) return -1;
+    if ((s->nrecs + 1) * sizeof(spill_record) + s->path_used + len + 1 > s->cap && spill_write(s) != 0) {
+        s->failed = 1;
+        return -1;
+    }
+    s->path_used += len + 1;
+    spill_record *r = (spill_record *)s->buf + s->nrecs++;
+    memset(r, 0, sizeof(*r));
+    r->size = size;
+    r->hash = hash;
+    r->seq = s->seq++;
+    r->path = s->cap - s->path_used;
+    r->path_len = (uint32_t)len;
+    if (st) {
+        r->dev = (uint64_t)st->st_dev;
+        r->ino = (uint64_t)st->st_ino;
+        r->mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+        r->nlink = (uint32_t)st->st_nlink;
+    }
+    memcpy(s->buf + r->path, path, len + 1);
+    return 0;
+}
+
+/*
+ * Makes sure need bytes of r are buffered; moves what is left to the front
+ * first, and grows the buffer for a record with an unusually long path.
+ */
+static int spill_fill(dupe_spill *s, spill_run *r, size_t need) {
+    if (r->len - r->pos >= need) return 0;
+    memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+    r->len -= r->pos;
+    r->pos = 0;
+    if (need > r->cap) {
+        unsigned char *buf = realloc(r->buf, need);
+        if (!buf) return -1;
+        r->buf = buf;
+        r->cap = need;
+    }
+    while (r->len < need) {
+        size_t want = r->cap - r->len;
+        if (want > r->end - r->off) want = (size_t)(r->end - r->off);
+        if (want == 0) return -1;
+        ssize_t got = pread(fileno(s->file), r->buf + r->len, want, (off_t)r->off);
+        if (got <= 0) return -1;
+        r->len += (size_t)got;
+        r->off += (uint64_t)got;
+    }
+    return 0;
+}
+
+/* Steps r to its next record; 0 when there is one, 1 at the end of the run, -1 on error. */
+static int spill_step(dupe_spill *s, spill_run *r) {
+    if (r->pos == r->len && r->off == r->end) return 1;
+    if (spill_fill(s, r, sizeof(spill_record)) != 0) return -1;
+    memcpy(&r->rec, r->buf + r->pos, sizeof(spill_record));
+    r->pos += sizeof(spill_record);
+    if (spill_fill(s, r, r->rec.path_len + 1) != 0) return -1;
+    return 0;
+}
+
+static void spill_heap_down(dupe_spill *s, size_t i) {
+    size_t *h = s->heap, top = h[i];
+    for (size_t c; (c = 2 * i + 1) < s->nheap; i = c) {
+        if (c + 1 < s->nheap && spill_cmp(&s->merge[h[c + 1]].rec, &s->merge[h[c]].rec) < 0) c++;
+        if (spill_cmp(&s->merge[top].rec, &s->merge[h[c]].rec) <= 0) break;
+        h[i] = h[c];
+    }
+    h[i] = top;
+}
+
+/* Starts merging runs [first, first + n), each read through an each-byte buffer. */
+static int spill_merge_open(dupe_spill *s, size_t first, size_t n, size_t each) {
+    memset(s->merge, 0, n * sizeof(spill_run));
+    s->nmerge = n;
+    s->nheap = 0;
+    for (size_t i = 0; i < n; i++) {
+        spill_run *r = &s->merge[i];
+        r->off = s->runs[first + i].off;
+        r->end = s->runs[first + i].end;
+        if (!(r->buf = malloc(each))) return -1;
+        r->cap = each;
+        int rc = spill_step(s, r);
+        if (rc < 0) return -1;
+        if (rc == 0) s->heap[s->nheap++] = i;
+    }
+    for (size_t i = s->nheap / 2; i-- > 0;) spill_heap_down(s, i);
+    return 0;
+}
+
+static void spill_merge_close(dupe_spill *s) {
+    for (size_t i = 0; i < s->nmerge; i++) free(s->merge[i].buf);
+    s->nmerge = 0;
+    s->nheap = 0;
+}
+
+/**
+ * spill_next: The next record in (size, hash, arrival) order and its path,
+ * which stays valid until the next call. Returns 1, 0 at the end, -1 on error.
+ */
+static int spill_next(dupe_spill *s, spill_record *out, const char **path) {
+    if (s->nruns == 0) {
+        if (s->next == s->nrecs) return 0;
+        *out = ((spill_record *)s->buf)[s->next++];
+        *path = (const char *)s->buf + out->path;
+        return 1;
+    }
+    if (s->nheap == 0) return 0;
+    spill_run *r = &s->merge[s->heap[0]];
+    *out = r->rec;
+    *path = (const char *)r->buf + r->pos;
+    r->pos += out->path_len + 1;   // Still buffered: a refill only happens in the next spill_step()
+    return 1;
+}
+
+/* Moves the run spill_next() took a record from to its next one. */
+static int spill_advance(dupe_spill *s) {
+    if (s->nruns == 0 || s->nheap == 0) return 0;
+    int rc = spill_step(s, &s->merge[s->heap[0]]);
+    if (rc < 0) return -1;
+    if (rc > 0) s->heap[0] = s->heap[--s->nheap];
+    if (s->nheap) spill_heap_down(s, 0);
+    return 0;
+}
+
+/**
+ * spill_merge_pass: Merges the runs fan_in at a time into longer runs at the
+ * end of the spill file, and gives the blocks of the merged ones back.
+ */
+static int spill_merge_pass(dupe_spill *s, size_t fan_in) {
+    size_t each = s->cap / fan_in;
+    if (each > SPILL_READ_MAX) each = SPILL_READ_MAX;
+    size_t out = 0;
+    for (size_t first = 0; first < s->nruns; first += fan_in) {
+        size_t n = s->nruns - first < fan_in ? s->nruns - first : fan_in;
+        if (n == 1) {
+            s->runs[out++] = s->runs[first];
+            continue;
+        }
+        uint64_t off = s->file_len;
+        int rc = spill_merge_open(s, first, n, each);
+        spill_record r;
+        const char *path;
+        while (rc == 0 && (rc = spill_next(s, &r, &path)) > 0) {
+            if (fwrite_unlocked(&r, sizeof(spill_record), 1, s->file) != 1 ||
+                fwrite_unlocked(path, r.path_len + 1, 1, s->file) != 1) {
+                fprintf(stderr, C_RED "Error:" C_RESET " Could not write the --mem-limit spill file (%s).\n", strerror(errno));
+                rc = -1;
+                break;
+            }
+            s->file_len += sizeof(spill_record) + r.path_len + 1;
+            rc = spill_advance(s);
+        }
+        spill_merge_close(s);
+        if (rc < 0 || fflush(s->file) != 0) return -1;
+        for (size_t i = first; i < first + n; i++) {
+            fallocate(fileno(s->file), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      (off_t)s->runs[i].off, (off_t)(s->runs[i].end - s->runs[i].off));
+        }
+        s->runs[out].off = off;
+        s->runs[out++].end = s->file_len;
+    }
+    s->nruns = out;
+    spill_merge_passes++;
+    return 0;
+}
+
+/**
+ * spill_start: Sets up the final pass. Without runs the buffer is sorted
+ * where it is; otherwise it becomes the last run and is freed, and its budget
+ * pays for one read buffer per run. While there are more runs than the budget
+ * has room for, they are merged into fewer, longer ones first.
+ */
+static int spill_start(dupe_spill *s) {
+    if (s->nruns == 0) {
+        spill_sort((spill_record *)s->buf, s->nrecs);
+        s->next = 0;
+        return 0;
+    }
+    if (s->nrecs && spill_write(s) != 0) return -1;
+    if (fflush(s->file) != 0) return -1;
+    free(s->buf);
+    s->buf = NULL;
+
+    size_t fan_in = s->cap / SPILL_READ_MIN;   // spill_fill() grows a buffer for a longer record
+    if (fan_in < 2) fan_in = 2;
+    size_t n = s->nruns < fan_in ? s->nruns : fan_in;
+    if (!(s->merge = calloc(n, sizeof(spill_run))) || !(s->heap = malloc(n * sizeof(size_t)))) return -1;
+    while (s->nruns > fan_in) {
+        if (spill_merge_pass(s, fan_in) != 0) return -1;
+    }
+
+    size_t each = s->cap / s->nruns;
+    if (each > SPILL_READ_MAX) each = SPILL_READ_MAX;
+    return spill_merge_open(s, 0, s->nruns, each);
+}
+
+static void spill_stat(const spill_record *r, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_mode = S_IFREG;
+    st->st_size = (off_t)r->size;
+    st->st_dev = (dev_t)r->dev;
+    st->st_ino = (ino_t)r->ino;
+    st->st_nlink = (nlink_t)r->nlink;
+    st->st_mtim.tv_sec = (time_t)(r->mtime_ns / 1000000000LL);
+    st->st_mtim.tv_nsec = (long)(r->mtime_ns % 1000000000LL);
+}
+
+/**
+ * spill_groups: Replays every member in (size, hash) order and hands each
+ * group, loaded alone into a small table, to fn. Memory beyond the buffers
+ * is one group at a time. Returns -1 if a run could not be read back.
+ */
+int spill_groups(dupe_spill *s, int keep_stat, spill_group_fn fn, void *user) {
+    if (s->failed) return -1;
+    dupe_table *group = dupe_new(keep_stat, 0);
+    if (!group || spill_start(s) != 0) {
+        if (group) dupe_free(group);
+        return -1;
+    }
+    spill_record r;
+    const char *path;
+    int rc = spill_next(s, &r, &path);
+    while (rc > 0) {
+        unsigned long long size = r.size, hash = r.hash;
+        dupe_clear(group);
+        do {
+            struct stat st;
+            spill_stat(&r, &st);
+            if (dupe_add(group, hash, size, path, &st) != 0 || spill_advance(s) != 0) {
+                rc = -1;
+                break;
+            }
+            rc = spill_next(s, &r, &path);
+        } while (rc > 0 && r.size == size && r.hash == hash);
+        if (rc >= 0) fn(group, &group->groups[0], user);
+    }
+    dupe_free(group);
+    return rc < 0 ? -1 : 0;
+}
+
+void spill_free(dupe_spill *s) {
+    if (s->file) fclose(s->file);
+    spill_merge_close(s);
+    free(s->merge);
+    free(s->runs);
+    free(s->heap);
+    free(s->buf);
+    free(s);
+}
+
+/**
+ * spill_summary: How much of the scan went to disk under --mem-limit.
+ */
+void spill_summary(void) {
+    if (!spill_runs_written) return;
+    double mb = spill_bytes_written / 1048576.0;
+    printf(C_YELLOW "Memory limit: " C_RESET "%'llu sorted runs (" C_CYAN "%' .2f" C_RESET " MB) were spilled to disk and merged", spill_runs_written, mb);
+    if (spill_merge_passes) printf(", with %'llu intermediate merge passes", spill_merge_passes);
+    printf(".\n");
+    if (log_fp) {
+        fprintf(log_fp, "Memory limit: %'llu sorted runs (%' .2f MB) were spilled to disk and merged", spill_runs_written, mb);
+        if (spill_merge_passes) fprintf(log_fp, ", with %'llu intermediate merge passes", spill_merge_passes);
+        fprintf(log_fp, ".\n");
+    }
+}
+
+/* ================= INODE SET ================= */
+
+static size_t inode_slot(uint64_t dev, uint64_t ino, size_t cap) {
+    unsigned long long k = (ino ^ (dev * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+    return (size_t)(k ^ (k >> 32)) & (cap - 1);
+}
+
+inode_set *inode_new(void) {
+    inode_set *s = calloc(1, sizeof(inode_set));
+    if (!s) return NULL;
+    s->cap = 1024;
+    s->slots = calloc(s->cap, sizeof(inode_entry));
+    if (!s->slots) { free(s); return NULL; }
+    pthread_mutex_init(&s->lock, NULL);
+    return s;
+}
+
+/* Finds the slot of (dev, ino), or the free slot it would take. Caller holds s->lock. */
+static inode_entry *inode_find(inode_set *s, uint64_t dev, uint64_t ino) {
+    size_t i = inode_slot(dev, ino, s->cap);
+    while (s->slots[i].state != INODE_EMPTY && (s->slots[i].dev != dev || s->slots[i].ino != ino)) i = (i + 1) & (s->cap - 1);
+    return &s->slots[i];
+}
+
+static int inode_grow(inode_set *s) {
+    size_t cap = s->cap * 2;
+    inode_entry *slots = calloc(cap, sizeof(inode_entry));
+    if (!slots) return -1;
+    for (size_t i = 0; i < s->cap; i++) {
+        if (s->slots[i].state == INODE_EMPTY) continue;
+        size_t j = inode_slot(s->slots[i].dev, s->slots[i].ino, cap);
+        while (slots[j].state != INODE_EMPTY) j = (j + 1) & (cap - 1);
+        slots[j] = s->slots[i];
+    }
+    free(s->slots);
+    s->slots = slots;
+    s->cap = cap;
+    return 0;
+}
+
+/**
+ * inode_add: Adds the inode of st in the given state. Returns INODE_EMPTY if
+ * it was new, otherwise leaves it alone and returns its state, with *hash set
+ * (hash may be NULL). Out of memory, the inode is reported as INODE_FAILED,
+ * so the caller just hashes the path.
+ */
+int inode_add(inode_set *s, const struct stat *st, int state, unsigned long long *hash) {
+    pthread_mutex_lock(&s->lock);
+    int found = INODE_FAILED;
+    if ((s->count + 1) * 10 <= s->cap * 7 || inode_grow(s) == 0) {
+        inode_entry *e = inode_find(s, (uint64_t)st->st_dev, (uint64_t)st->st_ino);
+        found = e->state;
+        if (found == INODE_EMPTY) {
+            e->dev = (uint64_t)st->st_dev;
+            e->ino = (uint64_t)st->st_ino;
+            e->hash = 0;
+            e->state = state;
+            s->count++;
+        } else if (hash) {
+            *hash = e->hash;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    return found;
+}
+
+/**
+ * inode_publish: Records the result of the first link of a pending inode
+ * (0 if it could not be hashed). Other entries are left alone.
+ */
+void inode_publish(inode_set *s, uint64_t dev, uint64_t ino, unsigned long long hash) {
+    pthread_mutex_lock(&s->lock);
+    inode_entry *e = inode_find(s, dev, ino);
+    if (e->state == INODE_PENDING) {
+        e->hash = hash;
+        e->state = hash != 0 ? INODE_HASHED : INODE_FAILED;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * inode_hash: The published result of an inode, or 0 if there is none (yet).
+ */
+unsigned long long inode_hash(inode_set *s, uint64_t dev, uint64_t ino) {
+    pthread_mutex_lock(&s->lock);
+    inode_entry *e = inode_find(s, dev, ino);
+    unsigned long long hash = e->state == INODE_HASHED ? e->hash : 0;
+    pthread_mutex_unlock(&s->lock);
+    return hash;
+}
+
+/**
+ * inode_park: Keeps a link for inode_flush(). Returns -1 out of memory.
+ */
+static int inode_park(inode_set *s, const char *path, const struct stat *st) {
+    if (s->nparked == s->parked_cap) {
+        size_t cap = s->parked_cap ? s->parked_cap * 2 : 64;
+        inode_link *l = realloc(s->parked, cap * sizeof(inode_link));
+        if (!l) return -1;
+        s->parked = l;
+        s->parked_cap = cap;
+    }
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    s->parked[s->nparked].path = copy;
+    s->parked[s->nparked].st = *st;
+    s->nparked++;
+    return 0;
+}
+
+void inode_free(inode_set *s) {
+    if (!s) return;
+    for (size_t i = 0; i < s->nparked; i++) free(s->parked[i].path);
+    free(s->parked);
+    free(s->slots);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+/**
+ * pool_emit: Prints one finished job and updates the counters.
+ * Only the writer thread calls this (or pool_emit_now() while the writer is idle),
+ * so neither needs the pool lock.
+ */
+static void pool_emit(hash_pool *p, hash_job *job) {
+    if (job->link == INODE_LINK) {
+        job->hash = inode_hash(inode_index, job->dev, job->ino);   // Emitted before this job, or in flight when unordered
+        if (job->hash != 0) {
+            inode_index->links++;
+        } else {
+            // The first link failed; try this one, as inode_flush() does
+            struct stat hst;
+            job->hash = hash_with_cache(p->cache, job->path, &job->st, &hst);
+            job->st = hst;
+            job->size = job->hash != 0 ? (unsigned long long)hst.st_size : 0;
+        }
+    } else if (job->link == INODE_FIRST) {
+        inode_publish(inode_index, job->dev, job->ino, job->hash);
+    }
+    (*p->total)++;
+    progress_done(job->hash != 0 ? job->size : 0);
+    if (job->hash != 0) {
+        (*p->succeeded)++;
+        *p->total_sz += job->size;
+        emit_result(job->hash, &job->st, job->path);
+    } else if (verify_index) {
+        verify_emit(verify_index, 0, job->path);
+    }
+}
+
+/**
+ * pool_retire: Marks a job finished and wakes the writer. Caller holds p->lock.
+ */
+static void pool_retire(hash_pool *p, hash_job *job) {
+    job->state = JOB_DONE;
+    pthread_cond_signal(&p->can_emit);
+}
+
+/**
+ * pool_tune: Hill-climbs the number of active workers for --remote. Keeps
+ * adding workers while each step raises throughput by ADAPT_GAIN, steps back
+ * when one does not, and probes upward again after ADAPT_PROBE_WINDOWS.
+ * Called by the writer with p->lock held.
+ */
+static void pool_tune(hash_pool *p, int emitted) {
+    pool_tuner *t = &p->tuner;
+    uint64_t now = stats_now();
+    t->window_files += (uint64_t)emitted;
+    if (t->window_start == 0) { t->window_start = now; return; }
+    uint64_t elapsed = now - t->window_start;
+    if (elapsed < ADAPT_WINDOW_MS * 1000000ULL || t->window_files < ADAPT_MIN_FILES) return;
+
+    double rate = (double)t->window_files * 1e9 / (double)elapsed;
+    t->window_start = now;
+    t->window_files = 0;
+    int step = p->active / 2 > 1 ? p->active / 2 : 1;
+    int before = p->active;
+
+    if (p->active > t->best_active) {
+        if (rate > t->best_rate * ADAPT_GAIN) {
+            t->best_rate = rate;
+            t->best_active = p->active;
+            p->active += step;
+        } else {
+            p->active = t->best_active;
+            t->settled = 0;
+        }
+    } else {
+        t->best_rate = rate;   // Track drift at the current level
+        if (++t->settled >= ADAPT_PROBE_WINDOWS) {
+            p->active += step;
+            t->settled = 0;
+        }
+    }
+    if (p->active > p->max_active) p->active = p->max_active;
+    if (p->active > before) pthread_cond_broadcast(&p->can_activate);
+}
+
+/**
+ * pool_writer: The single output consumer. Collects finished jobs from the
+ * tail (only the consecutive ones unless unordered), writes them without the
+ * lock, then releases their slots.
+ */
+static void *pool_writer(void *arg) {
+    hash_pool *p = arg;
+    hash_job *batch[WRITER_BATCH];
+    gh_stats *sx = stats_thread("writer");
+    progress_thread();
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        int n = 0;
+        for (unsigned long long seq = p->tail; seq < p->head && n < WRITER_BATCH; seq++) {
+            hash_job *job = &p->slots[seq % p->capacity];
+            if (job->state == JOB_DONE) {
+                job->state = JOB_EMITTED;
+                batch[n++] = job;
+            } else if (job->state != JOB_EMITTED && !p->unordered) {
+                break;
+            }
+        }
+        if (n == 0) {
+            if (p->workers_done && p->tail == p->head) break;
+            // Idle: don't let results sit in the stdio buffers while input trickles in
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += OUT_FLUSH_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            if (pthread_cond_timedwait(&p->can_emit, &p->lock, &deadline) == ETIMEDOUT) {
+                pthread_mutex_unlock(&p->lock);
+                out_flush();
+                pthread_mutex_lock(&p->lock);
+            }
+            continue;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        uint64_t mark = sx ? stats_now() : 0;
+        flockfile(stdout);
+        if (log_fp) flockfile(log_fp);
+        for (int i = 0; i < n; i++) pool_emit(p, batch[i]);
+        out_tick();
+        if (log_fp) funlockfile(log_fp);
+        funlockfile(stdout);
+        stats_lap(sx, PHASE_OUTPUT, &mark);
+
+        pthread_mutex_lock(&p->lock);
+        if (p->adaptive) pool_tune(p, n);
+        int freed = 0;
+        while (p->tail < p->head) {
+            hash_job *t = &p->slots[p->tail % p->capacity];
+            if (t->state != JOB_EMITTED) break;
+            t->state = JOB_FREE;
+            p->tail++;
+            freed = 1;
+        }
+        if (p->next < p->tail) p->next = p->tail;
+        if (freed) pthread_cond_broadcast(&p->can_push);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/**
+ * pool_idle_wait: Blocks an idle worker. Active workers wait for jobs, parked
+ * ones for activation; a worker parked while waiting forwards its wakeup so
+ * the job that caused it is not stranded. Caller holds p->lock.
+ */
+static void pool_idle_wait(hash_pool *p, int id) {
+    int was_active = id < p->active;
+    pthread_cond_wait(was_active ? &p->can_claim : &p->can_activate, &p->lock);
+    if (was_active && id >= p->active) pthread_cond_signal(&p->can_claim);
+}
+
+/**
+ * pool_claim: Returns the oldest job still waiting for a worker, or NULL.
+ * Caller holds p->lock.
+ */
+static hash_job *pool_claim(hash_pool *p) {
+    while (p->next < p->head) {
+        hash_job *job = &p->slots[p->next % p->capacity];
+        p->next++;
+        if (job->state == JOB_QUEUED) {
+            job->state = JOB_CLAIMED;
+            return job;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * job_hash_sync: Hashes a claimed job with blocking I/O and feeds the cache.
+ */
+static void job_hash_sync(hash_pool *p, hash_job *job) {
+    job->size = 0;
+    job->hash = hash_path_stat(job->path, &job->st);
+    if (job->hash != 0) {
+        job->size = (unsigned long long)job->st.st_size;
+        if (p->cache) cache_store(p->cache, &job->st, job->hash);
+    }
+}
+
+/* ================= IO_URING ENGINE ================= */
+
+typedef struct {
+    int fd;
+    unsigned sq_entries;
+    unsigned sq_local_tail;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_sz, cq_map_sz, sqes_sz;
+    unsigned outstanding;   // Submitted SQEs whose CQE has not been reaped
+} gh_uring;
+
+enum { UOP_OPEN, UOP_STATX, UOP_READ, UOP_CLOSE = UOP_READ + GH_SAMPLE_MAX };
+#define UDATA(slot, op) (((unsigned long long)(slot) << 5) | (unsigned long long)(op))
+
+static void uring_free(gh_uring *r) {
+    if (r->sqes) munmap(r->sqes, r->sqes_sz);
+    if (r->cq_map && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_sz);
+    if (r->sq_map) munmap(r->sq_map, r->sq_map_sz);
+    close(r->fd);
+}
+
+static int uring_init(gh_uring *r, unsigned entries) {
+    struct io_uring_params prm;
+    memset(r, 0, sizeof(*r));
+    memset(&prm, 0, sizeof(prm));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &prm);
+    if (r->fd < 0) return -1;
+
+    r->sq_map_sz = prm.sq_off.array + prm.sq_entries * sizeof(unsigned);
+    r->cq_map_sz = prm.cq_off.cqes + prm.cq_entries * sizeof(struct io_uring_cqe);
+    if (prm.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_sz > r->sq_map_sz) r->sq_map_sz = r->cq_map_sz;
+        r->cq_map_sz = r->sq_map_sz;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) { r->sq_map = NULL; uring_free(r); return -1; }
+    if (prm.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_map = r->sq_map;
+    } else {
+        r->cq_map = mmap(NULL, r->cq_map_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) { r->cq_map = NULL; uring_free(r); return -1; }
+    }
+    r->sqes_sz = prm.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) { r->sqes = NULL; uring_free(r); return -1; }
+
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_entries = prm.sq_entries;
+    r->sq_head = (unsigned *)(sq + prm.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + prm.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + prm.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + prm.sq_off.array);
+    r->cq_head = (unsigned *)(cq + prm.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + prm.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + prm.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + prm.cq_off.cqes);
+    r->sq_local_tail = *r->sq_tail;
+    return 0;
+}
+
+/**
+ * uring_enter: Hands every queued SQE to the kernel and optionally waits for
+ * at least min_complete completions.
+ */
+static int uring_enter(gh_uring *r, unsigned min_complete) {
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+    for (;;) {
+        unsigned pending = r->sq_local_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        if (pending == 0 && min_complete == 0) return 0;
+        unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+        long ret = syscall(__NR_io_uring_enter, r->fd, pending, min_complete, flags, NULL, 0);
+        if (ret >= 0) return 0;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EBUSY) return 0;  // Caller reaps, then retries
+        return -1;
+    }
+}
+
+/* Makes sure n SQEs are free, submitting the queued ones if needed. Returns -1 if they are not. */
+static int uring_reserve(gh_uring *r, unsigned n) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->sq_entries - (r->sq_local_tail - head) >= n) return 0;
+    uring_enter(r, 0);
+    head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    return r->sq_entries - (r->sq_local_tail - head) >= n ? 0 : -1;
+}
+
+static struct io_uring_sqe *uring_get_sqe(gh_uring *r) {
+    if (uring_reserve(r, 1) != 0) return NULL;
+    unsigned idx = r->sq_local_tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[idx] = idx;
+    r->sq_local_tail++;
+    r->outstanding++;
+    return sqe;
+}
+
+/**
+ * uring_supported: Probes once for a working ring with every opcode the engine uses.
+ */
+int uring_supported(void) {
+    gh_uring r;
+    if (uring_init(&r, 4) != 0) return 0;
+
+    int ok = 0;
+    size_t probe_sz = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_sz);
+    if (probe && syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        const int needed[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE };
+        ok = 1;
+        for (size_t i = 0; i < sizeof(needed) / sizeof(needed[0]); i++) {
+            if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) ok = 0;
+        }
+    }
+    free(probe);
+    uring_free(&r);
+    return ok;
+}
+
+/* Per-file state while its operations are in flight */
+typedef struct {
+    hash_job *job;
+    int pending;                 // CQEs still expected for the current phase
+    int opening;                 // 1 while openat/statx are outstanding
+    int fd;
+    int stat_res;
+    int nsamples;
+    int got[GH_SAMPLE_MAX];
+    int skip[GH_SAMPLE_MAX];        // Sample start inside an O_DIRECT-aligned read
+    unsigned align;              // O_DIRECT alignment, 0 for page cache reads
+    struct statx stx;
+    unsigned char *buf;          // uring_samples() * GH_SAMPLE_BUF_SIZE, GH_DIO_ALIGN_MAX aligned
+    uint64_t started;            // stats_now() at submission, only with --stats
+} uring_slot;
+
+/**
+ * uring_queue_open: Queues the openat and statx of a slot's job, both or
+ * neither: a lone openat would complete into a slot that has moved on.
+ */
+static int uring_queue_open(gh_uring *r, uring_slot *s, unsigned idx) {
+    if (uring_reserve(r, 2) != 0) return -1;
+    struct io_uring_sqe *sqe = uring_get_sqe(r);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long long)(uintptr_t)s->job->path;
+    sqe->open_flags = O_RDONLY | O_NOATIME | (hash_opts.pagecache == GH_PAGECACHE_DIRECT ? O_DIRECT : 0);
+    sqe->user_data = UDATA(idx, UOP_OPEN);
+
+    sqe = uring_get_sqe(r);
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long long)(uintptr_t)s->job->path;
+    sqe->len = STATX_SIZE | STATX_INO | STATX_MTIME | (hash_opts.pagecache == GH_PAGECACHE_DIRECT ? STATX_DIOALIGN : 0);
+    sqe->off = (unsigned long long)(uintptr_t)&s->stx;
+    sqe->user_data = UDATA(idx, UOP_STATX);
+
+    s->fd = -1;
+    s->stat_res = 0;
+    s->opening = 1;
+    s->pending = 2;
+    if (thread_stats) s->started = stats_now();
+    return 0;
+}
+
+static void uring_queue_close(gh_uring *r, int fd) {
+    struct io_uring_sqe *sqe = uring_get_sqe(r);
+    if (!sqe) { close(fd); return; }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = UDATA(0, UOP_CLOSE);
+}
+
+/**
+ * uring_advance: Moves a slot to its next phase once the current one has
+ * completed. Returns 1 when the job is finished.
+ */
+static int uring_advance(gh_uring *r, uring_slot *s, unsigned idx) {
+    hash_job *job = s->job;
+    gh_stats *sx = thread_stats;
+    if (s->opening) {
+        s->opening = 0;
+        if (s->fd == -EINVAL && s->stat_res >= 0 && hash_opts.pagecache == GH_PAGECACHE_DIRECT) {
+            // The filesystem refuses O_DIRECT; the blocking path falls back to dropping pages
+            job->hash = hash_path_stat(job->path, &job->st);
+            if (job->hash != 0) job->size = (unsigned long long)job->st.st_size;
+            return 1;
+        }
+        if (s->fd < 0 || s->stat_res < 0) {
+            if (s->fd >= 0) uring_queue_close(r, s->fd);
+            if (sx) sx->failures++;
+            job->hash = 0;
+            return 1;
+        }
+        job->size = (unsigned long long)s->stx.stx_size;
+        memset(&job->st, 0, sizeof(job->st));
+        job->st.st_dev = makedev(s->stx.stx_dev_major, s->stx.stx_dev_minor);
+        job->st.st_ino = (ino_t)s->stx.stx_ino;
+        job->st.st_size = (off_t)s->stx.stx_size;
+        job->st.st_mtim.tv_sec = s->stx.stx_mtime.tv_sec;
+        job->st.st_mtim.tv_nsec = s->stx.stx_mtime.tv_nsec;
+
+        int64_t offsets[GH_SAMPLE_MAX];
+        s->nsamples = gh_sample_layout(hash_opts.layout, job->size, offsets);
+        s->align = 0;
+        if (hash_opts.pagecache == GH_PAGECACHE_DIRECT) {
+            s->align = gh_dio_alignment(&s->stx);
+            if (!s->align) fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL) & ~O_DIRECT);
+        }
+        // The reads below are already concurrent; only readahead needs turning off
+        if ((hash_opts.flags & GH_REMOTE) || (hash_opts.pagecache != GH_PAGECACHE_KEEP && !s->align)) posix_fadvise(s->fd, 0, 0, POSIX_FADV_RANDOM);
+        for (int i = 0; i < s->nsamples; i++) {
+            unsigned char *buf = s->buf + (size_t)i * GH_SAMPLE_BUF_SIZE;
+            int64_t off = offsets[i];
+            size_t len = GH_CHUNK_SIZE, skip = 0;
+            if (s->align) len = gh_dio_window(offsets[i], s->align, &off, &skip);
+            s->skip[i] = (int)skip;
+            struct io_uring_sqe *sqe = uring_get_sqe(r);
+            if (!sqe) {
+                // Could not queue the read: fall back to a blocking one
+                s->got[i] = (int)pread(s->fd, buf, len, (off_t)off);
+                continue;
+            }
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = s->fd;
+            sqe->addr = (unsigned long long)(uintptr_t)buf;
+            sqe->len = (unsigned)len;
+            sqe->off = (unsigned long long)off;
+            if (hash_opts.pagecache != GH_PAGECACHE_KEEP && !s->align) sqe->rw_flags = RWF_DONTCACHE;
+            sqe->user_data = UDATA(idx, UOP_READ + i);
+            s->pending++;
+        }
+        if (s->pending > 0) return 0;
+    }
+
+    if (hash_opts.pagecache != GH_PAGECACHE_KEEP && !s->align) {
+        // RWF_DONTCACHE is not supported here: read again and drop the pages afterwards
+        int64_t offsets[GH_SAMPLE_MAX];
+        int no_dontcache = 1;
+        gh_sample_layout(hash_opts.layout, job->size, offsets);
+        for (int i = 0; i < s->nsamples; i++) {
+            if (s->got[i] == -EOPNOTSUPP) s->got[i] = (int)gh_pread_uncached(s->fd, s->buf + (size_t)i * GH_SAMPLE_BUF_SIZE, offsets[i], &no_dontcache);
+        }
+    }
+
+    uint64_t mark = sx ? stats_now() : 0;
+    unsigned long long hash = hash_opts.algo->seed(job->size);
+    for (int i = 0; i < s->nsamples; i++) {
+        ssize_t n = gh_dio_trim(s->got[i], (size_t)s->skip[i]);
+        if (n > 0) hash = hash_opts.algo->update(hash, s->buf + (size_t)i * GH_SAMPLE_BUF_SIZE + s->skip[i], (size_t)n);
+    }
+    uring_queue_close(r, s->fd);
+    job->hash = hash;
+    if (sx) {
+        stats_lap(sx, PHASE_HASH, &mark);
+        for (int i = 0; i < s->nsamples; i++) {
+            if (s->got[i] > 0) sx->bytes_read += (uint64_t)s->got[i];
+            else if (s->got[i] < 0) sx->failures++;
+        }
+        sx->opens++;
+        sx->reads += (uint64_t)s->nsamples;
+        stats_latency(sx, mark - s->started);
+    }
+    return 1;
+}
+
+/* Most samples one file of this run can take, which sizes the per-slot buffers. */
+static int uring_samples(void) {
+    return hash_opts.layout == GH_LAYOUT_V2 ? GH_SAMPLE_MAX : GH_SAMPLE_COUNT;
+}
+
+/**
+ * pool_uring_loop: Keeps up to io_depth files in flight on one ring and
+ * retires them in batches under the pool lock.
+ */
+static int pool_uring_loop(hash_pool *p, gh_uring *r, int id) {
+    int depth = p->io_depth;
+    uring_slot *slots = calloc((size_t)depth, sizeof(uring_slot));
+    unsigned char *bufs = NULL;
+    if (posix_memalign((void **)&bufs, GH_DIO_ALIGN_MAX, (size_t)depth * uring_samples() * GH_SAMPLE_BUF_SIZE) != 0) bufs = NULL;
+    hash_job **finished = calloc((size_t)depth, sizeof(hash_job *));
+    int *free_list = calloc((size_t)depth, sizeof(int));
+    int *claimed = calloc((size_t)depth, sizeof(int));
+    if (!slots || !bufs || !finished || !free_list || !claimed) {
+        free(slots); free(bufs); free(finished); free(free_list); free(claimed);
+        return -1;
+    }
+    for (int i = 0; i < depth; i++) {
+        slots[i].buf = bufs + (size_t)i * uring_samples() * GH_SAMPLE_BUF_SIZE;
+        free_list[i] = depth - 1 - i;
+    }
+    int nfree = depth, nfinished = 0;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        for (int i = 0; i < nfinished; i++) pool_retire(p, finished[i]);
+        nfinished = 0;
+
+        int nclaimed = 0;
+        hash_job *job;
+        while (nfree > 0 && id < p->active && (job = pool_claim(p)) != NULL) {
+            int idx = free_list[--nfree];
+            slots[idx].job = job;
+            claimed[nclaimed++] = idx;
+        }
+        if (nclaimed == 0 && nfree == depth) {
+            if (p->closing) break;
+            pool_idle_wait(p, id);
+            continue;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        for (int k = 0; k < nclaimed; k++) {
+            int idx = claimed[k];
+            slots[idx].job->size = 0;
+            if (uring_queue_open(r, &slots[idx], (unsigned)idx) != 0) {
+                job_hash_sync(p, slots[idx].job);
+                finished[nfinished++] = slots[idx].job;
+                slots[idx].job = NULL;
+                free_list[nfree++] = idx;
+            }
+        }
+
+        gh_stats *sx = thread_stats;
+        uint64_t mark = sx ? stats_now() : 0;
+        int enter_rc = uring_enter(r, depth - nfree > 0 ? 1 : 0);
+        stats_lap(sx, PHASE_READ, &mark);  // Time waiting on the ring: opens and reads together
+        if (enter_rc != 0) {
+            fprintf(stderr, C_RED "Error:" C_RESET " io_uring_enter failed (%s), switching to blocking I/O.\n", strerror(errno));
+            // Reads may still land in bufs, so it is deliberately leaked here
+            for (int i = 0; i < depth; i++) {
+                if (!slots[i].job) continue;
+                job_hash_sync(p, slots[i].job);
+                finished[nfinished++] = slots[i].job;
+            }
+            pthread_mutex_lock(&p->lock);
+            for (int i = 0; i < nfinished; i++) pool_retire(p, finished[i]);
+            pthread_mutex_unlock(&p->lock);
+            free(slots); free(finished); free(free_list); free(claimed);
+            return -1;
+        }
+
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            unsigned idx = (unsigned)(cqe->user_data >> 5);
+            int op = (int)(cqe->user_data & 0x1f);
+            int res = cqe->res;
+            r->outstanding--;
+            if (op == UOP_CLOSE) continue;
+
+            uring_slot *s = &slots[idx];
+            if (op == UOP_OPEN) s->fd = res;
+            else if (op == UOP_STATX) s->stat_res = res;
+            else s->got[op - UOP_READ] = res;
+
+            if (--s->pending == 0 && uring_advance(r, s, idx)) {
+                if (s->job->hash != 0 && p->cache) cache_store(p->cache, &s->job->st, s->job->hash);
+                finished[nfinished++] = s->job;
+                s->job = NULL;
+                free_list[nfree++] = (int)idx;
+            }
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    // Let the trailing closes finish before the ring goes away
+    while (r->outstanding > 0 && uring_enter(r, 1) == 0) {
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        r->outstanding -= tail - head;
+        __atomic_store_n(r->cq_head, tail, __ATOMIC_RELEASE);
+    }
+
+    free(slots);
+    free(bufs);
+    free(finished);
+    free(free_list);
+    free(claimed);
+    return 0;
+}
+
+static void *pool_worker(void *arg) {
+    hash_pool *p = arg;
+    stats_thread("hash");
+    pthread_mutex_lock(&p->lock);
+    int id = p->worker_ids++;   // Workers with id >= p->active sit out while --remote tunes
+    pthread_mutex_unlock(&p->lock);
+
+    if (p->io_mode == IO_URING) {
+        gh_uring r;
+        if (uring_init(&r, (unsigned)p->io_depth * 4) == 0) {
+            int rc = pool_uring_loop(p, &r, id);
+            uring_free(&r);
+            if (rc == 0) return NULL;
+        }
+    }
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        hash_job *job = id < p->active ? pool_claim(p) : NULL;
+        if (!job) {
+            if (p->closing) break;
+            pool_idle_wait(p, id);
+            continue;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        job_hash_sync(p, job);
+
+        pthread_mutex_lock(&p->lock);
+        pool_retire(p, job);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/**
+ * pool_start: Spawns nthreads hashing workers. Returns 0 on success.
+ */
+int pool_start(hash_pool *p, int nthreads, int unordered, int io_mode, int io_depth, fp_cache *cache, int adaptive,
+               int *succeeded, int *total, unsigned long long *total_sz) {
+    memset(p, 0, sizeof(*p));
+    p->capacity = (size_t)nthreads * QUEUE_SLOTS_PER_JOB;
+    if (io_mode == IO_URING) p->capacity = (size_t)nthreads * (size_t)io_depth * 2;
+    p->slots = calloc(p->capacity, sizeof(hash_job));
+    p->threads = calloc((size_t)nthreads, sizeof(pthread_t));
+    if (!p->slots || !p->threads) {
+        free(p->slots);
+        free(p->threads);
+        return -1;
+    }
+    p->unordered = unordered;
+    p->max_active = nthreads;
+    p->adaptive = adaptive;
+    p->active = adaptive && nthreads > ADAPT_START ? ADAPT_START : nthreads;
+    p->io_mode = io_mode;
+    p->io_depth = io_depth;
+    p->cache = cache;
+    p->succeeded = succeeded;
+    p->total = total;
+    p->total_sz = total_sz;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->can_push, NULL);
+    pthread_cond_init(&p->can_claim, NULL);
+    pthread_cond_init(&p->can_emit, NULL);
+    pthread_cond_init(&p->can_activate, NULL);
+
+    if (pthread_create(&p->writer, NULL, pool_writer, p) != 0) {
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->can_push);
+        pthread_cond_destroy(&p->can_claim);
+        pthread_cond_destroy(&p->can_emit);
+        pthread_cond_destroy(&p->can_activate);
+        free(p->slots);
+        free(p->threads);
+        return -1;
+    }
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&p->threads[i], NULL, pool_worker, p) != 0) break;
+        p->nthreads++;
+    }
+    if (p->nthreads == 0) {
+        pool_finish(p);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * pool_emit_now: Emits a file that could not be queued, in order: waits until
+ * everything queued before it was emitted, then emits it directly. A hard
+ * link or cache hit still gets its result; anything else is reported and
+ * emitted as failed (hash 0), so totals, --verify and later links see it.
+ * Caller holds p->lock, which keeps the idle writer from running meanwhile.
+ */
+static void pool_emit_now(hash_pool *p, const char *path, const struct stat *st, int link, int hit,
+                          unsigned long long cached) {
+    if (!hit) fprintf(stderr, C_RED "Error:" C_RESET " Out of memory, cannot queue " C_YELLOW "'%s'" C_RESET "\n", path);
+    while (p->tail != p->head) pthread_cond_wait(&p->can_push, &p->lock);
+    hash_job job = { .path = (char *)path, .hash = hit ? cached : 0, .link = link };
+    if (st) {
+        job.st = *st;
+        job.size = (unsigned long long)st->st_size;
+        job.dev = (uint64_t)st->st_dev;
+        job.ino = (uint64_t)st->st_ino;
+    }
+    flockfile(stdout);
+    if (log_fp) flockfile(log_fp);
+    pool_emit(p, &job);
+    if (log_fp) funlockfile(log_fp);
+    funlockfile(stdout);
+}
+
+/**
+ * pool_submit: Queues a path for hashing, blocking while the ring is full.
+ * If st is given and the cache already knows the file, the job is completed
+ * on the spot and never reaches a worker. So is a hard link (link ==
+ * INODE_LINK, st given), which the writer gives the result of the link
+ * queued before it.
+ */
+void pool_submit(hash_pool *p, const char *path, const struct stat *st, int link) {
+    size_t len = strlen(path) + 1;
+    unsigned long long cached = 0;
+    int hit = link == INODE_LINK || (p->cache && st && cache_lookup(p->cache, st, &cached));
+
+    pthread_mutex_lock(&p->lock);
+    while (p->head - p->tail == p->capacity) pthread_cond_wait(&p->can_push, &p->lock);
+    hash_job *job = &p->slots[p->head % p->capacity];
+    if (len > job->path_cap) {
+        // Slots keep their buffer, so this only happens until each has seen a long path
+        size_t cap = len < 256 ? 256 : len * 2;
+        char *buf = realloc(job->path, cap);
+        if (!buf) {
+            pool_emit_now(p, path, st, link, hit, cached);
+            pthread_mutex_unlock(&p->lock);
+            return;
+        }
+        job->path = buf;
+        job->path_cap = cap;
+    }
+    memcpy(job->path, path, len);
+    job->link = link;
+    if (st) {
+        job->dev = (uint64_t)st->st_dev;
+        job->ino = (uint64_t)st->st_ino;
+    }
+    p->head++;
+    if (hit) {
+        job->hash = cached;
+        job->size = (unsigned long long)st->st_size;
+        job->st = *st;
+        pool_retire(p, job);
+    } else {
+        job->state = JOB_QUEUED;
+        pthread_cond_signal(&p->can_claim);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ * pool_finish: Drains the queue, joins the workers and releases the ring.
+ */
+void pool_finish(hash_pool *p) {
+    pthread_mutex_lock(&p->lock);
+    p->closing = 1;
+    pthread_cond_broadcast(&p->can_claim);
+    pthread_cond_broadcast(&p->can_activate);
+    pthread_mutex_unlock(&p->lock);
+
+    for (int i = 0; i < p->nthreads; i++) pthread_join(p->threads[i], NULL);
+
+    pthread_mutex_lock(&p->lock);
+    p->workers_done = 1;
+    pthread_cond_signal(&p->can_emit);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->writer, NULL);
+
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->can_push);
+    pthread_cond_destroy(&p->can_claim);
+    pthread_cond_destroy(&p->can_emit);
+    pthread_cond_destroy(&p->can_activate);
+    for (size_t i = 0; i < p->capacity; i++) free(p->slots[i].path);
+    free(p->slots);
+    free(p->threads);
+}
+
+/**
+ * hash_with_cache: Returns the cached hash when st still matches, otherwise
+ * hashes the file and records the result. *out_st receives the size and
+ * identity of the file the hash belongs to.
+ */
+unsigned long long hash_with_cache(fp_cache *cache, const char *path, const struct stat *st, struct stat *out_st) {
+    unsigned long long h;
+    if (cache && st && cache_lookup(cache, st, &h)) {
+        *out_st = *st;
+        return h;
+    }
+    h = hash_path_stat(path, out_st);
+    if (h != 0 && cache) cache_store(cache, out_st, h);
+    return h;
+}
+
+/**
+ * scan_file: Entry point for every regular file a walker finds. Drops files
+ * of other shards, then parks it in the size prefilter when one is active,
+ * otherwise hashes it. st may be NULL when the walker did not need to stat
+ * the file.
+ */
+void scan_file(scan_ctx *ctx, const char *path, const struct stat *st) {
+    if (!shard_keeps(ctx, path)) return;
+    if (ctx->sizes) {
+        struct stat fst;
+        if (!st) {
+            if (stat(path, &fst) != 0) return;
+            st = &fst;
+        }
+        if (dupe_add(ctx->sizes, 0, (unsigned long long)st->st_size, path, st) == 0) return;
+        // Out of memory: fall back to hashing this one straight away
+    }
+    scan_hash(ctx, path, st);
+}
+
+/**
+ * shard_keeps: 1 if path belongs to this --shard. Files are assigned by a
+ * hash of their path relative to the scan root (the file name for a root
+ * that is a file), so every node agrees whatever its mount point is called,
+ * and a file only changes shards when it is renamed.
+ */
+int shard_keeps(const scan_ctx *ctx, const char *path) {
+    if (ctx->shards <= 1) return 1;
+    const char *rel = path + ctx->root_len;
+    while (*rel == '/') rel++;
+    if (*rel == '\0') {
+        const char *slash = strrchr(path, '/');
+        rel = slash ? slash + 1 : path;
+    }
+    // FNV-1a, then a finalizer so the low bits depend on every byte
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const unsigned char *p = (const unsigned char *)rel; *p; p++) h = (h ^ *p) * 0x100000001b3ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h % ctx->shards == ctx->shard;
+}
+
+static void size_filter_group(dupe_table *t, dupe_group *g, void *arg) {
+    scan_ctx *ctx = arg;
+    if (g->count < 2 || (inode_index && dupe_one_inode(t, g))) {
+        ctx->size_skipped += g->count;   // Hard links of one file share their size with nothing else
+        return;
+    }
+    for (size_t m = g->first; m != SIZE_MAX; m = t->members[m].next) {
+        scan_hash(ctx, t->members[m].path, &t->stats[m]);
+    }
+}
+
+/**
+ * size_filter_flush: Hashes every file whose size is shared with at least one
+ * other file, and counts the rest as skipped. A spilled prefilter replays its
+ * runs in size order.
+ */
+void size_filter_flush(scan_ctx *ctx) {
+    dupe_table *t = ctx->sizes;
+    if (!t) return;
+    ctx->sizes = NULL;
+
+    if (t->spill) {
+        if (spill_groups(t->spill, 1, size_filter_group, ctx) != 0) {
+            fprintf(stderr, C_RED "Error:" C_RESET " The size prefilter could not read its spill file back; some files were not hashed.\n");
+        }
+    } else {
+        for (size_t gi = 0; gi < t->ngroups; gi++) size_filter_group(t, &t->groups[gi], ctx);
+    }
+    dupe_free(t);
+}
+
+/**
+ * scan_link: Looks a file up in inode_index before it is hashed. Returns
+ * INODE_FIRST for the first link of an inode, INODE_LINK when the pool is to
+ * hand this path the first link's result, INODE_NONE when it has to be
+ * hashed after all (the first link failed), and -1 when it was published
+ * (or parked) here without being opened.
+ */
+static int scan_link(scan_ctx *ctx, const char *path, const struct stat *st) {
+    inode_set *s = inode_index;
+    unsigned long long h = 0;
+    int state = inode_add(s, st, INODE_PENDING, &h);
+    if (state == INODE_EMPTY) return INODE_FIRST;
+    if (state != INODE_PENDING && state != INODE_HASHED) return INODE_NONE;
+
+    if (ctx->pool) {
+        // Unordered, the writer may get here before the first link is hashed
+        if (state == INODE_HASHED || !ctx->pool->unordered) return INODE_LINK;   // pool_emit() counts it
+        if (inode_park(s, path, st) != 0) return INODE_NONE;
+        return -1;
+    }
+    // Queued files come out first, so the output order stays the walk order
+    elevator_flush(ctx);
+    prefetch_flush(ctx);
+    if (state == INODE_PENDING && (h = inode_hash(s, (uint64_t)st->st_dev, (uint64_t)st->st_ino)) == 0) return INODE_NONE;
+    s->links++;
+    scan_emit(ctx, h, st, path);
+    return -1;
+}
+
+/**
+ * inode_flush: Emits the links inode_park() held back, once the pool is done.
+ */
+void inode_flush(scan_ctx *ctx) {
+    inode_set *s = inode_index;
+    if (!s) return;
+    for (size_t i = 0; i < s->nparked; i++) {
+        inode_link *l = &s->parked[i];
+        unsigned long long h = inode_hash(s, (uint64_t)l->st.st_dev, (uint64_t)l->st.st_ino);
+        struct stat hst = l->st;
+        if (h != 0) s->links++;
+        else h = hash_with_cache(ctx->cache, l->path, &l->st, &hst);   // The first link failed; try this one
+        scan_emit(ctx, h, &hst, l->path);
+        free(l->path);
+    }
+    s->nparked = 0;
+}
+
+/**
+ * scan_hash: Hands one file to the elevator, the prefetcher or the pool, or
+ * hashes it inline. A later link of an inode already queued is not opened.
+ */
+void scan_hash(scan_ctx *ctx, const char *path, const struct stat *st) {
+    if (thread_progress) progress_add(&thread_progress->queued, 1);
+    int link = INODE_NONE;
+    if (inode_index && st && (st->st_nlink > 1 || ctx->follow) && (link = scan_link(ctx, path, st)) < 0) return;
+    if (ctx->elev) {
+        elevator_add(ctx, path, st);
+        return;
+    }
+    if (ctx->prefetch) {
+        prefetch_add(ctx, path, st);
+        return;
+    }
+    if (ctx->pool) {
+        pool_submit(ctx->pool, path, st, link);
+        return;
+    }
+    struct stat hst;
+    unsigned long long h = hash_with_cache(ctx->cache, path, st, &hst);
+    if (link == INODE_FIRST) inode_publish(inode_index, (uint64_t)st->st_dev, (uint64_t)st->st_ino, h);
+    scan_emit(ctx, h, &hst, path);
+}
+
+/**
+ * scan_emit: Counts one file hashed on this thread and publishes its result
+ * (h == 0 for a failure).
+ */
+void scan_emit(scan_ctx *ctx, unsigned long long h, const struct stat *st, const char *path) {
+    (*ctx->total)++;
+    progress_done(h != 0 ? (uint64_t)st->st_size : 0);
+    if (h != 0 && inode_index && (ctx->elev || ctx->prefetch)) {
+        inode_publish(inode_index, (uint64_t)st->st_dev, (uint64_t)st->st_ino, h);   // For scan_link() after a flush
+    }
+    if (h != 0) {
+        gh_stats *sx = thread_stats;
+        uint64_t mark = sx ? stats_now() : 0;
+        (*ctx->succeeded)++;
+        *ctx->total_sz += (unsigned long long)st->st_size;
+        emit_result(h, st, path);
+        out_tick();
+        stats_lap(sx, PHASE_OUTPUT, &mark);
+    } else if (verify_index) {
+        verify_emit(verify_index, 0, path);
+    }
+}
+
+static int scan_visit(const char *path, const struct stat *st, void *arg) {
+    scan_ctx *ctx = arg;
+    gh_stats *sx = thread_stats;
+    stats_lap(sx, PHASE_WALK, &ctx->walk_mark);   // lstat and readdir since the last visit
+    if (S_ISDIR(st->st_mode)) {
+        if (ctx->follow && inode_index && inode_add(inode_index, st, INODE_DIR, NULL) == INODE_DIR) {
+            inode_index->dirs++;   // Reached again through a symlink
+            if (sx) ctx->walk_mark = stats_now();
+            return GH_WALK_SKIP;
+        }
+        if (sx) sx->dirs++;
+    } else {
+        if (thread_progress) progress_add(&thread_progress->found, 1);
+        scan_file(ctx, path, st);   // Already matched against ext_filter by the walker
+    }
+    if (sx) ctx->walk_mark = stats_now();
+    return GH_WALK_CONTINUE;
+}
+
+/**
+ * process_path_recursive: Performs hash on other directories recursively,
+ * using the library walker. Names are filtered before they are stat'ed.
+ */
+void process_path_recursive(const char *path, scan_ctx *ctx) {
+    ctx->root_len = strlen(path);
+    if (thread_stats) ctx->walk_mark = stats_now();
+    const gh_ext_set *exts = ctx->ignore_ext ? NULL : &ext_filter;
+    if (ctx->follow) gh_walk_follow(path, exts, scan_visit, ctx);
+    else gh_walk_ext(path, exts, scan_visit, ctx);
+    stats_lap(thread_stats, PHASE_WALK, &ctx->walk_mark);
+}
+
+/* ================= ELEVATOR ================= */
+
+struct elevator {
+    elevator_file *files;
+    size_t count;
+    elevator_read *reads;
+    unsigned char *arena;  // Sample buffers of the current window
+    size_t arena_cap;
+};
+
+elevator *elevator_new(void) {
+    elevator *e = calloc(1, sizeof(elevator));
+    if (!e) return NULL;
+    e->files = calloc(ELEVATOR_WINDOW, sizeof(elevator_file));
+    e->reads = calloc((size_t)ELEVATOR_WINDOW * GH_SAMPLE_MAX, sizeof(elevator_read));
+    if (!e->files || !e->reads) {
+        elevator_free(e);
+        return NULL;
+    }
+    return e;
+}
+
+void elevator_free(elevator *e) {
+    if (!e) return;
+    for (size_t i = 0; i < e->count; i++) free(e->files[i].path);
+    free(e->files);
+    free(e->reads);
+    free(e->arena);
+    free(e);
+}
+
+/**
+ * elevator_add: Queues one file of the window, flushing the window once it
+ * is full. The file is opened and located only when the window is flushed.
+ */
+void elevator_add(scan_ctx *ctx, const char *path, const struct stat *st) {
+    elevator *e = ctx->elev;
+    elevator_file *f = &e->files[e->count];
+    memset(f, 0, sizeof(*f));
+    if (!(f->path = strdup(path))) {
+        // Out of memory: keep the order and hash this one inline
+        elevator_flush(ctx);
+        ctx->elev = NULL;
+        scan_hash(ctx, path, st);
+        ctx->elev = e;
+        return;
+    }
+    if (st) {
+        f->st = *st;
+        f->has_st = 1;
+    }
+    f->fd = -1;
+    if (++e->count == ELEVATOR_WINDOW) elevator_flush(ctx);
+}
+
+/**
+ * elevator_locate: Physical byte offset of the data at off, from FIEMAP.
+ * Returns 0 when the filesystem cannot tell (no FIEMAP, a hole, or delayed
+ * allocation that has no address yet).
+ */
+static int elevator_locate(int fd, int64_t off, uint64_t *physical) {
+    uint64_t raw[(sizeof(struct fiemap) + sizeof(struct fiemap_extent) + 7) / 8];
+    struct fiemap *fm = (struct fiemap *)raw;
+    memset(raw, 0, sizeof(raw));
+    fm->fm_start = (uint64_t)off;
+    fm->fm_length = GH_CHUNK_SIZE;
+    fm->fm_extent_count = 1;
+    if (ioctl(fd, FS_IOC_FIEMAP, fm) != 0 || fm->fm_mapped_extents == 0) return 0;
+    const struct fiemap_extent *fe = &fm->fm_extents[0];
+    if (fe->fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_ENCODED)) return 0;
+    *physical = fe->fe_physical + ((uint64_t)off > fe->fe_logical ? (uint64_t)off - fe->fe_logical : 0);
+    return 1;
+}
+
+/* Device, then located reads by physical offset, then the rest by inode and logical offset. */
+static int elevator_cmp(const void *a, const void *b) {
+    const elevator_read *x = a, *y = b;
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    if (x->located != y->located) return x->located ? -1 : 1;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    if (x->off != y->off) return x->off < y->off ? -1 : 1;
+    return 0;
+}
+
+/**
+ * elevator_flush: Hashes the window. Every file is opened and its samples
+ * located first; then all sample reads of the window are issued in one
+ * ascending sweep over the disk, and the hashes are put together and emitted
+ * in the order the files were queued. Under --full whole files are streamed
+ * in the order of their first block. If the window's sample arena cannot be
+ * allocated, each file is hashed on its own instead.
+ */
+void elevator_flush(scan_ctx *ctx) {
+    elevator *e = ctx->elev;
+    if (!e || e->count == 0) return;
+    gh_stats *sx = thread_stats;
+    uint64_t mark = sx ? stats_now() : 0;
+    uint64_t started = mark;   // Latency of a file: from the start of its window until its hash is ready
+    int full = (hash_opts.flags & GH_FULL) != 0;
+    int uncached = hash_opts.pagecache != GH_PAGECACHE_KEEP;
+    size_t nreads = 0, nsamples = 0;
+
+    for (size_t i = 0; i < e->count; i++) {
+        elevator_file *f = &e->files[i];
+        if (ctx->cache && f->has_st && cache_lookup(ctx->cache, &f->st, &f->hash)) continue;
+        f->fd = open(f->path, O_RDONLY | O_NOATIME);
+        if (f->fd != -1 && fstat(f->fd, &f->st) != 0) {
+            close(f->fd);
+            f->fd = -1;
+        }
+        if (f->fd == -1) {
+            if (sx) sx->failures++;
+            continue;
+        }
+        f->has_st = 1;
+        if (full) {
+            f->nsamples = 0;
+        } else {
+            f->nsamples = gh_sample_layout(hash_opts.layout, (uint64_t)f->st.st_size, f->offsets);
+            posix_fadvise(f->fd, 0, 0, POSIX_FADV_RANDOM);   // Readahead would read between the sorted samples
+        }
+        for (int s = 0; s < (full ? 1 : f->nsamples); s++) {
+            elevator_read *r = &e->reads[nreads++];
+            r->dev = (uint64_t)f->st.st_dev;
+            r->off = full ? 0 : f->offsets[s];
+            r->located = elevator_locate(f->fd, r->off, &r->key);
+            if (!r->located) r->key = (uint64_t)f->st.st_ino;
+            r->file = (unsigned)i;
+            r->sample = (unsigned)s;
+        }
+        nsamples += (size_t)f->nsamples;
+    }
+    stats_lap(sx, PHASE_OPEN, &mark);
+
+    if (nsamples * GH_CHUNK_SIZE > e->arena_cap) {
+        free(e->arena);
+        e->arena_cap = nsamples * GH_CHUNK_SIZE;
+        if (!(e->arena = malloc(e->arena_cap))) e->arena_cap = 0;
+    }
+    if (!e->arena && nsamples > 0) {
+        // No room for the window's samples: hash each file on its own, unsorted
+        for (size_t i = 0; i < e->count; i++) {
+            elevator_file *f = &e->files[i];
+            if (f->fd == -1) continue;
+            f->hash = hash_fd_stat(f->fd, &f->st);   // Feeds --stats itself
+            close(f->fd);
+            f->fd = -1;
+            if (f->hash != 0 && ctx->cache) cache_store(ctx->cache, &f->st, f->hash);
+        }
+        nreads = 0;
+    }
+    unsigned char *next = e->arena;
+    for (size_t i = 0; i < e->count && e->arena; i++) {
+        e->files[i].buf = next;
+        next += (size_t)e->files[i].nsamples * GH_CHUNK_SIZE;
+    }
+
+    qsort(e->reads, nreads, sizeof(elevator_read), elevator_cmp);
+    for (size_t k = 0; k < nreads; k++) {
+        elevator_read *r = &e->reads[k];
+        elevator_file *f = &e->files[r->file];
+        if (full) {
+            close(f->fd);
+            f->fd = -1;
+            f->hash = hash_path_stat(f->path, &f->st);   // Feeds --stats itself
+            continue;
+        }
+        unsigned char *buf = f->buf + (size_t)r->sample * GH_CHUNK_SIZE;
+        int no_dontcache = 0;
+        f->got[r->sample] = uncached ? gh_pread_uncached(f->fd, buf, r->off, &no_dontcache)
+                                     : pread(f->fd, buf, GH_CHUNK_SIZE, (off_t)r->off);
+    }
+    stats_lap(sx, PHASE_READ, &mark);
+
+    for (size_t i = 0; i < e->count && !full; i++) {
+        elevator_file *f = &e->files[i];
+        if (f->fd == -1) continue;
+        unsigned long long hash = hash_opts.algo->seed((unsigned long long)f->st.st_size);
+        for (int s = 0; s < f->nsamples; s++) {
+            if (f->got[s] > 0) hash = hash_opts.algo->update(hash, f->buf + (size_t)s * GH_CHUNK_SIZE, (size_t)f->got[s]);
+        }
+        f->hash = hash;
+        if (ctx->cache) cache_store(ctx->cache, &f->st, hash);
+        if (sx) {
+            sx->opens++;
+            sx->reads += (uint64_t)f->nsamples;
+            for (int s = 0; s < f->nsamples; s++) {
+                if (f->got[s] > 0) sx->bytes_read += (uint64_t)f->got[s];
+                else if (f->got[s] < 0) sx->failures++;
+            }
+            stats_latency(sx, stats_now() - started);
+        }
+    }
+    stats_lap(sx, PHASE_HASH, &mark);
+
+    for (size_t i = 0; i < e->count; i++) {
+        elevator_file *f = &e->files[i];
+        if (f->fd != -1) close(f->fd);
+        if (full && f->hash != 0 && ctx->cache) cache_store(ctx->cache, &f->st, f->hash);
+        scan_emit(ctx, f->hash, &f->st, f->path);
+        free(f->path);
+    }
+    e->count = 0;
+}
+
+/* ================= PREFETCH ================= */
+
+typedef struct {
+    char *path;
+    struct stat st;
+    int fd;                    // -1 when cached or unreadable
+    unsigned long long hash;   // Cache hit
+} prefetch_entry;
+
+struct prefetch_queue {
+    prefetch_entry *ring;      // depth + 1 slots: the file being hashed and the ones ahead of it
+    size_t depth;              // Files kept requested ahead of the hasher
+    size_t head, count;
+};
+
+prefetch_queue *prefetch_new(size_t depth) {
+    prefetch_queue *q = calloc(1, sizeof(prefetch_queue));
+    if (!q) return NULL;
+    if (!(q->ring = calloc(depth + 1, sizeof(prefetch_entry)))) {
+        free(q);
+        return NULL;
+    }
+    q->depth = depth;
+    return q;
+}
+
+/* Hashes the oldest queued file, whose samples have had the longest to arrive. */
+static void prefetch_pop(scan_ctx *ctx) {
+    prefetch_queue *q = ctx->prefetch;
+    prefetch_entry *e = &q->ring[q->head];
+    q->head = (q->head + 1) % (q->depth + 1);
+    q->count--;
+
+    struct stat hst = e->st;
+    unsigned long long h = e->hash;
+    if (e->fd != -1) {
+        h = hash_fd_stat(e->fd, &hst);
+        close(e->fd);
+        if (h != 0 && ctx->cache) cache_store(ctx->cache, &hst, h);
+    }
+    scan_emit(ctx, h, &hst, e->path);
+    free(e->path);
+}
+
+/* Opens a file, queues it and asks for its samples with WILLNEED. */
+static void prefetch_request(scan_ctx *ctx, const char *path, const struct stat *st) {
+    prefetch_queue *q = ctx->prefetch;
+    gh_stats *sx = thread_stats;
+    uint64_t mark = sx ? stats_now() : 0;
+    prefetch_entry *e = &q->ring[(q->head + q->count) % (q->depth + 1)];
+    memset(e, 0, sizeof(*e));
+    e->fd = -1;
+    if (!(e->path = strdup(path))) {
+        // Out of memory: keep the order and hash this one inline
+        prefetch_flush(ctx);
+        ctx->prefetch = NULL;
+        scan_hash(ctx, path, st);
+        ctx->prefetch = q;
+        return;
+    }
+    q->count++;
+    if (st && ctx->cache && cache_lookup(ctx->cache, st, &e->hash)) {
+        e->st = *st;
+        return;
+    }
+    e->fd = open(path, O_RDONLY | O_NOATIME | O_CLOEXEC);
+    if (e->fd == -1 || fstat(e->fd, &e->st) != 0) {
+        if (e->fd != -1) close(e->fd);
+        e->fd = -1;
+        if (sx) sx->failures++;
+        return;
+    }
+    int64_t offsets[GH_SAMPLE_MAX];
+    int n = gh_sample_layout(hash_opts.layout, (uint64_t)e->st.st_size, offsets);
+    for (int i = 0; i < n; i++) posix_fadvise(e->fd, (off_t)offsets[i], GH_CHUNK_SIZE, POSIX_FADV_WILLNEED);
+    stats_lap(sx, PHASE_OPEN, &mark);
+}
+
+/**
+ * prefetch_add: Queues a file and requests its samples, then hashes the
+ * file queued depth places before it. The kernel reads the samples of the
+ * depth files after that one while the hasher works.
+ */
+void prefetch_add(scan_ctx *ctx, const char *path, const struct stat *st) {
+    prefetch_queue *q = ctx->prefetch;
+    prefetch_request(ctx, path, st);
+    if (q->count > q->depth) prefetch_pop(ctx);
+}
+
+/**
+ * prefetch_flush: Hashes everything still queued, in order.
+ */
+void prefetch_flush(scan_ctx *ctx) {
+    if (!ctx->prefetch) return;
+    while (ctx->prefetch->count > 0) prefetch_pop(ctx);
+}
+
+void prefetch_free(prefetch_queue *q) {
+    if (!q) return;
+    free(q->ring);
+    free(q);
+}
+
+/* ================= PATH LISTS ================= */
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t cap, start, end;
+    int eof;
+    int error;             // errno of a failed read or buffer growth, 0 otherwise
+} path_reader;
+
+/**
+ * path_reader_next: Returns the next delim-terminated record with the
+ * terminator replaced by NUL, or NULL at end of input. The buffer only grows
+ * to fit the longest single record. A read error also ends the input, with
+ * r->error set; a nonblocking fd that has nothing yet is waited on instead.
+ */
+static char *path_reader_next(path_reader *r, char delim, int flush_when_idle) {
+    for (;;) {
+        char *rec = r->buf + r->start;
+        char *hit = memchr(rec, delim, r->end - r->start);
+        if (hit) {
+            *hit = '\0';
+            r->start = (size_t)(hit - r->buf) + 1;
+            return rec;
+        }
+        if (r->eof) {
+            if (r->start == r->end) return NULL;
+            r->buf[r->end] = '\0';    // Last record had no terminator
+            r->start = r->end;
+            return rec;
+        }
+
+        if (r->start > 0) {
+            memmove(r->buf, rec, r->end - r->start);
+            r->end -= r->start;
+            r->start = 0;
+        }
+        if (r->end + 1 >= r->cap) {
+            char *b = realloc(r->buf, r->cap * 2);
+            if (!b) { r->error = ENOMEM; return NULL; }
+            r->buf = b;
+            r->cap *= 2;
+        }
+        if (flush_when_idle) {
+            // The producer is slow: push out what we have before blocking on it
+            struct pollfd pfd = { r->fd, POLLIN, 0 };
+            if (poll(&pfd, 1, OUT_FLUSH_MS) == 0) out_flush();
+        }
+        ssize_t n = read(r->fd, r->buf + r->end, r->cap - 1 - r->end);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = { r->fd, POLLIN, 0 };
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if (n < 0) {
+            r->error = errno;
+            r->eof = 1;         // Hand out the records already read, then stop
+        } else if (n == 0) {
+            r->eof = 1;
+        } else {
+            r->end += (size_t)n;
+        }
+    }
+}
+
+/**
+ * scan_list: Hashes the paths read from fd while they are still arriving.
+ * Records end with delim ('\0' for --stdin0, '\n' for --files-from). With
+ * recursive set, listed directories are walked like command-line arguments.
+ * Returns -1 if the list could not be read to its end.
+ */
+int scan_list(int fd, char delim, int recursive, int walk_threads, scan_ctx *ctx) {
+    path_reader r = { fd, malloc(LIST_BUF_SIZE), LIST_BUF_SIZE, 0, 0, 0, 0 };
+    if (!r.buf) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Out of memory.\n");
+        return -1;
+    }
+
+    char *path;
+    while ((path = path_reader_next(&r, delim, ctx->pool == NULL)) != NULL) {
+        if (*path == '\0') continue;
+        if (recursive) {
+            if (walk_threads > 0) walk_tree(path, walk_threads, ctx);
+            else process_path_recursive(path, ctx);
+            continue;
+        }
+        ctx->root_len = 0;   // Listed files shard by the path as listed, before anything is stat'ed
+        if (!shard_keeps(ctx, path)) continue;
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            if (!silent_mode) fprintf(stderr, C_RED "Path Error:" C_RESET " " C_YELLOW "'%s'" C_RESET " is not a regular file\n", path);
+            continue;
+        }
+        if (!ctx->ignore_ext && !gh_ext_match(&ext_filter, path)) continue;
+        if (thread_progress) progress_add(&thread_progress->found, 1);
+        scan_file(ctx, path, &st);
+    }
+    free(r.buf);
+    if (r.error) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Cannot read the path list: %s\n", strerror(r.error));
+        return -1;
+    }
+    return 0;
+}
+
+/* ================= VERIFY ================= */
+
+/**
+ * verify_push: Appends a copy of rec with len bytes of path as its path.
+ */
+static int verify_push(verify_list *v, const char *path, size_t len, const verify_entry *rec) {
+    if (len == 0) return 0;
+    if (v->count == v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 1024;
+        verify_entry *entries = realloc(v->entries, cap * sizeof(verify_entry));
+        if (!entries) return -1;
+        v->entries = entries;
+        v->cap = cap;
+    }
+    char *copy = strndup(path, len);
+    if (!copy) return -1;
+    verify_entry *e = &v->entries[v->count++];
+    *e = *rec;
+    e->path = copy;
+    e->state = VERIFY_PENDING;
+    return 0;
+}
+
+static inline int log_push(verify_list *v, const char *path, size_t len, const verify_entry *rec) {
+    return v->push ? v->push(v, path, len, rec) : verify_push(v, path, len, rec);
+}
+
+static int parse_hex64(const char *s, const char *end, unsigned long long *out) {
+    if (end - s < 16) return 0;
+    unsigned long long h = 0;
+    for (int i = 0; i < 16; i++) {
+        char c = s[i];
+        int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (d < 0) return 0;
+        h = h << 4 | (unsigned)d;
+    }
+    *out = h;
+    return 1;
+}
+
+static int starts_with(const char *s, const char *end, const char *prefix) {
+    size_t n = strlen(prefix);
+    return (size_t)(end - s) >= n && memcmp(s, prefix, n) == 0;
+}
+
+/**
+ * json_unquote: Decodes the JSON string whose opening quote is just before s
+ * into out, which needs as many bytes as the input. Returns the decoded
+ * length, or -1 if the string is not terminated before end.
+ */
+static long json_unquote(const char *s, const char *end, char *out) {
+    char *o = out;
+    while (s < end && *s != '"') {
+        if (*s != '\\') { *o++ = *s++; continue; }
+        if (end - s < 2) return -1;
+        char c = s[1];
+        s += 2;
+        switch (c) {
+        case 'b': *o++ = '\b'; break;
+        case 'f': *o++ = '\f'; break;
+        case 'n': *o++ = '\n'; break;
+        case 'r': *o++ = '\r'; break;
+        case 't': *o++ = '\t'; break;
+        case '"': case '\\': case '/': *o++ = c; break;
+        case 'u': {
+            unsigned cp = 0;
+            if (end - s < 4) return -1;
+            for (int i = 0; i < 4; i++) {
+                char x = s[i];
+                int d = x >= '0' && x <= '9' ? x - '0' : (x | 0x20) >= 'a' && (x | 0x20) <= 'f' ? (x | 0x20) - 'a' + 10 : -1;
+                if (d < 0) return -1;
+                cp = cp << 4 | (unsigned)d;
+            }
+            s += 4;
+            // Six input bytes always cover the UTF-8 encoding
+            if (cp < 0x80) {
+                *o++ = (char)cp;
+            } else if (cp < 0x800) {
+                *o++ = (char)(0xc0 | cp >> 6);
+                *o++ = (char)(0x80 | (cp & 0x3f));
+            } else {
+                *o++ = (char)(0xe0 | cp >> 12);
+                *o++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+                *o++ = (char)(0x80 | (cp & 0x3f));
+            }
+            break;
+        }
+        default: return -1;
+        }
+    }
+    return s < end ? (long)(o - out) : -1;
+}
+
+/**
+ * verify_parse_ndjson: One --format ndjson line. Keys are found by name; a
+ * quote inside a path is always escaped, so a path cannot fake one.
+ */
+static int json_u64(const char *line, const char *end, const char *key, unsigned long long *out) {
+    size_t klen = strlen(key);
+    const char *p = memmem(line, (size_t)(end - line), key, klen);
+    if (!p) return 0;
+    unsigned long long n = 0;
+    for (p += klen; p < end && *p >= '0' && *p <= '9'; p++) n = n * 10 + (unsigned long long)(*p - '0');
+    *out = n;
+    return 1;
+}
+
+/**
+ * verify_label: Splits a kernel name from a log header ("vec64", "vec64-full",
+ * "vec64-v2") into v->algo, v->full and v->layout. Returns -1 for names this
+ * version does not know.
+ */
+static int verify_label(verify_list *v, char *name) {
+    char *suffix = strchr(name, '-');
+    if (suffix) {
+        if (strcmp(suffix, "-full") == 0) v->full = 1;
+        else if (strcmp(suffix, "-v2") == 0) v->layout = GH_LAYOUT_V2;
+        else return -1;
+        *suffix = '\0';
+    } else {
+        v->layout = GH_LAYOUT_V1;
+    }
+    return (v->algo = gh_algo_find(name)) ? 0 : -1;
+}
+
+static int verify_parse_ndjson(verify_list *v, const char *line, const char *end, char **scratch, size_t *scratch_cap) {
+    const char *h = memmem(line, (size_t)(end - line), "\"hash\":\"", 8);
+    const char *p = memmem(line, (size_t)(end - line), "\"path\":\"", 8);
+    verify_entry rec = { 0 };
+    unsigned long long dev = 0, ino = 0, mtime = 0;
+    if (!h || !p || !parse_hex64(h + 8, end, &rec.hash) || !json_u64(line, end, "\"size\":", &rec.size)) return -1;
+    json_u64(line, end, "\"dev\":", &dev);
+    json_u64(line, end, "\"ino\":", &ino);
+    json_u64(line, end, "\"mtime_ns\":", &mtime);
+    unsigned long long layout = 0;
+    if (memmem(line, (size_t)(end - line), "\"full\":true", 11)) v->full = 1;
+    if (json_u64(line, end, "\"layout\":", &layout)) v->layout = (unsigned)layout;
+    rec.has_size = 1;
+    rec.dev = dev;
+    rec.ino = ino;
+    rec.mtime_ns = (int64_t)mtime;
+
+    size_t need = (size_t)(end - p);
+    if (need > *scratch_cap) {
+        char *buf = realloc(*scratch, need);
+        if (!buf) return -1;
+        *scratch = buf;
+        *scratch_cap = need;
+    }
+    long len = json_unquote(p + 8, end, *scratch);
+    if (len < 0) return -1;
+    return log_push(v, *scratch, (size_t)len, &rec);
+}
+
+/**
+ * verify_parse_lines: Text and NDJSON logs. Text logs hold "<hash>  <path>"
+ * lines (-r, --files-from, --dupes, --watch) or File/Path/Hash blocks (files
+ * named on the command line), and name their kernel on the "Algorithm:" line
+ * (see verify_label()).
+ */
+static int verify_parse_lines(verify_list *v, const char *data, size_t len) {
+    const char *file = NULL, *file_end = NULL, *dir = NULL, *dir_end = NULL;
+    char *scratch = NULL;
+    size_t scratch_cap = 0;
+    int rc = 0;
+
+    for (const char *line = data, *stop = data + len; line < stop && rc == 0;) {
+        const char *end = memchr(line, '\n', (size_t)(stop - line));
+        if (!end) end = stop;
+        unsigned long long hash;
+
+        if (*line == '{') {
+            rc = verify_parse_ndjson(v, line, end, &scratch, &scratch_cap);
+        } else if (end - line > 18 && line[16] == ' ' && line[17] == ' ' && parse_hex64(line, end, &hash)) {
+            verify_entry rec = { .hash = hash };
+            rc = log_push(v, line + 18, (size_t)(end - line - 18), &rec);
+        } else if (starts_with(line, end, "Algorithm: ")) {
+            char name[16] = {0};
+            size_t n = (size_t)(end - line) - 11;
+            memcpy(name, line + 11, n < sizeof(name) - 1 ? n : sizeof(name) - 1);
+            rc = verify_label(v, name);
+        } else if (starts_with(line, end, "File: ")) {
+            file = line + 6;
+            file_end = end;
+        } else if (starts_with(line, end, "Path: ")) {
+            dir = line + 6;
+            dir_end = end;
+        } else if (starts_with(line, end, "Hash: ") && file && dir && parse_hex64(line + 6, end, &hash)) {
+            size_t dlen = (size_t)(dir_end - dir), flen = (size_t)(file_end - file);
+            if (dlen == 1 && *dir == '/') dlen = 0;   // File in the root directory
+            size_t need = dlen + 1 + flen;
+            if (need > scratch_cap) {
+                char *buf = realloc(scratch, need);
+                if (!buf) { rc = -1; break; }
+                scratch = buf;
+                scratch_cap = need;
+            }
+            memcpy(scratch, dir, dlen);
+            scratch[dlen] = '/';
+            memcpy(scratch + dlen + 1, file, flen);
+            verify_entry rec = { .hash = hash };
+            rc = log_push(v, scratch, need, &rec);
+            file = dir = NULL;
+        }
+        line = end + 1;
+    }
+    free(scratch);
+    return rc;
+}
+
+/**
+ * verify_parse_binary: A --format binary log, checked record by record so a
+ * truncated file is rejected instead of read past its end.
+ */
+static int verify_parse_binary(verify_list *v, const char *data, size_t len) {
+    gh_record_header h;
+    if (len < sizeof(h)) return -1;
+    memcpy(&h, data, sizeof(h));
+    if (h.byte_order != GH_RECORD_BYTE_ORDER || h.format_version != GH_RECORD_VERSION ||
+        h.header_size < sizeof(h) || h.header_size > len) return -1;
+    h.algo[sizeof(h.algo) - 1] = '\0';
+    if (verify_label(v, h.algo) != 0 || v->algo->id != (h.algo_id & ~(GH_FULL_ID | GH_LAYOUT_V2_ID))) return -1;
+
+    for (size_t off = h.header_size; off < len;) {
+        gh_record r;
+        if (len - off < sizeof(r)) return -1;
+        memcpy(&r, data + off, sizeof(r));
+        if (r.length < sizeof(r) + (size_t)r.path_len + 1 || r.length > len - off) return -1;
+        verify_entry rec = { .hash = r.hash, .size = r.size, .has_size = 1, .dev = r.dev, .ino = r.ino, .mtime_ns = r.mtime_ns };
+        if (log_push(v, data + off + sizeof(r), r.path_len, &rec) != 0) return -1;
+        off += r.length;
+    }
+    return 0;
+}
+
+static size_t verify_slot(const char *path, size_t cap) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) h = (h ^ *p) * 0x100000001b3ULL;
+    return (size_t)(h ^ (h >> 32)) & (cap - 1);
+}
+
+/**
+ * verify_dedupe: A --watch log lists a file again every time it changed. Keeps
+ * each path once, at its first position, with the values of its last line.
+ */
+int verify_dedupe(verify_list *v) {
+    size_t cap = 16;
+    while (cap < v->count * 2) cap *= 2;
+    size_t *index = calloc(cap, sizeof(size_t));   // Entry number + 1 (0 = empty)
+    if (!index) return -1;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < v->count; i++) {
+        verify_entry *e = &v->entries[i];
+        size_t s = verify_slot(e->path, cap);
+        while (index[s] && strcmp(v->entries[index[s] - 1].path, e->path) != 0) s = (s + 1) & (cap - 1);
+        if (index[s]) {
+            verify_entry *first = &v->entries[index[s] - 1];
+            free(first->path);
+            *first = *e;
+            continue;
+        }
+        v->entries[kept] = *e;
+        index[s] = ++kept;
+    }
+    v->count = kept;
+    free(index);
+    return 0;
+}
+
+/**
+ * log_map: Maps a log read-only. An empty log maps to NULL; MAP_FAILED is
+ * returned after printing why the log cannot be read.
+ */
+static const char *log_map(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Could not open log " C_YELLOW "%s" C_RESET " (%s).\n", path, strerror(errno));
+        if (fd != -1) close(fd);
+        return MAP_FAILED;
+    }
+    *len = (size_t)st.st_size;
+    const char *data = *len ? mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (data == MAP_FAILED) fprintf(stderr, C_RED "Error:" C_RESET " Could not read log " C_YELLOW "%s" C_RESET ".\n", path);
+    return data;
+}
+
+/* Hands every entry of a mapped log to log_push(). Returns -1 after printing why. */
+static int log_parse(verify_list *v, const char *path, const char *data, size_t len) {
+    int rc = len >= sizeof(GH_RECORD_MAGIC) - 1 && memcmp(data, GH_RECORD_MAGIC, sizeof(GH_RECORD_MAGIC) - 1) == 0
+                 ? verify_parse_binary(v, data, len)
+                 : verify_parse_lines(v, data, len);
+    if (rc != 0) fprintf(stderr, C_RED "Error:" C_RESET " " C_YELLOW "%s" C_RESET " is damaged or not a gh log.\n", path);
+    return rc;
+}
+
+/**
+ * verify_read: Appends the entries of a previous text, NDJSON or binary log
+ * to v, and sets v->algo if the log names its kernel. Returns -1 (after
+ * printing why) if it cannot be used.
+ */
+int verify_read(verify_list *v, const char *path) {
+    size_t len = 0;
+    const char *data = log_map(path, &len);
+    if (data == MAP_FAILED) return -1;
+
+    size_t before = v->count;
+    int rc = log_parse(v, path, data, len);
+    if (data) munmap((void *)data, len);
+    if (rc != 0) return -1;
+    if (v->count == before) fprintf(stderr, C_YELLOW "Warning:" C_RESET " " C_YELLOW "%s" C_RESET " lists no files.\n", path);
+    return 0;
+}
+
+/**
+ * verify_load: One log, ready for verify_run().
+ */
+verify_list *verify_load(const char *path) {
+    verify_list *v = calloc(1, sizeof(verify_list));
+    if (!v) return NULL;
+    if (verify_read(v, path) != 0) {
+        verify_free(v);
+        return NULL;
+    }
+    if (verify_dedupe(v) != 0) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Out of memory.\n");
+        verify_free(v);
+        return NULL;
+    }
+    return v;
+}
+
+static void verify_report(verify_list *v, verify_entry *e) {
+    v->counts[e->state]++;
+    switch (e->state) {
+    case VERIFY_OK:
+        return;
+    case VERIFY_MISMATCH:
+        smart_printf(C_RED, "Mismatch: ", "%s (logged %016llx, now %016llx)\n", e->path, e->hash, e->found);
+        break;
+    case VERIFY_RESIZED:
+        smart_printf(C_RED, "Changed: ", "%s (logged %llu bytes, now %llu)\n", e->path, e->size, e->found);
+        break;
+    case VERIFY_MISSING:
+        smart_printf(C_RED, "Missing: ", "%s\n", e->path);
+        break;
+    default:
+        smart_printf(C_RED, "Unreadable: ", "%s\n", e->path);
+        break;
+    }
+    __atomic_store_n(&v->failed, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Prints the entries up to the next queued one; the submitter settled them
+ * without hashing. The acquire pairs with verify_run()'s release, so found is
+ * visible once the state is.
+ */
+static void verify_settle(verify_list *v) {
+    while (v->reported < v->count && __atomic_load_n(&v->entries[v->reported].state, __ATOMIC_ACQUIRE) > VERIFY_QUEUED) {
+        verify_report(v, &v->entries[v->reported++]);
+    }
+}
+
+/**
+ * verify_run: Sends every entry through ctx (the pool or inline hashing).
+ * Entries with a logged size are stat'ed first, and a missing file or a
+ * changed size is settled without opening it. With fail_fast, submission
+ * stops at the first problem.
+ */
+void verify_run(verify_list *v, scan_ctx *ctx) {
+    if (thread_progress) progress_add(&thread_progress->found, v->count);
+    progress_listed();
+    for (size_t i = 0; i < v->count; i++) {
+        if (v->fail_fast && __atomic_load_n(&v->failed, __ATOMIC_RELAXED)) break;
+        verify_entry *e = &v->entries[i];
+        struct stat st;
+        if (e->has_size) {
+            int state = VERIFY_PENDING;
+            if (stat(e->path, &st) != 0) {
+                state = errno == ENOENT || errno == ENOTDIR ? VERIFY_MISSING : VERIFY_UNREADABLE;
+            } else if ((unsigned long long)st.st_size != e->size) {
+                state = VERIFY_RESIZED;
+                e->found = (unsigned long long)st.st_size;
+            }
+            if (state != VERIFY_PENDING) {
+                // The writer may be settling this entry right now: publish found before the state
+                __atomic_store_n(&e->state, state, __ATOMIC_RELEASE);
+                __atomic_store_n(&v->failed, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+        }
+        // Results come back in submission order (the pool runs ordered in this mode)
+        __atomic_store_n(&e->state, VERIFY_QUEUED, __ATOMIC_RELEASE);
+        scan_hash(ctx, e->path, e->has_size ? &st : NULL);
+    }
+}
+
+/**
+ * verify_emit: Checks one rehashed file (hash 0 if it failed) against the log.
+ * Called by whoever owns the output, like emit_result().
+ */
+void verify_emit(verify_list *v, unsigned long long hash, const char *path) {
+    verify_settle(v);
+    if (v->reported == v->count) return;
+    verify_entry *e = &v->entries[v->reported++];
+    e->found = hash;
+    if (hash == 0) e->state = access(path, F_OK) == 0 ? VERIFY_UNREADABLE : VERIFY_MISSING;
+    else e->state = hash == e->hash ? VERIFY_OK : VERIFY_MISMATCH;
+    verify_report(v, e);
+}
+
+/**
+ * verify_finish: Prints what is left once all hashing is done, and the tally.
+ */
+void verify_finish(verify_list *v) {
+    verify_settle(v);
+    unsigned long long *c = v->counts;
+    unsigned long long unchecked = v->count - v->reported;
+    printf(C_YELLOW "Verify: " C_RESET "%'llu ok, %'llu mismatched, %'llu changed size, %'llu missing, %'llu unreadable",
+           c[VERIFY_OK], c[VERIFY_MISMATCH], c[VERIFY_RESIZED], c[VERIFY_MISSING], c[VERIFY_UNREADABLE]);
+    if (unchecked) printf(" (%'llu not checked, --fail-fast)", unchecked);
+    printf(".\n");
+    if (log_fp) {
+        fprintf(log_fp, "Verify: %'llu ok, %'llu mismatched, %'llu changed size, %'llu missing, %'llu unreadable",
+                c[VERIFY_OK], c[VERIFY_MISMATCH], c[VERIFY_RESIZED], c[VERIFY_MISSING], c[VERIFY_UNREADABLE]);
+        if (unchecked) fprintf(log_fp, " (%'llu not checked, --fail-fast)", unchecked);
+        fprintf(log_fp, ".\n");
+    }
+}
+
+void verify_free(verify_list *v) {
+    for (size_t i = 0; i < v->count; i++) free(v->entries[i].path);
+    free(v->entries);
+    free(v);
+}
+
+/* ================= MERGE ================= */
+
+static int merge_cmp(const void *a, const void *b) {
+    return strcmp(((const verify_entry *)a)->path, ((const verify_entry *)b)->path);
+}
+
+static const char *verify_kind(int full, unsigned layout) {
+    if (full) return "--full digests";
+    return layout == GH_LAYOUT_V2 ? "v2 fingerprints" : "v1 fingerprints";
+}
+
+/**
+ * merge_load: Reads the logs of a sharded scan (any mix of text, NDJSON and
+ * binary, all written with one kernel and digest) into one list sorted by path, so the
+ * result does not depend on how the work was split. Returns NULL after
+ * printing why.
+ */
+verify_list *merge_load(char *const *paths, int n) {
+    verify_list *v = calloc(1, sizeof(verify_list));
+    if (!v) return NULL;
+    for (int i = 0; i < n; i++) {
+        const gh_algo *algo = v->algo;
+        int full = v->full;
+        unsigned layout = v->layout ? v->layout : GH_LAYOUT_V1;
+        v->algo = NULL;
+        v->full = 0;
+        v->layout = 0;
+        if (verify_read(v, paths[i]) != 0) {
+            verify_free(v);
+            return NULL;
+        }
+        if (!v->layout) v->layout = GH_LAYOUT_V1;
+        if (i > 0 && (full != v->full || (!full && layout != v->layout))) {
+            fprintf(stderr, C_RED "Error:" C_RESET " " C_YELLOW "%s" C_RESET " holds %s, the logs before it %s.\n",
+                    paths[i], verify_kind(v->full, v->layout), verify_kind(full, layout));
+            verify_free(v);
+            return NULL;
+        }
+        if (algo && v->algo && algo != v->algo) {
+            fprintf(stderr, C_RED "Error:" C_RESET " " C_YELLOW "%s" C_RESET " was hashed with %s, the logs before it with %s.\n",
+                    paths[i], v->algo->name, algo->name);
+            verify_free(v);
+            return NULL;
+        }
+        if (!v->algo) v->algo = algo;
+    }
+    if (verify_dedupe(v) != 0) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Out of memory.\n");
+        verify_free(v);
+        return NULL;
+    }
+    qsort(v->entries, v->count, sizeof(verify_entry), merge_cmp);
+    return v;
+}
+
+/**
+ * merge_print: Writes the merged entries like a scan would, in --format.
+ * Fields a text log did not record are written as 0.
+ */
+void merge_print(const verify_list *v) {
+    for (size_t i = 0; i < v->count; i++) {
+        const verify_entry *e = &v->entries[i];
+        if (record_fp) {
+            struct stat st;
+            memset(&st, 0, sizeof(st));
+            st.st_size = (off_t)e->size;
+            st.st_dev = (dev_t)e->dev;
+            st.st_ino = (ino_t)e->ino;
+            st.st_mtim.tv_sec = (time_t)(e->mtime_ns / 1000000000LL);
+            st.st_mtim.tv_nsec = (long)(e->mtime_ns % 1000000000LL);
+            print_record(e->hash, &st, e->path, 0);
+        } else {
+            print_simple_output(e->hash, e->path);
+        }
+        out_tick();
+    }
+}
+
+/* ================= COMPARE ================= */
+
+static int compare_paths(const compare_entry *a, const compare_entry *b) {
+    size_t n = a->len < b->len ? a->len : b->len;
+    int c = memcmp(a->path, b->path, n);
+    return c ? c : (a->len > b->len) - (a->len < b->len);
+}
+
+/* Path order as in merge_cmp(); repeats of a path stay in log order. */
+static int compare_cmp(const void *x, const void *y) {
+    const compare_entry *a = x, *b = y;
+    int c = compare_paths(a, b);
+    return c ? c : (a->link > b->link) - (a->link < b->link);
+}
+
+/* Copies a path that is not in the mapping as logged into the name chunks. */
+static const char *compare_name(compare_log *c, const char *path, size_t len) {
+    compare_chunk *k = c->names;
+    if (!k || k->cap - k->used < len) {
+        size_t cap = len > COMPARE_CHUNK ? len : COMPARE_CHUNK;
+        if (!(k = malloc(sizeof(compare_chunk) + cap))) return NULL;
+        k->next = c->names;
+        k->used = 0;
+        k->cap = cap;
+        c->names = k;
+    }
+    char *out = k->data + k->used;
+    memcpy(out, path, len);
+    k->used += len;
+    return out;
+}
+
+/**
+ * compare_push: The log_push() of --compare. A record is 32 bytes; the path
+ * is left in the mapped log unless the parser had to decode it.
+ */
+static int compare_push(verify_list *v, const char *path, size_t len, const verify_entry *rec) {
+    compare_log *c = (compare_log *)v;
+    if (len == 0) return 0;
+    if (c->count == c->cap) {
+        size_t cap = c->cap ? c->cap * 2 : 1024;
+        if (c->count >= COMPARE_NONE) return -1;
+        compare_entry *entries = realloc(c->entries, cap * sizeof(compare_entry));
+        if (!entries) return -1;
+        c->entries = entries;
+        c->cap = cap;
+    }
+    uintptr_t p = (uintptr_t)path, base = (uintptr_t)c->data;
+    if (p < base || p - base > c->len || len > c->len - (p - base)) {
+        if (!(path = compare_name(c, path, len))) return -1;
+    }
+    compare_entry *e = &c->entries[c->count];
+    e->hash = rec->hash;
+    e->size = rec->size;
+    e->path = path;
+    e->len = (uint32_t)len;
+    e->link = (uint32_t)c->count++;
+    return 0;
+}
+
+/**
+ * compare_load: Maps a text, NDJSON or binary log and sorts its entries by
+ * path, keeping the last line of a path a --watch log repeats. If other is
+ * given, the log must hold the same kind of hash. Returns NULL after
+ * printing why.
+ */
+compare_log *compare_load(const char *path, const compare_log *other) {
+    compare_log *c = calloc(1, sizeof(compare_log));
+    if (!c) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Out of memory.\n");
+        return NULL;
+    }
+    c->log.push = compare_push;
+    c->data = log_map(path, &c->len);
+    if (c->data == MAP_FAILED || log_parse(&c->log, path, c->data, c->len) != 0) {
+        if (c->data == MAP_FAILED) c->data = NULL;
+        compare_free(c);
+        return NULL;
+    }
+    if (c->count == 0) fprintf(stderr, C_YELLOW "Warning:" C_RESET " " C_YELLOW "%s" C_RESET " lists no files.\n", path);
+    if (!c->log.layout) c->log.layout = GH_LAYOUT_V1;
+    if (other) {
+        const verify_list *a = &other->log, *b = &c->log;
+        if (a->full != b->full || (!a->full && a->layout != b->layout)) {
+            fprintf(stderr, C_RED "Error:" C_RESET " " C_YELLOW "%s" C_RESET " holds %s, the first log %s.\n",
+                    path, verify_kind(b->full, b->layout), verify_kind(a->full, a->layout));
+            compare_free(c);
+            return NULL;
+        }
+        if (a->algo && b->algo && a->algo != b->algo) {
+            fprintf(stderr, C_RED "Error:" C_RESET " " C_YELLOW "%s" C_RESET " was hashed with %s, the first log with %s.\n",
+                    path, b->algo->name, a->algo->name);
+            compare_free(c);
+            return NULL;
+        }
+    }
+
+    if (c->count) qsort(c->entries, c->count, sizeof(compare_entry), compare_cmp);
+    size_t kept = 0;
+    for (size_t i = 0; i < c->count; i++) {
+        if (kept && compare_paths(&c->entries[kept - 1], &c->entries[i]) == 0) c->entries[kept - 1] = c->entries[i];
+        else c->entries[kept++] = c->entries[i];
+        c->entries[kept - 1].link = COMPARE_NONE;
+    }
+    c->count = kept;
+    return c;
+}
+
+typedef struct {
+    unsigned long long hash;
+    uint32_t index;
+} compare_key;
+
+static int compare_key_cmp(const void *x, const void *y) {
+    const compare_key *a = x, *b = y;
+    if (a->hash != b->hash) return a->hash < b->hash ? -1 : 1;
+    return (a->index > b->index) - (a->index < b->index);
+}
+
+/* Next step of a merge over both sorted sides: <0 only in a, >0 only in b, 0 in both. */
+static int compare_step(const compare_log *a, size_t i, const compare_log *b, size_t j) {
+    if (i == a->count) return 1;
+    if (j == b->count) return -1;
+    return compare_paths(&a->entries[i], &b->entries[j]);
+}
+
+/**
+ * compare_run: Reports how b differs from a with two linear merges. The
+ * first pairs up paths and collects the ones found on one side only; those
+ * are sorted by hash, and a hash that was removed in one place and added in
+ * another is a move (copies pair up in path order). The second prints every
+ * difference in path order, then the tally. Sets *paths to the number of
+ * files seen (a move counts once) and returns 1 if the logs differ, 0 if
+ * not, or -1 if memory ran out.
+ */
+int compare_run(compare_log *a, compare_log *b, unsigned long long *paths) {
+    compare_key *ka = malloc((a->count + 1) * sizeof(compare_key));
+    compare_key *kb = malloc((b->count + 1) * sizeof(compare_key));
+    if (!ka || !kb) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Out of memory.\n");
+        free(ka);
+        free(kb);
+        return -1;
+    }
+    size_t na = 0, nb = 0;
+    for (size_t i = 0, j = 0; i < a->count || j < b->count;) {
+        int c = compare_step(a, i, b, j);
+        if (c < 0) {
+            ka[na].hash = a->entries[i].hash;
+            ka[na++].index = (uint32_t)i++;
+        } else if (c > 0) {
+            kb[nb].hash = b->entries[j].hash;
+            kb[nb++].index = (uint32_t)j++;
+        } else {
+            i++;
+            j++;
+        }
+    }
+    qsort(ka, na, sizeof(compare_key), compare_key_cmp);
+    qsort(kb, nb, sizeof(compare_key), compare_key_cmp);
+    for (size_t i = 0, j = 0; i < na && j < nb;) {
+        if (ka[i].hash < kb[j].hash) {
+            i++;
+        } else if (ka[i].hash > kb[j].hash) {
+            j++;
+        } else {
+            a->entries[ka[i].index].link = kb[j].index;
+            b->entries[kb[j].index].link = ka[i].index;
+            i++;
+            j++;
+        }
+    }
+    free(ka);
+    free(kb);
+
+    unsigned long long same = 0, changed = 0, moved = 0, added = 0, removed = 0;
+    for (size_t i = 0, j = 0; i < a->count || j < b->count;) {
+        int c = compare_step(a, i, b, j);
+        if (c < 0) {
+            const compare_entry *e = &a->entries[i++];
+            if (e->link == COMPARE_NONE) {
+                smart_printf(C_RED, "Removed: ", "%.*s\n", (int)e->len, e->path);
+                removed++;
+            } else {
+                const compare_entry *to = &b->entries[e->link];
+                smart_printf(C_CYAN, "Moved: ", "%.*s -> %.*s\n", (int)e->len, e->path, (int)to->len, to->path);
+                moved++;
+            }
+        } else if (c > 0) {
+            const compare_entry *e = &b->entries[j++];
+            if (e->link != COMPARE_NONE) continue;   // Reported with its old path
+            smart_printf(C_GREEN, "Added: ", "%.*s\n", (int)e->len, e->path);
+            added++;
+        } else {
+            const compare_entry *e = &a->entries[i++], *now = &b->entries[j++];
+            if (e->hash == now->hash) {
+                same++;
+                continue;
+            }
+            smart_printf(C_YELLOW, "Changed: ", "%.*s (was %016llx, now %016llx)\n", (int)e->len, e->path, e->hash, now->hash);
+            changed++;
+        }
+    }
+
+    printf(C_YELLOW "Compare: " C_RESET "%'llu unchanged, %'llu changed, %'llu moved, %'llu added, %'llu removed.\n",
+           same, changed, moved, added, removed);
+    if (log_fp) {
+        fprintf(log_fp, "Compare: %'llu unchanged, %'llu changed, %'llu moved, %'llu added, %'llu removed.\n",
+                same, changed, moved, added, removed);
+    }
+    *paths = same + changed + moved + added + removed;
+    return changed + moved + added + removed > 0;
+}
+
+void compare_free(compare_log *c) {
+    if (!c) return;
+    if (c->data) munmap((void *)c->data, c->len);
+    for (compare_chunk *k = c->names, *next; k; k = next) {
+        next = k->next;
+        free(k);
+    }
+    free(c->entries);
+    free(c);
+}
+
+/* ================= WATCH DAEMON ================= */
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_EXCL_UNLINK)
+
+static volatile sig_atomic_t watch_stop = 0;
+
+static void watch_on_signal(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+/**
+ * watch_init: Creates the inotify instance and, if socket_path is given, a
+ * listening unix socket that subscribers connect to. Returns 0 on success.
+ */
+int watch_init(gh_watch *w, const char *socket_path) {
+    memset(w, 0, sizeof(*w));
+    w->listen_fd = -1;
+    w->socket_path = socket_path;
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd == -1) {
+        fprintf(stderr, C_RED "Error:" C_RESET " inotify unavailable (%s).\n", strerror(errno));
+        return -1;
+    }
+    if (!socket_path) return 0;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Socket path too long: %s\n", socket_path);
+        close(w->fd);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+    w->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (w->listen_fd == -1 || bind(w->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(w->listen_fd, 16) != 0) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Could not listen on " C_YELLOW "%s" C_RESET " (%s).\n", socket_path, strerror(errno));
+        if (w->listen_fd != -1) close(w->listen_fd);
+        close(w->fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void watch_set_dir(gh_watch *w, int wd, const char *path) {
+    if (wd >= w->dirs_cap) {
+        int cap = w->dirs_cap ? w->dirs_cap : 1024;
+        while (cap <= wd) cap *= 2;
+        char **d = realloc(w->dirs, (size_t)cap * sizeof(char *));
+        if (!d) return;
+        memset(d + w->dirs_cap, 0, (size_t)(cap - w->dirs_cap) * sizeof(char *));
+        w->dirs = d;
+        w->dirs_cap = cap;
+    }
+    free(w->dirs[wd]);
+    w->dirs[wd] = strdup(path);
+}
+
+static int path_has_prefix(const char *path, const char *prefix, size_t len) {
+    return strncmp(path, prefix, len) == 0 && (path[len] == '\0' || path[len] == '/');
+}
+
+/**
+ * watch_move_prefix: A watched directory was renamed from `from` to `to`.
+ * Watch descriptors follow the inode, so only the stored paths need fixing.
+ */
+static void watch_move_prefix(gh_watch *w, const char *from, const char *to) {
+    size_t flen = strlen(from);
+    for (int wd = 0; wd < w->dirs_cap; wd++) {
+        char *old = w->dirs[wd];
+        if (!old || !path_has_prefix(old, from, flen)) continue;
+        size_t need = strlen(to) + strlen(old + flen) + 1;
+        char *moved = malloc(need);
+        if (!moved) continue;
+        snprintf(moved, need, "%s%s", to, old + flen);
+        free(old);
+        w->dirs[wd] = moved;
+    }
+}
+
+/**
+ * watch_drop_prefix: A watched directory left the tree; stop watching it.
+ */
+static void watch_drop_prefix(gh_watch *w, const char *prefix) {
+    size_t len = strlen(prefix);
+    for (int wd = 0; wd < w->dirs_cap; wd++) {
+        if (!w->dirs[wd] || !path_has_prefix(w->dirs[wd], prefix, len)) continue;
+        inotify_rm_watch(w->fd, wd);
+        free(w->dirs[wd]);
+        w->dirs[wd] = NULL;
+    }
+}
+
+static void watch_broadcast(gh_watch *w, const char *line, size_t len) {
+    for (int i = 0; i < w->nclients;) {
+        // A subscriber that cannot keep up with the socket buffer is dropped
+        if (send(w->clients[i], line, len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)len) {
+            close(w->clients[i]);
+            w->clients[i] = w->clients[--w->nclients];
+            continue;
+        }
+        i++;
+    }
+}
+
+/**
+ * watch_hash: Rehashes one changed file and publishes the result.
+ */
+static void watch_hash(gh_watch *w, scan_ctx *ctx, const char *path) {
+    struct stat st;
+    if (lstat(path, &st) != 0 || !S_ISREG(st.st_mode)) return;
+    if (!ctx->ignore_ext && !gh_ext_match(&ext_filter, path)) return;
+
+    struct stat hst;
+    unsigned long long h = hash_with_cache(ctx->cache, path, &st, &hst);
+    (*ctx->total)++;
+    if (h == 0) return;
+    (*ctx->succeeded)++;
+    *ctx->total_sz += (unsigned long long)hst.st_size;
+    emit_result(h, &hst, path);
+
+    if (w->nclients > 0) {
+        size_t len = strlen(path);
+        char *line = malloc(len + 20);
+        if (!line) return;
+        char *p = put_hex64(line, h);
+        *p++ = ' ';
+        *p++ = ' ';
+        memcpy(p, path, len);
+        p[len] = '\n';
+        watch_broadcast(w, line, (size_t)(p - line) + len + 1);
+        free(line);
+    }
+}
+
+/* Recursion of watch_tree(): *buf holds the path being looked at, len bytes long. */
+static void watch_tree_at(gh_watch *w, char **buf, size_t *cap, size_t len, scan_ctx *ctx) {
+    const char *path = *buf;
+    struct stat st;
+    if (lstat(path, &st) != 0) return;
+    if (S_ISREG(st.st_mode)) {
+        if (ctx) watch_hash(w, ctx, path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) return;
+
+    int wd = inotify_add_watch(w->fd, path, WATCH_MASK | IN_ONLYDIR);
+    if (wd >= 0) {
+        watch_set_dir(w, wd, path);
+    } else if (!w->warned_limit) {
+        fprintf(stderr, C_YELLOW "Warning:" C_RESET " Cannot watch '%s' (%s)%s\n", path, strerror(errno),
+                errno == ENOSPC ? "; raise fs.inotify.max_user_watches" : "");
+        w->warned_limit = 1;
+    }
+
+    DIR *dir = opendir(path);
+    if (!dir) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN && !ctx) continue;
+        size_t n = strlen(entry->d_name), need = len + 1 + n + 1;
+        if (need > *cap) {
+            char *grown = realloc(*buf, need * 2);
+            if (!grown) continue;
+            *buf = grown;
+            *cap = need * 2;
+        }
+        (*buf)[len] = '/';
+        memcpy(*buf + len + 1, entry->d_name, n + 1);
+        watch_tree_at(w, buf, cap, len + 1 + n, ctx);
+        (*buf)[len] = '\0';
+    }
+    closedir(dir);
+}
+
+/**
+ * watch_tree: Adds a watch on every directory under path. With ctx set, the
+ * regular files found on the way are hashed too (directories that appeared
+ * after the initial scan). One path buffer serves the whole tree.
+ */
+void watch_tree(gh_watch *w, const char *path, scan_ctx *ctx) {
+    size_t len = strlen(path), cap = len + 256;
+    char *buf = malloc(cap);
+    if (!buf) return;
+    memcpy(buf, path, len + 1);
+    watch_tree_at(w, &buf, &cap, len, ctx);
+    free(buf);
+}
+
+/**
+ * watch_event: Acts on one inotify event. Files are rehashed when they are
+ * closed after writing or renamed into the tree; new directories are
+ * watched and scanned.
+ */
+static void watch_event(gh_watch *w, scan_ctx *ctx, const struct inotify_event *ev) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        fprintf(stderr, C_YELLOW "Warning:" C_RESET " inotify queue overflowed, rescanning.\n");
+        for (int i = 0; i < w->nroots; i++) watch_tree(w, w->roots[i], ctx);
+        return;
+    }
+    if (ev->wd < 0 || ev->wd >= w->dirs_cap) return;
+    if (ev->mask & IN_IGNORED) {
+        free(w->dirs[ev->wd]);
+        w->dirs[ev->wd] = NULL;
+        return;
+    }
+    const char *dir = w->dirs[ev->wd];
+    if (!dir || ev->len == 0) return;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, ev->name);
+
+    // A directory that moved out and did not reappear in the next event left the tree
+    if (w->move_from && !((ev->mask & IN_MOVED_TO) && ev->cookie == w->move_cookie)) {
+        watch_drop_prefix(w, w->move_from);
+        free(w->move_from);
+        w->move_from = NULL;
+    }
+
+    if (ev->mask & IN_ISDIR) {
+        if (ev->mask & IN_MOVED_FROM) {
+            w->move_from = strdup(path);
+            w->move_cookie = ev->cookie;
+        } else if (ev->mask & (IN_MOVED_TO | IN_CREATE)) {
+            if (w->move_from) {
+                watch_move_prefix(w, w->move_from, path);
+                free(w->move_from);
+                w->move_from = NULL;
+            }
+            watch_tree(w, path, ctx);
+        }
+    } else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        watch_hash(w, ctx, path);
+    }
+}
+
+/**
+ * watch_run: The daemon loop. Waits for filesystem events and subscribers
+ * until SIGINT or SIGTERM, flushing the output after every batch.
+ */
+void watch_run(gh_watch *w, scan_ctx *ctx) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = watch_on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigset_t block, orig;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &orig);
+
+    char *buf = malloc(WATCH_EVENT_BUF);
+    if (!buf) return;
+    out_flush();
+
+    while (!watch_stop) {
+        struct pollfd fds[2 + WATCH_CLIENTS_MAX];
+        int nfds = 0;
+        fds[nfds++] = (struct pollfd){ w->fd, POLLIN, 0 };
+        if (w->listen_fd != -1) fds[nfds++] = (struct pollfd){ w->listen_fd, POLLIN, 0 };
+        int first_client = nfds;
+        for (int i = 0; i < w->nclients; i++) fds[nfds++] = (struct pollfd){ w->clients[i], POLLIN, 0 };
+
+        // Signals are only delivered inside ppoll, so a stop request is never missed
+        if (ppoll(fds, (nfds_t)nfds, NULL, &orig) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // Subscribers only listen; any input is discarded, EOF disconnects them
+        for (int i = nfds - 1; i >= first_client; i--) {
+            if (!fds[i].revents) continue;
+            char junk[256];
+            ssize_t n = recv(fds[i].fd, junk, sizeof(junk), MSG_DONTWAIT);
+            if (n > 0 || (n < 0 && errno == EAGAIN)) continue;
+            int k = i - first_client;
+            close(w->clients[k]);
+            w->clients[k] = w->clients[--w->nclients];
+        }
+
+        if (fds[0].revents & POLLIN) {
+            ssize_t n;
+            while ((n = read(w->fd, buf, WATCH_EVENT_BUF)) > 0) {
+                for (ssize_t off = 0; off < n;) {
+                    const struct inotify_event *ev = (const struct inotify_event *)(buf + off);
+                    watch_event(w, ctx, ev);
+                    off += (ssize_t)sizeof(struct inotify_event) + ev->len;
+                }
+            }
+            out_flush();
+        }
+        if (w->listen_fd != -1 && (fds[1].revents & POLLIN)) {
+            int c;
+            while ((c = accept4(w->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+                if (w->nclients == WATCH_CLIENTS_MAX) { close(c); continue; }
+                w->clients[w->nclients++] = c;
+            }
+        }
+    }
+    free(buf);
+    pthread_sigmask(SIG_SETMASK, &orig, NULL);
+}
+
+void watch_free(gh_watch *w) {
+    for (int i = 0; i < w->nclients; i++) close(w->clients[i]);
+    if (w->listen_fd != -1) {
+        close(w->listen_fd);
+        unlink(w->socket_path);
+    }
+    for (int wd = 0; wd < w->dirs_cap; wd++) free(w->dirs[wd]);
+    free(w->dirs);
+    free(w->roots);
+    free(w->move_from);
+    close(w->fd);
+}
+
+/* ================= PARALLEL WALKER ================= */
+
+enum { NODE_QUEUED, NODE_LISTING, NODE_LISTED };
+
+typedef struct walk_node walk_node;
+
+typedef struct {
+    uint32_t name_off;     // Offset into the owning node's name arena
+    walk_node *child;      // Set for subdirectories, NULL for files
+} walk_entry;
+
+struct walk_node {
+    char *path;
+    walk_node *parent;     // Outlives the listing of its children
+    uint64_t dev, ino;     // -L: set by the lister, for cycles and inode_index
+    int fd;                // Opened by the parent's lister, or -1
+    int state;
+    int refs;              // Held by the emitter and, until popped, by a deque
+    walk_entry *entries;
+    size_t count, cap;
+    char *names;
+    size_t names_len, names_cap;
+    struct stat *stats;    // Per-entry metadata, only when the cache needs it
+};
+
+typedef struct {
+    walk_node **items;
+    size_t top, bottom, cap;   // Owner pushes/pops at bottom, thieves take from top
+    pthread_mutex_t lock;
+} walk_deque;
+
+typedef struct walker {
+    int nthreads;
+    int ignore_ext;
+    int need_stat;
+    int follow;            // -L
+    walk_deque deques[WALK_THREADS_MAX];
+    pthread_t threads[WALK_THREADS_MAX];
+    long pending;          // Queued nodes not yet claimed (atomic)
+    long open_fds;         // Directory fds currently held (atomic)
+    long buffered;         // Listed entries not yet emitted
+    long unlisted;         // Directory nodes not yet listed (atomic), for progress_listed()
+    int done;
+    pthread_mutex_t lock;  // Guards state changes, buffered and done
+    pthread_cond_t work_cv;
+    pthread_cond_t listed_cv;
+    pthread_cond_t drain_cv;
+} walker;
+
+typedef struct {
+    walker *w;
+    int id;
+} walk_thread_arg;
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static walk_node *walk_node_new(const char *parent, const char *name) {
+    walk_node *n = calloc(1, sizeof(walk_node));
+    if (!n) return NULL;
+    if (parent) {
+        size_t len = strlen(parent) + strlen(name) + 2;
+        n->path = malloc(len);
+        if (n->path) snprintf(n->path, len, "%s/%s", parent, name);
+    } else {
+        n->path = strdup(name);
+    }
+    if (!n->path) { free(n); return NULL; }
+    n->fd = -1;
+    n->state = NODE_QUEUED;
+    n->refs = parent ? 2 : 1;
+    return n;
+}
+
+static void walk_node_free(walk_node *n) {
+    if (n->fd >= 0) close(n->fd);
+    free(n->path);
+    free(n->entries);
+    free(n->names);
+    free(n->stats);
+    free(n);
+}
+
+/**
+ * walk_node_unref: Drops one reference, freeing the node on the last one.
+ */
+static void walk_node_unref(walker *w, walk_node *n) {
+    pthread_mutex_lock(&w->lock);
+    int last = --n->refs == 0;
+    pthread_mutex_unlock(&w->lock);
+    if (last) walk_node_free(n);
+}
+
+static int walk_node_add(walker *w, walk_node *n, const char *name, walk_node *child, const struct stat *st) {
+    if (n->count == n->cap) {
+        size_t cap = n->cap ? n->cap * 2 : 64;
+        walk_entry *e = realloc(n->entries, cap * sizeof(walk_entry));
+        if (!e) return -1;
+        n->entries = e;
+        if (w->need_stat) {
+            struct stat *sts = realloc(n->stats, cap * sizeof(struct stat));
+            if (!sts) return -1;
+            n->stats = sts;
+        }
+        n->cap = cap;
+    }
+    size_t len = strlen(name) + 1;
+    if (n->names_len + len > n->names_cap) {
+        size_t cap = n->names_cap ? n->names_cap * 2 : 1024;
+        while (cap < n->names_len + len) cap *= 2;
+        char *names = realloc(n->names, cap);
+        if (!names) return -1;
+        n->names = names;
+        n->names_cap = cap;
+    }
+    memcpy(n->names + n->names_len, name, len);
+    n->entries[n->count].name_off = (uint32_t)n->names_len;
+    n->entries[n->count].child = child;
+    if (w->need_stat && st) n->stats[n->count] = *st;
+    n->names_len += len;
+    n->count++;
+    if (child) __atomic_add_fetch(&w->unlisted, 1, __ATOMIC_RELAXED);
+    else if (thread_progress) progress_add(&thread_progress->found, 1);
+    return 0;
+}
+
+static void deque_push(walk_deque *d, walk_node *n) {
+    pthread_mutex_lock(&d->lock);
+    if (d->top > 0 && d->bottom == d->cap) {
+        memmove(d->items, d->items + d->top, (d->bottom - d->top) * sizeof(walk_node *));
+        d->bottom -= d->top;
+        d->top = 0;
+    }
+    if (d->bottom == d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 256;
+        walk_node **items = realloc(d->items, cap * sizeof(walk_node *));
+        if (!items) { pthread_mutex_unlock(&d->lock); return; }
+        d->items = items;
+        d->cap = cap;
+    }
+    d->items[d->bottom++] = n;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static walk_node *deque_pop(walk_deque *d, int steal) {
+    walk_node *n = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) n = steal ? d->items[d->top++] : d->items[--d->bottom];
+    if (d->top == d->bottom) d->top = d->bottom = 0;
+    pthread_mutex_unlock(&d->lock);
+    return n;
+}
+
+/**
+ * walk_list: Reads one directory with getdents64 and records its entries.
+ * Subdirectories become new nodes pushed to deque `id`.
+ */
+static void walk_list(walker *w, walk_node *n, int id) {
+    gh_stats *sx = thread_stats;
+    uint64_t mark = sx ? stats_now() : 0;
+    int fd = n->fd;
+    n->fd = -1;
+    if (fd < 0) {
+        fd = open(n->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    } else {
+        __atomic_sub_fetch(&w->open_fds, 1, __ATOMIC_RELAXED);
+    }
+    struct stat dst;
+    if (fd >= 0 && w->follow && fstat(fd, &dst) == 0) {
+        n->dev = (uint64_t)dst.st_dev;
+        n->ino = (uint64_t)dst.st_ino;
+        for (const walk_node *a = n->parent; a; a = a->parent) {
+            if (a->dev == n->dev && a->ino == n->ino) {
+                close(fd);   // A link back to an ancestor: leave it empty, as gh_walk_follow() does
+                fd = -1;
+                n->ino = 0;
+                break;
+            }
+        }
+    }
+
+    walk_node **children = NULL;
+    size_t nchildren = 0, children_cap = 0;
+    if (fd >= 0) {
+        char *buf = malloc(DENTS_BUF_SIZE);
+        long nread;
+        while (buf && (nread = syscall(SYS_getdents64, fd, buf, DENTS_BUF_SIZE)) > 0) {
+            for (long off = 0; off < nread;) {
+                struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+                off += d->d_reclen;
+                const char *name = d->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+                struct stat st;
+                int have_st = 0;
+                unsigned char type = d->d_type;
+                if (type == DT_UNKNOWN || (type == DT_LNK && w->follow)) {
+                    if (fstatat(fd, name, &st, w->follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0) continue;
+                    have_st = 1;
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+                }
+
+                if (type == DT_DIR) {
+                    walk_node *child = walk_node_new(n->path, name);
+                    if (!child) continue;
+                    child->parent = n;
+                    if (__atomic_add_fetch(&w->open_fds, 1, __ATOMIC_RELAXED) <= WALK_FD_BUDGET) {
+                        child->fd = openat(fd, name, O_RDONLY | O_DIRECTORY | (w->follow ? 0 : O_NOFOLLOW) | O_CLOEXEC);
+                    }
+                    if (child->fd < 0) __atomic_sub_fetch(&w->open_fds, 1, __ATOMIC_RELAXED);
+                    if (walk_node_add(w, n, name, child, NULL) != 0) { walk_node_free(child); continue; }
+                    if (nchildren == children_cap) {
+                        children_cap = children_cap ? children_cap * 2 : 16;
+                        walk_node **c = realloc(children, children_cap * sizeof(walk_node *));
+                        if (!c) { children_cap = nchildren; continue; }
+                        children = c;
+                    }
+                    children[nchildren++] = child;
+                } else if (type == DT_REG) {
+                    if (!w->ignore_ext && !gh_ext_match(&ext_filter, name)) continue;
+                    if (w->need_stat && !have_st) {
+                        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                        have_st = 1;
+                    }
+                    walk_node_add(w, n, name, NULL, have_st ? &st : NULL);
+                }
+            }
+        }
+        free(buf);
+        close(fd);
+    }
+
+    // Push in reverse so the owner pops the first subdirectory first,
+    // which is also the first one the emitter will need.
+    __atomic_add_fetch(&w->pending, (long)nchildren, __ATOMIC_RELAXED);
+    for (size_t i = nchildren; i > 0; i--) deque_push(&w->deques[id], children[i - 1]);
+    free(children);
+    if (sx) {
+        stats_lap(sx, PHASE_WALK, &mark);
+        sx->dirs++;
+    }
+
+    // Children were counted when they were added, so this only reaches 0 with the tree listed
+    if (__atomic_sub_fetch(&w->unlisted, 1, __ATOMIC_RELAXED) == 0) progress_listed();
+
+    pthread_mutex_lock(&w->lock);
+    n->state = NODE_LISTED;
+    w->buffered += (long)n->count;
+    pthread_cond_broadcast(&w->listed_cv);
+    if (nchildren > 0) pthread_cond_broadcast(&w->work_cv);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/**
+ * walk_try_claim: Moves a node from QUEUED to LISTING. Returns 1 if this thread won it.
+ */
+static int walk_try_claim(walker *w, walk_node *n) {
+    int won = 0;
+    pthread_mutex_lock(&w->lock);
+    if (n->state == NODE_QUEUED) {
+        n->state = NODE_LISTING;
+        won = 1;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return won;
+}
+
+static void *walk_thread(void *arg) {
+    walk_thread_arg *a = arg;
+    walker *w = a->w;
+    int id = a->id;
+    stats_thread("walk");
+    progress_walker(id);
+
+    for (;;) {
+        walk_node *n = deque_pop(&w->deques[id], 0);
+        for (int k = 1; !n && k < w->nthreads; k++) {
+            n = deque_pop(&w->deques[(id + k) % w->nthreads], 1);
+        }
+        if (!n) {
+            pthread_mutex_lock(&w->lock);
+            while (!w->done && __atomic_load_n(&w->pending, __ATOMIC_RELAXED) == 0) {
+                pthread_cond_wait(&w->work_cv, &w->lock);
+            }
+            int done = w->done;
+            pthread_mutex_unlock(&w->lock);
+            if (done) break;
+            continue;
+        }
+        __atomic_sub_fetch(&w->pending, 1, __ATOMIC_RELAXED);
+
+        pthread_mutex_lock(&w->lock);
+        while (!w->done && w->buffered > WALK_BUFFER_MAX) pthread_cond_wait(&w->drain_cv, &w->lock);
+        int claimed = !w->done && n->state == NODE_QUEUED;
+        if (claimed) n->state = NODE_LISTING;
+        pthread_mutex_unlock(&w->lock);
+
+        if (claimed) walk_list(w, n, id);
+        walk_node_unref(w, n);
+    }
+    return NULL;
+}
+
+/**
+ * walk_emit: Emits a listed directory depth-first in readdir order, then frees it.
+ * Lists the node itself when no walk thread has claimed it yet. With -L, a
+ * directory already emitted under another path is only drained (skip).
+ */
+static void walk_emit(walker *w, walk_node *n, scan_ctx *ctx, int skip, char **pbuf, size_t *pcap) {
+    if (walk_try_claim(w, n)) {
+        walk_list(w, n, 0);
+    } else {
+        pthread_mutex_lock(&w->lock);
+        while (n->state != NODE_LISTED) pthread_cond_wait(&w->listed_cv, &w->lock);
+        pthread_mutex_unlock(&w->lock);
+    }
+    if (!skip && w->follow && inode_index && n->ino) {
+        // Decided here, in emit order, so the same path wins every run
+        struct stat dst = { .st_dev = (dev_t)n->dev, .st_ino = (ino_t)n->ino };
+        if (inode_add(inode_index, &dst, INODE_DIR, NULL) == INODE_DIR) {
+            inode_index->dirs++;
+            skip = 1;
+        }
+    }
+
+    size_t plen = strlen(n->path);
+    for (size_t i = 0; i < n->count; i++) {
+        walk_entry *e = &n->entries[i];
+        if (e->child) {
+            walk_emit(w, e->child, ctx, skip, pbuf, pcap);
+            continue;
+        }
+        if (skip) continue;
+        const char *name = n->names + e->name_off;
+        size_t need = plen + strlen(name) + 2;
+        if (need > *pcap) {
+            char *b = realloc(*pbuf, need * 2);
+            if (!b) continue;
+            *pbuf = b;
+            *pcap = need * 2;
+        }
+        memcpy(*pbuf, n->path, plen);
+        (*pbuf)[plen] = '/';
+        strcpy(*pbuf + plen + 1, name);
+        scan_file(ctx, *pbuf, n->stats ? &n->stats[i] : NULL);
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->buffered -= (long)n->count;
+    if (w->buffered <= WALK_BUFFER_MAX) pthread_cond_broadcast(&w->drain_cv);
+    pthread_mutex_unlock(&w->lock);
+    walk_node_unref(w, n);
+}
+
+/**
+ * walk_tree: Scans path with the parallel walker. Behaves like
+ * process_path_recursive() for the root (symlinks skipped, files hashed directly).
+ */
+void walk_tree(const char *path, int nthreads, scan_ctx *ctx) {
+    ctx->root_len = strlen(path);
+    struct stat st;
+    if ((ctx->follow ? stat(path, &st) : lstat(path, &st)) != 0) return;
+    if (S_ISREG(st.st_mode)) {
+        if (ctx->ignore_ext || gh_ext_match(&ext_filter, path)) {
+            if (thread_progress) progress_add(&thread_progress->found, 1);
+            scan_file(ctx, path, &st);
+        }
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) return;
+
+    walker *w = calloc(1, sizeof(walker));
+    walk_node *root = walk_node_new(NULL, path);
+    if (!w || !root) {
+        free(w);
+        if (root) walk_node_free(root);
+        return;
+    }
+    w->nthreads = nthreads;
+    w->unlisted = 1;   // The root
+    w->ignore_ext = ctx->ignore_ext;
+    w->need_stat = ctx->cache != NULL || ctx->sizes != NULL || inode_index != NULL;   // inode_index needs st_nlink
+    w->follow = ctx->follow;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->work_cv, NULL);
+    pthread_cond_init(&w->listed_cv, NULL);
+    pthread_cond_init(&w->drain_cv, NULL);
+    for (int i = 0; i < nthreads; i++) pthread_mutex_init(&w->deques[i].lock, NULL);
+
+    walk_thread_arg args[WALK_THREADS_MAX];
+    int started = 0;
+    for (int i = 0; i < nthreads; i++) {
+        args[i].w = w;
+        args[i].id = i;
+        if (pthread_create(&w->threads[i], NULL, walk_thread, &args[i]) != 0) break;
+        started++;
+    }
+
+    char *pbuf = NULL;
+    size_t pcap = 0;
+    walk_emit(w, root, ctx, 0, &pbuf, &pcap);
+    free(pbuf);
+
+    pthread_mutex_lock(&w->lock);
+    w->done = 1;
+    pthread_cond_broadcast(&w->work_cv);
+    pthread_cond_broadcast(&w->drain_cv);
+    pthread_mutex_unlock(&w->lock);
+    for (int i = 0; i < started; i++) pthread_join(w->threads[i], NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        walk_node *n;
+        while ((n = deque_pop(&w->deques[i], 0)) != NULL) walk_node_unref(w, n);
+        free(w->deques[i].items);
+        pthread_mutex_destroy(&w->deques[i].lock);
+    }
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->work_cv);
+    pthread_cond_destroy(&w->listed_cv);
+    pthread_cond_destroy(&w->drain_cv);
+    free(w);
+}
+
+void smart_printf(const char *color, const char *prefix, const char *fmt, ...) {
+    va_list args;
+    if (!silent_mode) {
+        printf("%s%s" C_RESET, color, prefix);
+        va_start(args, fmt);
+        vprintf(fmt, args);
+        va_end(args);
+    }
+    if (log_fp) {
+        fprintf(log_fp, "%s", prefix);
+        va_start(args, fmt);
+        vfprintf(log_fp, fmt, args); 
+        va_end(args);
+    }
+}
+
+void print_separator(int length, const char* color, char symbol) {
+    if (length < 0) length = 0;
+    size_t n = (size_t)length + 8;
+    char stack_line[256];
+    char *line = n + 1 <= sizeof(stack_line) ? stack_line : malloc(n + 1);
+    if (!line) return;
+    memset(line, symbol, n);
+    line[n] = '\n';
+
+    if (!silent_mode) {
+        fputs(color, stdout);
+        fwrite(line, 1, n, stdout);
+        fputs(C_RESET "\n", stdout);
+    }
+    if (log_fp) fwrite(line, 1, n + 1, log_fp);
+    if (line != stack_line) free(line);
+}
+
+static uint64_t mtime_ns(const struct stat *st) {
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ULL + (uint64_t)st->st_mtim.tv_nsec;
+}
+
+static uint64_t cache_slot_of(uint64_t dev, uint64_t ino, uint32_t variant, uint64_t capacity) {
+    uint64_t k = (ino ^ (dev << 32) ^ ((uint64_t)variant << 56)) * 0x9e3779b97f4a7c15ULL;
+    return (k ^ (k >> 29)) & (capacity - 1);
+}
+
+/**
+ * cache_map: Creates (or maps) a table file with the given capacity.
+ */
+static int cache_map(const char *path, uint64_t capacity, int create, int *out_fd, cache_header **out_hdr, size_t *out_size) {
+    int fd = open(path, O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644);
+    if (fd == -1) return -1;
+
+    size_t size;
+    if (create) {
+        size = sizeof(cache_header) + capacity * sizeof(cache_entry);
+        if (ftruncate(fd, (off_t)size) != 0) { close(fd); return -1; }
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(cache_header)) { close(fd); return -1; }
+        size = (size_t)st.st_size;
+    }
+
+    cache_header *hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED) { close(fd); return -1; }
+
+    if (create) {
+        memcpy(hdr->magic, CACHE_MAGIC, 8);
+        hdr->version = 1;
+        hdr->run = 0;
+        hdr->capacity = capacity;
+        hdr->count = 0;
+    } else if (memcmp(hdr->magic, CACHE_MAGIC, 8) != 0 || hdr->version != 1 ||
+               hdr->capacity == 0 || (hdr->capacity & (hdr->capacity - 1)) != 0 ||
+               size != sizeof(cache_header) + hdr->capacity * sizeof(cache_entry)) {
+        munmap(hdr, size);
+        close(fd);
+        return -1;
+    }
+    *out_fd = fd;
+    *out_hdr = hdr;
+    *out_size = size;
+    return 0;
+}
+
+/**
+ * cache_rebuild: Rewrites the table into a fresh file of new_capacity slots,
+ * keeping only entries that pass the age filter, then renames it into place.
+ */
+static int cache_rebuild(fp_cache *c, uint64_t new_capacity, uint32_t min_run) {
+    size_t tmp_len = strlen(c->path) + 5;
+    char *tmp = malloc(tmp_len);
+    if (!tmp) return -1;
+    snprintf(tmp, tmp_len, "%s.tmp", c->path);
+
+    int fd;
+    cache_header *hdr;
+    size_t size;
+    if (cache_map(tmp, new_capacity, 1, &fd, &hdr, &size) != 0) { free(tmp); return -1; }
+
+    cache_entry *slots = (cache_entry *)(hdr + 1);
+    hdr->run = c->hdr->run;
+    for (uint64_t i = 0; i < c->hdr->capacity; i++) {
+        cache_entry *e = &c->slots[i];
+        if (e->last_run == 0 || e->last_run < min_run) continue;
+        uint64_t j = cache_slot_of(e->dev, e->ino, e->variant, new_capacity);
+        while (slots[j].last_run != 0) j = (j + 1) & (new_capacity - 1);
+        slots[j] = *e;
+        hdr->count++;
+    }
+
+    if (rename(tmp, c->path) != 0) {
+        munmap(hdr, size);
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+    munmap(c->hdr, c->map_size);
+    close(c->fd);
+    c->fd = fd;
+    c->hdr = hdr;
+    c->slots = slots;
+    c->map_size = size;
+    return 0;
+}
+
+/**
+ * cache_default_path: $XDG_CACHE_HOME/gh/fingerprints or ~/.cache/gh/fingerprints.
+ * Creates the directories on the way. Returns a malloc'd string or NULL.
+ */
+char *cache_default_path(void) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[PATH_MAX];
+    if (xdg && xdg[0]) {
+        snprintf(dir, sizeof(dir), "%s", xdg);
+    } else if (home && home[0]) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+    } else {
+        return NULL;
+    }
+    mkdir(dir, 0755);
+    size_t len = strlen(dir);
+    snprintf(dir + len, sizeof(dir) - len, "/gh");
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return NULL;
+
+    size_t out_len = strlen(dir) + sizeof("/fingerprints");
+    char *out = malloc(out_len);
+    if (out) snprintf(out, out_len, "%s/fingerprints", dir);
+    return out;
+}
+
+/**
+ * cache_open: Maps the table at path (creating it if needed) and takes an
+ * exclusive lock for the run. Returns NULL if the cache cannot be used.
+ */
+fp_cache *cache_open(const char *path, uint32_t variant) {
+    fp_cache *c = calloc(1, sizeof(fp_cache));
+    if (!c) return NULL;
+    c->path = strdup(path);
+    c->variant = variant;
+
+    size_t lock_len = strlen(path) + 6;
+    char *lock_path = malloc(lock_len);
+    if (!c->path || !lock_path) goto fail;
+    snprintf(lock_path, lock_len, "%s.lock", path);
+    c->lock_fd = open(lock_path, O_RDWR | O_CREAT, 0644);
+    free(lock_path);
+    if (c->lock_fd == -1) goto fail;
+    if (flock(c->lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, C_YELLOW "Warning:" C_RESET " Cache is in use by another gh, running without it.\n");
+        close(c->lock_fd);
+        goto fail;
+    }
+
+    if (cache_map(path, 0, 0, &c->fd, &c->hdr, &c->map_size) != 0 &&
+        cache_map(path, CACHE_MIN_SLOTS, 1, &c->fd, &c->hdr, &c->map_size) != 0) {
+        close(c->lock_fd);
+        goto fail;
+    }
+    c->slots = (cache_entry *)(c->hdr + 1);
+    c->hdr->run++;
+    if (c->hdr->run == 0) c->hdr->run = 1;
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+
+fail:
+    free(c->path);
+    free(c);
+    return NULL;
+}
+
+/**
+ * cache_lookup: Returns 1 and the stored hash when dev/ino are known and
+ * size/mtime still match.
+ */
+int cache_lookup(fp_cache *c, const struct stat *st, unsigned long long *hash) {
+    uint64_t dev = (uint64_t)st->st_dev, ino = (uint64_t)st->st_ino;
+    int hit = 0;
+
+    pthread_mutex_lock(&c->lock);
+    uint64_t mask = c->hdr->capacity - 1;
+    for (uint64_t i = cache_slot_of(dev, ino, c->variant, c->hdr->capacity);; i = (i + 1) & mask) {
+        cache_entry *e = &c->slots[i];
+        if (e->last_run == 0) break;
+        if (e->dev == dev && e->ino == ino && e->variant == c->variant) {
+            if (e->size == (uint64_t)st->st_size && e->mtime_ns == (int64_t)mtime_ns(st)) {
+                e->last_run = c->hdr->run;
+                *hash = e->hash;
+                hit = 1;
+            }
+            break;
+        }
+    }
+    if (hit) c->hits++;
+    else c->misses++;
+    pthread_mutex_unlock(&c->lock);
+    return hit;
+}
+
+/**
+ * cache_store: Inserts or refreshes the entry for st. Grows the table past 70%
+ * load; if it cannot, the cache is only read for the rest of the run, so the
+ * probes always end at an empty slot.
+ */
+void cache_store(fp_cache *c, const struct stat *st, unsigned long long hash) {
+    uint64_t dev = (uint64_t)st->st_dev, ino = (uint64_t)st->st_ino;
+
+    pthread_mutex_lock(&c->lock);
+    if (!c->read_only && (c->hdr->count + 1) * 10 > c->hdr->capacity * 7 &&
+        cache_rebuild(c, c->hdr->capacity * 2, 1) != 0) {
+        c->read_only = 1;
+        fprintf(stderr, C_YELLOW "Warning:" C_RESET " Could not grow cache %s, no new entries will be stored this run.\n", c->path);
+    }
+    if (c->read_only) {
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    uint64_t mask = c->hdr->capacity - 1;
+    uint64_t i = cache_slot_of(dev, ino, c->variant, c->hdr->capacity);
+    while (c->slots[i].last_run != 0 &&
+           !(c->slots[i].dev == dev && c->slots[i].ino == ino && c->slots[i].variant == c->variant)) {
+        i = (i + 1) & mask;
+    }
+    cache_entry *e = &c->slots[i];
+    if (e->last_run == 0) c->hdr->count++;
+    e->dev = dev;
+    e->ino = ino;
+    e->size = (uint64_t)st->st_size;
+    e->mtime_ns = (int64_t)mtime_ns(st);
+    e->hash = hash;
+    e->variant = c->variant;
+    e->last_run = c->hdr->run;
+    pthread_mutex_unlock(&c->lock);
+}
+
+/**
+ * cache_close: Drops expired entries (or every entry this run did not see
+ * when prune_unseen is set), then unmaps the table and releases the lock.
+ */
+void cache_close(fp_cache *c, int prune_unseen) {
+    uint32_t run = c->hdr->run;
+    uint32_t min_run = prune_unseen ? run : (run > CACHE_KEEP_RUNS ? run - CACHE_KEEP_RUNS : 1);
+
+    uint64_t live = 0, stale = 0;
+    for (uint64_t i = 0; i < c->hdr->capacity; i++) {
+        if (c->slots[i].last_run == 0) continue;
+        if (c->slots[i].last_run < min_run) stale++;
+        else live++;
+    }
+    if (stale > 0) {
+        uint64_t capacity = CACHE_MIN_SLOTS;
+        while (live * 10 > capacity * 7) capacity *= 2;
+        if (cache_rebuild(c, capacity, min_run) != 0) {
+            fprintf(stderr, C_YELLOW "Warning:" C_RESET " Could not prune cache %s\n", c->path);
+        }
+    }
+
+    munmap(c->hdr, c->map_size);
+    close(c->fd);
+    close(c->lock_fd);
+    pthread_mutex_destroy(&c->lock);
+    free(c->path);
+    free(c);
+}
+
+/* ================= HASHING ================= */
+
+/**
+ * hash_account: Hands back the identity fields of a gh_result the cache and
+ * --dupes use, and feeds --stats.
+ */
+static unsigned long long hash_account(unsigned long long hash, const gh_result *r, struct stat *out_st) {
+    memset(out_st, 0, sizeof(*out_st));
+    out_st->st_dev = (dev_t)r->dev;
+    out_st->st_ino = (ino_t)r->ino;
+    out_st->st_size = (off_t)r->size;
+    out_st->st_mtim.tv_sec = (time_t)r->mtime_sec;
+    out_st->st_mtim.tv_nsec = r->mtime_nsec;
+
+    gh_stats *sx = thread_stats;
+    if (sx) {
+        sx->phase_ns[PHASE_OPEN] += r->open_ns;
+        sx->phase_ns[PHASE_READ] += r->read_ns;
+        sx->phase_ns[PHASE_HASH] += r->hash_ns;
+        sx->bytes_read += r->bytes_read;
+        sx->failures += (uint64_t)r->read_errors + (r->error != 0);
+        if (r->error == 0) {
+            sx->opens++;
+            sx->reads += r->reads;
+            stats_latency(sx, r->open_ns + r->read_ns + r->hash_ns);
+        }
+    }
+    return hash;
+}
+
+/**
+ * hash_path_stat: gh_hash_path() with the command-line options, or
+ * gh_hash_full_path() under --full.
+ */
+unsigned long long hash_path_stat(const char *filename, struct stat *out_st) {
+    gh_result res;
+    unsigned long long hash = (hash_opts.flags & GH_FULL) ? gh_hash_full_path(&hash_opts, filename, &res)
+                                                          : gh_hash_path(&hash_opts, filename, &res);
+    return hash_account(hash, &res, out_st);
+}
+
+/**
+ * hash_fd_stat: gh_hash_fd() with the command-line options, for files the
+ * caller has already opened.
+ */
+unsigned long long hash_fd_stat(int fd, struct stat *out_st) {
+    gh_result res;
+    return hash_account(gh_hash_fd(&hash_opts, fd, &res), &res, out_st);
+}
+
+/**
+ * algo_variant: Kernel id stored in caches and binary logs. Full digests get
+ * GH_FULL_ID and v2 fingerprints GH_LAYOUT_V2_ID, so no two kinds of hash
+ * ever pass for one another.
+ */
+uint32_t algo_variant(void) {
+    if (hash_opts.flags & GH_FULL) return hash_opts.algo->id | GH_FULL_ID;   // Digests do not depend on the layout
+    return hash_opts.algo->id | (hash_opts.layout == GH_LAYOUT_V2 ? GH_LAYOUT_V2_ID : 0);
+}
+
+/**
+ * algo_suffix: The same distinction for the kernel name in log headers,
+ * "vec64-full" or "vec64-v2". v1 fingerprints keep the bare name.
+ */
+const char *algo_suffix(void) {
+    if (hash_opts.flags & GH_FULL) return "-full";
+    return hash_opts.layout == GH_LAYOUT_V2 ? "-v2" : "";
+}
+
+/**
+ * ext_filter_apply: Adds (--ext) or removes (--exclude-ext) a comma-separated
+ * list of extensions. Returns -1 after reporting the first one it cannot take.
+ */
+int ext_filter_apply(int add, const char *list) {
+    char ext[GH_EXT_MAX_LEN + 2];
+    for (const char *p = list;; p++) {
+        size_t n = strcspn(p, ",");
+        if (n > 0) {
+            int ok = n < sizeof(ext);
+            if (ok) {
+                memcpy(ext, p, n);
+                ext[n] = '\0';
+                if (add) ok = gh_ext_add(&ext_filter, ext) == 0;
+                else gh_ext_remove(&ext_filter, ext);
+            }
+            if (!ok) {
+                fprintf(stderr, C_RED "Error:" C_RESET " Cannot use extension '%.*s' (at most %d characters, %d extensions).\n",
+                        (int)n, p, GH_EXT_MAX_LEN, GH_EXT_SLOTS / 2);
+                return -1;
+            }
+        }
+        p += n;
+        if (*p == '\0') return 0;
+    }
+}
+
+/**
+ * option_has_value: 1 for options that consume the next argument, so later
+ * passes over argv can step over their values.
+ */
+static int option_has_value(const char *arg) {
+    static const char *const with_value[] = {
+        "-l", "--log", "-j", "--jobs", "--io", "--io-depth", "--cache-file", "--algo", "--files-from", "--socket",
+        "--pagecache", "--format", "--verify", "--ext", "--exclude-ext", "--shard", "--layout", "--prefetch",
+        "-W", "--walk-threads", "--mem-limit"
+    };
+    for (size_t i = 0; i < sizeof(with_value) / sizeof(with_value[0]); i++) {
+        if (strcmp(arg, with_value[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * parse_bytes: "512M", "4G", "64k" or a plain byte count. Returns 0 if s is
+ * not one.
+ */
+static int parse_bytes(const char *s, unsigned long long *out) {
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (end == s || errno) return 0;
+    int shift = 0;
+    switch (*end | 0x20) {
+    case 'k': shift = 10; end++; break;
+    case 'm': shift = 20; end++; break;
+    case 'g': shift = 30; end++; break;
+    case 't': shift = 40; end++; break;
+    }
+    if (*end == 'B' || *end == 'b') end++;
+    if (*end || n > (ULLONG_MAX >> shift)) return 0;
+    *out = n << shift;
+    return 1;
+}
+
+/* ================= MAIN ================= */
+
+int main(int argc, char *argv[]) {
+    setlocale(LC_NUMERIC, "en_US.UTF-8");
+    if (argc < 2) goto usage;
+    out_init();
+    gh_ext_defaults(&ext_filter);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int ignore_extension = 0;
+    int recursive_mode = 0;
+    int follow_links = 0;
+    int jobs = 1;
+    int jobs_given = 0;
+    int unordered = 0;
+    int io_mode = IO_SYNC;
+    int io_depth = IO_DEPTH_DEFAULT;
+    int walk_threads = 0;
+    int last_path = 0;   // Index of the last path argument
+    int dupe_mode = 0;
+    int confirm_dupes = 0;
+    unsigned long long mem_limit = 0;   // --mem-limit: halved between the size prefilter and the duplicate index
+    int size_filter = 1;
+    const char *files_from = NULL;
+    int watch_mode = 0;
+    const char *socket_path = NULL;
+    char list_delim = '\n';
+    const char *algo_name = "fnv1a";
+    int use_cache = 0;
+    int cache_prune = 0;
+    char *cache_filename = NULL;
+    int files_total = 0;
+    int files_succeeded = 0;
+    unsigned long long total_size_bytes = 0;
+    int max_display_len = 15;   // Grows with the longest File/Path printed so far
+    char *log_filename = NULL;
+    const char *verify_filename = NULL;
+    int fail_fast = 0;
+    unsigned shard = 0, shards = 1;
+    int merge_mode = 0;
+    int elevator_mode = 0;
+    int prefetch_depth = 0;
+    verify_list *merged = NULL;
+    int compare_mode = 0;
+    compare_log *compare_old = NULL, *compare_new = NULL;
+
+    /* First pass: Parse arguments */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--ignore") == 0) {
+            ignore_extension = 1;
+        } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--recursive") == 0) {
+            recursive_mode = 1;
+        } else if (strcmp(argv[i], "-L") == 0 || strcmp(argv[i], "--follow") == 0) {
+            follow_links = 1;
+        } else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--log") == 0) {
+            if (i + 1 < argc) log_filename = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--silent") == 0) {
+            silent_mode = 1;
+        } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 < argc) jobs = atoi(argv[++i]);
+            jobs_given = 1;
+            if (jobs < 1 || jobs > JOBS_MAX) {
+                fprintf(stderr, C_RED "Error:" C_RESET " -j expects a thread count between 1 and %d.\n", JOBS_MAX);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--unordered") == 0) {
+            unordered = 1;
+        } else if (strcmp(argv[i], "--io") == 0) {
+            const char *engine = (i + 1 < argc) ? argv[++i] : "";
+            if (strcmp(engine, "sync") == 0) io_mode = IO_SYNC;
+            else if (strcmp(engine, "uring") == 0) io_mode = IO_URING;
+            else {
+                fprintf(stderr, C_RED "Error:" C_RESET " Unknown I/O engine '%s' (expected sync or uring).\n", engine);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-W") == 0 || strcmp(argv[i], "--walk-threads") == 0) {
+            if (i + 1 < argc) walk_threads = atoi(argv[++i]);
+            if (walk_threads < 1 || walk_threads > WALK_THREADS_MAX) {
+                fprintf(stderr, C_RED "Error:" C_RESET " -W expects a thread count between 1 and %d.\n", WALK_THREADS_MAX);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--dupes") == 0) {
+            dupe_mode = 1;
+        } else if (strcmp(argv[i], "--no-size-filter") == 0) {
+            size_filter = 0;
+        } else if (strcmp(argv[i], "--mem-limit") == 0) {
+            if (!parse_bytes(i + 1 < argc ? argv[++i] : "", &mem_limit) || mem_limit < 2ULL * SPILL_MIN) {
+                fprintf(stderr, C_RED "Error:" C_RESET " --mem-limit expects a size of at least %dM, e.g. 512M or 4G.\n", 2 * SPILL_MIN >> 20);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--confirm") == 0) {
+            dupe_mode = 1;
+            confirm_dupes = 1;
+        } else if (strcmp(argv[i], "--algo") == 0) {
+            if (i + 1 < argc) algo_name = argv[++i];
+            if (!gh_algo_find(algo_name)) {
+                fprintf(stderr, C_RED "Error:" C_RESET " Unknown hash algorithm '%s' (expected fnv1a or vec64).\n", algo_name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--format") == 0) {
+            const char *format = i + 1 < argc ? argv[++i] : "";
+            if (strcmp(format, "text") == 0) out_format = FORMAT_TEXT;
+            else if (strcmp(format, "ndjson") == 0) out_format = FORMAT_NDJSON;
+            else if (strcmp(format, "binary") == 0) out_format = FORMAT_BINARY;
+            else {
+                fprintf(stderr, C_RED "Error:" C_RESET " Unknown output format '%s' (expected text, ndjson or binary).\n", format);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--ext") == 0 || strcmp(argv[i], "--exclude-ext") == 0) {
+            int add = strcmp(argv[i], "--ext") == 0;
+            if (ext_filter_apply(add, i + 1 < argc ? argv[++i] : "") != 0) return 1;
+        } else if (strcmp(argv[i], "--shard") == 0) {
+            const char *spec = i + 1 < argc ? argv[++i] : "";
+            char extra;
+            if (sscanf(spec, "%u/%u%c", &shard, &shards, &extra) != 2 || shards == 0 || shards > SHARDS_MAX || shard >= shards) {
+                fprintf(stderr, C_RED "Error:" C_RESET " --shard expects i/N with 0 <= i < N <= %d, e.g. 0/4.\n", SHARDS_MAX);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--merge") == 0) {
+            merge_mode = 1;
+        } else if (strcmp(argv[i], "--compare") == 0) {
+            compare_mode = 1;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            if (i + 1 < argc) verify_filename = argv[++i];
+        } else if (strcmp(argv[i], "--fail-fast") == 0) {
+            fail_fast = 1;
+        } else if (strcmp(argv[i], "--layout") == 0) {
+            const char *layout = i + 1 < argc ? argv[++i] : "";
+            if (strcmp(layout, "v1") == 0) hash_opts.layout = GH_LAYOUT_V1;
+            else if (strcmp(layout, "v2") == 0) hash_opts.layout = GH_LAYOUT_V2;
+            else {
+                fprintf(stderr, C_RED "Error:" C_RESET " Unknown sampling layout '%s' (expected v1 or v2).\n", layout);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--prefetch") == 0) {
+            if (i + 1 < argc) prefetch_depth = atoi(argv[++i]);
+            if (prefetch_depth < 1 || prefetch_depth > PREFETCH_MAX) {
+                fprintf(stderr, C_RED "Error:" C_RESET " --prefetch expects a file count between 1 and %d.\n", PREFETCH_MAX);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--elevator") == 0) {
+            elevator_mode = 1;
+        } else if (strcmp(argv[i], "--full") == 0) {
+            hash_opts.flags |= GH_FULL;
+        } else if (strcmp(argv[i], "--remote") == 0) {
+            hash_opts.flags |= GH_REMOTE;
+        } else if (strcmp(argv[i], "--pagecache") == 0) {
+            const char *policy = i + 1 < argc ? argv[++i] : "";
+            if (strcmp(policy, "keep") == 0) hash_opts.pagecache = GH_PAGECACHE_KEEP;
+            else if (strcmp(policy, "drop") == 0) hash_opts.pagecache = GH_PAGECACHE_DROP;
+            else if (strcmp(policy, "direct") == 0) hash_opts.pagecache = GH_PAGECACHE_DIRECT;
+            else {
+                fprintf(stderr, C_RED "Error:" C_RESET " Unknown page cache policy '%s' (expected keep, drop or direct).\n", policy);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch_mode = 1;
+            recursive_mode = 1;
+        } else if (strcmp(argv[i], "--socket") == 0) {
+            watch_mode = 1;
+            recursive_mode = 1;
+            if (i + 1 < argc) socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--stdin0") == 0) {
+            files_from = "-";
+            list_delim = '\0';
+        } else if (strcmp(argv[i], "--files-from") == 0) {
+            files_from = (i + 1 < argc) ? argv[++i] : "-";
+            list_delim = '\n';
+        } else if (strcmp(argv[i], "--progress") == 0) {
+            progress_mode = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            if (stats_mode == STATS_OFF) stats_mode = STATS_TEXT;
+        } else if (strcmp(argv[i], "--stats-json") == 0) {
+            stats_mode = STATS_JSON;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            use_cache = 1;
+        } else if (strcmp(argv[i], "--cache-file") == 0) {
+            use_cache = 1;
+            if (i + 1 < argc) cache_filename = argv[++i];
+        } else if (strcmp(argv[i], "--cache-prune") == 0) {
+            use_cache = 1;
+            cache_prune = 1;
+        } else if (strcmp(argv[i], "--io-depth") == 0) {
+            if (i + 1 < argc) io_depth = atoi(argv[++i]);
+            if (io_depth < 1 || io_depth > IO_DEPTH_MAX) {
+                fprintf(stderr, C_RED "Error:" C_RESET " --io-depth expects a value between 1 and %d.\n", IO_DEPTH_MAX);
+                return 1;
+            }
+        } else if (argv[i][0] != '-') {
+            files_total++;   // Paths are only touched once, when they are processed
+            last_path = i;
+        }
+    }
+
+    if (files_total == 0 && !recursive_mode && !files_from && !verify_filename) goto usage;
+    hash_opts.algo = gh_algo_find(algo_name);
+    if (verify_filename) {
+        if (files_total || recursive_mode || files_from || dupe_mode || watch_mode || out_format != FORMAT_TEXT || shards > 1 || merge_mode) {
+            fprintf(stderr, C_RED "Error:" C_RESET " --verify takes its paths from the log and cannot be combined with paths, -r, --files-from, --dupes, --watch, --format, --shard or --merge.\n");
+            return 1;
+        }
+        if (!(verify_index = verify_load(verify_filename))) return 1;
+        verify_index->fail_fast = fail_fast;
+        if (verify_index->algo) hash_opts.algo = verify_index->algo;   // Hashes only compare under the same kernel
+        if (verify_index->full) hash_opts.flags |= GH_FULL;
+        if (verify_index->layout) hash_opts.layout = verify_index->layout;
+        if (use_cache) {
+            fprintf(stderr, C_YELLOW "Warning:" C_RESET " --verify ignores the fingerprint cache and rereads every file.\n");
+            use_cache = 0;
+        }
+    }
+    if (shards > 1 && (dupe_mode || watch_mode)) {
+        fprintf(stderr, C_RED "Error:" C_RESET " --shard cannot be combined with --dupes or --watch (duplicates and changes span shards).\n");
+        return 1;
+    }
+    if (merge_mode) {
+        if (recursive_mode || files_from || dupe_mode || watch_mode || shards > 1 || files_total == 0) {
+            fprintf(stderr, C_RED "Error:" C_RESET " --merge takes the shard logs as its paths and cannot be combined with -r, --files-from, --dupes, --watch or --shard.\n");
+            return 1;
+        }
+        char **logs = calloc((size_t)argc, sizeof(char *));
+        int nlogs = 0;
+        for (int i = 1; logs && i < argc; i++) {
+            if (argv[i][0] == '-') {
+                if (option_has_value(argv[i])) i++;
+                continue;
+            }
+            logs[nlogs++] = argv[i];
+        }
+        merged = logs ? merge_load(logs, nlogs) : NULL;
+        free(logs);
+        if (!merged) return 1;
+        if (merged->algo) hash_opts.algo = merged->algo;   // The merged log names the kernel of its inputs
+        if (merged->full) hash_opts.flags |= GH_FULL;
+        hash_opts.layout = merged->layout;
+        use_cache = 0;
+    }
+    if (compare_mode) {
+        if (files_total != 2 || recursive_mode || files_from || dupe_mode || watch_mode || shards > 1 || merge_mode || out_format != FORMAT_TEXT) {
+            fprintf(stderr, C_RED "Error:" C_RESET " --compare takes exactly two logs as its paths and cannot be combined with -r, --files-from, --dupes, --watch, --shard, --merge or --format.\n");
+            return 1;
+        }
+        const char *logs[2];
+        int nlogs = 0;
+        for (int i = 1; i < argc; i++) {
+            if (argv[i][0] == '-') {
+                if (option_has_value(argv[i])) i++;
+                continue;
+            }
+            logs[nlogs++] = argv[i];
+        }
+        if (!(compare_old = compare_load(logs[0], NULL)) || !(compare_new = compare_load(logs[1], compare_old))) {
+            compare_free(compare_old);
+            return 1;
+        }
+        if (compare_old->log.algo) hash_opts.algo = compare_old->log.algo;   // The log header names the kernel of both
+        else if (compare_new->log.algo) hash_opts.algo = compare_new->log.algo;
+        if (compare_old->log.full) hash_opts.flags |= GH_FULL;
+        hash_opts.layout = compare_old->log.layout;
+        use_cache = 0;
+    }
+    if (stats_mode != STATS_OFF) hash_opts.flags |= GH_TIMING;
+    if (watch_mode) hash_opts.flags |= GH_NO_MMAP;   // Watched files are often rewritten mid-hash: read() them instead of faulting on the mapping
+    gh_stats *main_stats = stats_thread("main");
+    if (silent_mode && isatty(STDERR_FILENO)) progress_mode = 1;   // The bar -s has always promised
+    progress_thread();
+    if (mem_limit && !dupe_mode) {
+        fprintf(stderr, C_RED "Error:" C_RESET " --mem-limit bounds the --dupes index and needs -d or --confirm.\n");
+        return 1;
+    }
+    if (dupe_mode && !(dupe_index = dupe_new(out_format != FORMAT_TEXT, (size_t)(mem_limit / 2)))) {
+        if (!mem_limit) fprintf(stderr, C_RED "Error:" C_RESET " Out of memory.\n");   // spill_new() says why
+        return 1;
+    }
+    if (watch_mode && dupe_mode) {
+        fprintf(stderr, C_RED "Error:" C_RESET " --watch cannot be combined with --dupes.\n");
+        return 1;
+    }
+    if (watch_mode && elevator_mode) {
+        fprintf(stderr, C_RED "Error:" C_RESET " --watch cannot be combined with --elevator (changes arrive one at a time).\n");
+        return 1;
+    }
+    if (silent_mode && !log_filename) {
+        fprintf(stderr, C_RED "Error:" C_RESET " Silent mode requires a log file (-l).\n");
+        return 1;
+    }
+
+    // Initialize Log File
+    if (log_filename) {
+        log_fp = fopen(log_filename, watch_mode ? "a+" : "w");  // A restarted daemon keeps its history
+        if (!log_fp) {
+            fprintf(stderr, C_RED "Error:" C_RESET " Could not open log file " C_YELLOW "%s\n" C_RESET, log_filename);
+        } else if (out_format != FORMAT_TEXT) {
+            // The log holds nothing but records; the terminal output is unchanged
+            record_fp = log_fp;
+            log_fp = NULL;
+            out_attach_log(record_fp);
+        } else {
+            out_attach_log(log_fp);
+            time_t now = time(NULL);
+            struct tm *t = localtime(&now);
+            char time_str[64];
             strftime(time_str, sizeof(time_str), "%a, %b %d %Y %H:%M:%S", t);
-            fprintf(log_fp, "GetHash v%s Log - Generated on %s\n\n", VERSION, time_str);
+            fprintf(log_fp, "GetHash v%s Log - Generated on %s\n", VERSION, time_str);
+            fprintf(log_fp, "Algorithm: %s%s\n", hash_opts.algo->name, algo_suffix());
+            if (shards > 1) fprintf(log_fp, "Shard: %u/%u\n", shard, shards);
+            fputc('\n', log_fp);
+        }
+    }
+
+    if (out_format != FORMAT_TEXT && !record_fp) {
+        // Records own stdout; everything meant for people moves to stderr
+        fflush(stdout);
+        int fd = dup(STDOUT_FILENO);
+        record_fp = fd == -1 ? NULL : fdopen(fd, "w");
+        if (!record_fp || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+            fprintf(stderr, C_RED "Error:" C_RESET " Could not set up the record stream (%s).\n", strerror(errno));
+            return 1;
         }
+        out_attach_log(record_fp);
+    }
+    if (out_format == FORMAT_BINARY && print_record_header() != 0) {
+        fprintf(stderr, C_RED "Error:" C_RESET " %s already holds records of another format or hash kernel.\n",
+                log_filename ? log_filename : "The output");
+        return 1;
+    }
+
+    fp_cache *cache = NULL;
+    if (use_cache) {
+        char *path = cache_filename ? strdup(cache_filename) : cache_default_path();
+        if (path) cache = cache_open(path, algo_variant());
+        if (!cache) fprintf(stderr, C_YELLOW "Warning:" C_RESET " Fingerprint cache unavailable, hashing every file.\n");
+        free(path);
     }
 
     /* Second pass: Process files */
     int files_processed = 0;
-    for (int i = 1; i < argc; i++) {
+    hash_pool pool;
+    hash_pool *pool_ptr = NULL;
+    if (io_mode == IO_URING && !uring_supported()) {
+        fprintf(stderr, C_YELLOW "Warning:" C_RESET " io_uring is unavailable, using blocking I/O.\n");
+        io_mode = IO_SYNC;
+    } else if (io_mode == IO_URING && (hash_opts.flags & GH_FULL)) {
+        fprintf(stderr, C_YELLOW "Warning:" C_RESET " --full streams whole files and does not use io_uring.\n");
+        io_mode = IO_SYNC;
+    }
+    gh_watch watch;
+    if (watch_mode) {
+        if (watch_init(&watch, socket_path) != 0) return 1;
+        watch.roots = calloc((size_t)argc, sizeof(char *));
+    }
+
+    int list_fd = -1;
+    int list_failed = 0;
+    if (files_from) {
+        list_fd = strcmp(files_from, "-") == 0 ? STDIN_FILENO : open(files_from, O_RDONLY | O_CLOEXEC);
+        if (list_fd == -1) {
+            fprintf(stderr, C_RED "Error:" C_RESET " Could not open path list " C_YELLOW "%s\n" C_RESET, files_from);
+            return 1;
+        }
+    }
+    if ((hash_opts.flags & GH_REMOTE) && !jobs_given) jobs = REMOTE_JOBS_DEFAULT;
+    else if (verify_index && !jobs_given) jobs = VERIFY_JOBS_DEFAULT;
+    if (elevator_mode && (jobs_given || io_mode == IO_URING)) {
+        fprintf(stderr, C_YELLOW "Warning:" C_RESET " --elevator issues its sorted reads from one thread; -j and --io are ignored.\n");
+    }
+    if ((recursive_mode || files_from || verify_index) && !elevator_mode && (jobs > 1 || io_mode == IO_URING)) {
+        // Verification pairs results with log entries by order
+        if (pool_start(&pool, jobs, unordered && !verify_index, io_mode, io_depth, cache, (hash_opts.flags & GH_REMOTE) != 0,
+                       &files_succeeded, &files_total, &total_size_bytes) == 0) {
+            pool_ptr = &pool;
+        } else {
+            fprintf(stderr, C_RED "Error:" C_RESET " Could not start worker threads, hashing on the main thread.\n");
+        }
+    }
+
+    scan_ctx scan = { ignore_extension, pool_ptr, cache, NULL, 0, &files_succeeded, &files_total, &total_size_bytes, 0,
+                      shard, shards, 0, NULL, NULL, follow_links };
+    if (elevator_mode && !(scan.elev = elevator_new())) {
+        fprintf(stderr, C_YELLOW "Warning:" C_RESET " Not enough memory for --elevator, hashing in walk order.\n");
+    }
+    if (prefetch_depth) {
+        if (pool_ptr || elevator_mode || (hash_opts.flags & GH_FULL) || hash_opts.pagecache != GH_PAGECACHE_KEEP) {
+            // Workers and the elevator overlap reads already; WILLNEED pages would outlive drop/direct
+            fprintf(stderr, C_YELLOW "Warning:" C_RESET " --prefetch only applies to single-threaded sampling with --pagecache keep; ignored.\n");
+        } else if (!(scan.prefetch = prefetch_new((size_t)prefetch_depth))) {
+            fprintf(stderr, C_YELLOW "Warning:" C_RESET " Not enough memory for --prefetch, hashing without it.\n");
+        }
+    }
+    if (dupe_mode && size_filter && !(scan.sizes = dupe_new(1, (size_t)(mem_limit / 2)))) {
+        fprintf(stderr, C_YELLOW "Warning:" C_RESET " Not enough memory for the size prefilter, hashing every file.\n");
+    }
+    // --verify pairs every logged path with its own result, so it hashes links one by one
+    if ((recursive_mode || files_from) && !verify_index && !(inode_index = inode_new())) {
+        fprintf(stderr, C_YELLOW "Warning:" C_RESET " Not enough memory for the inode set, hashing every hard link.\n");
+    }
+
+    if (merged) {
+        merge_print(merged);
+        files_total = files_succeeded = (int)merged->count;
+        for (size_t i = 0; i < merged->count; i++) total_size_bytes += merged->entries[i].size;
+    }
+
+    progress_start();
+    for (int i = 1; i < argc && !merged && !compare_new; i++) {
         if (argv[i][0] == '-') {
-            if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--log") == 0) i++;
+            if (option_has_value(argv[i])) i++;
             continue;
         }
 
         if (recursive_mode) {
-            process_path_recursive(argv[i], ignore_extension, &files_succeeded, &files_total, &total_size_bytes);
+            // Watch first, so changes made during the initial scan are queued, not lost
+            if (watch_mode) {
+                watch_tree(&watch, argv[i], NULL);
+                if (watch.roots) watch.roots[watch.nroots++] = argv[i];
+            }
+            // Another root, a list, parked sizes or skipped link targets would make the listed count no total
+            if (i == last_path && !files_from && !scan.sizes && shards <= 1 && !follow_links) progress_last_source();
+            if (walk_threads > 0) walk_tree(argv[i], walk_threads, &scan);
+            else process_path_recursive(argv[i], &scan);
         } else {
             files_processed++;
             char *target_file = argv[i];
 
-            if (!ignore_extension && !is_video_file(target_file)) {
+            scan.root_len = strlen(target_file);   // A file root shards by its name, as under -r
+            if (!shard_keeps(&scan, target_file)) continue;
+            if (!ignore_extension && !gh_ext_match(&ext_filter, target_file)) {
                 if (!silent_mode) fprintf(stderr, C_RED "Skipping:" C_RESET " '%s' " C_YELLOW "(Non-video)\n" C_RESET, target_file);
                 continue;
             }
 
+            // Duplicate reports list absolute paths, so resolve before hashing
             char absolute_path[PATH_MAX];
-            if (realpath(target_file, absolute_path) == NULL) {
+            if (dupe_index && realpath(target_file, absolute_path) == NULL) {
                 if (!silent_mode) fprintf(stderr, C_RED "Path Error:" C_RESET " " C_YELLOW "'%s'" C_RESET " not found\n", target_file);
                 continue;
             }
 
-            unsigned long long file_size = 0;
-            unsigned long long h = calculate_video_hash(target_file, &file_size);
-            
-            if (h != 0) {
+            if (scan.sizes) {
+                scan_file(&scan, absolute_path, NULL);
+                continue;
+            }
+
+            struct stat target_st, hashed_st;
+            int have_st = cache && stat(target_file, &target_st) == 0;
+            if (thread_progress) {
+                progress_add(&thread_progress->found, 1);
+                progress_add(&thread_progress->queued, 1);
+            }
+            unsigned long long h = hash_with_cache(cache, target_file, have_st ? &target_st : NULL, &hashed_st);
+            unsigned long long file_size = h != 0 ? (unsigned long long)hashed_st.st_size : 0;
+            progress_done(file_size);
+            uint64_t mark = main_stats ? stats_now() : 0;
+
+            if (h == 0 && access(target_file, F_OK) != 0) {
+                if (!silent_mode) fprintf(stderr, C_RED "Path Error:" C_RESET " " C_YELLOW "'%s'" C_RESET " not found\n", target_file);
+            } else if (h != 0 && (dupe_index || record_fp)) {
+                files_succeeded++;
+                total_size_bytes += file_size;
+                if (!dupe_index && realpath(target_file, absolute_path) == NULL) {
+                    strncpy(absolute_path, target_file, PATH_MAX - 1);
+                    absolute_path[PATH_MAX - 1] = '\0';
+                }
+                emit_result(h, &hashed_st, absolute_path);
+                out_tick();
+            } else if (h != 0) {
                 files_succeeded++;
                 total_size_bytes += file_size;
-                char path_buf1[PATH_MAX], path_buf2[PATH_MAX];
-                strcpy(path_buf1, absolute_path);
-                strcpy(path_buf2, absolute_path);
+
+                // The File/Path block is the only output that needs the resolved path
+                if (realpath(target_file, absolute_path) == NULL) {
+                    strncpy(absolute_path, target_file, PATH_MAX - 1);
+                    absolute_path[PATH_MAX - 1] = '\0';
+                }
+                const char *slash = strrchr(absolute_path, '/');
+                const char *base = slash ? slash + 1 : absolute_path;
+                int dir_len = !slash ? 1 : slash == absolute_path ? 1 : (int)(slash - absolute_path);
+                const char *dir = !slash ? "." : absolute_path;
+                if ((int)strlen(base) > max_display_len) max_display_len = (int)strlen(base);
+                if (dir_len > max_display_len) max_display_len = dir_len;
 
                 print_separator(max_display_len, C_CYAN, '-');
-                smart_printf(C_GREEN, "File: ", "%s\n", basename(path_buf1));
-                smart_printf(C_GREEN, "Path: ", "%s\n", dirname(path_buf2));
+                smart_printf(C_GREEN, "File: ", "%s\n", base);
+                smart_printf(C_GREEN, "Path: ", "%.*s\n", dir_len, dir);
                 
                 double display_size;
                 const char* unit;
@@ -441,19 +6145,77 @@ int main(int argc, char *argv[]) {
                 if (log_fp) fprintf(log_fp, "Size:%' .2f %s\n", display_size, unit);
 
                 smart_printf(C_GREEN, "Hash: ", "%016llx\n", h);
+                out_tick();
             }
+            stats_lap(main_stats, PHASE_OUTPUT, &mark);
+        }
+    }
+
+    if (files_from) {
+        list_failed = scan_list(list_fd, list_delim, recursive_mode, walk_threads, &scan) != 0;
+        if (list_fd != STDIN_FILENO) close(list_fd);
+    }
+
+    if (verify_index) {
+        progress_last_source();
+        verify_run(verify_index, &scan);
+    }
+
+    size_filter_flush(&scan);
+    progress_walked();
+    elevator_flush(&scan);
+    elevator_free(scan.elev);
+    scan.elev = NULL;
+    prefetch_flush(&scan);
+    prefetch_free(scan.prefetch);
+    scan.prefetch = NULL;
+    if (pool_ptr) pool_finish(pool_ptr);
+    inode_flush(&scan);
+    progress_stop();   // The watch daemon has no end to count towards
+    if (watch_mode) {
+        scan.pool = NULL;
+        if (!silent_mode) fprintf(stderr, C_CYAN "Watching for changes" C_RESET "%s%s. Stop with Ctrl-C.\n",
+                                  socket_path ? ", serving results on " : "", socket_path ? socket_path : "");
+        watch_run(&watch, &scan);
+        watch_free(&watch);
+    }
+    if (cache) cache_close(cache, cache_prune);
+    if (dupe_index) {
+        uint64_t mark = main_stats ? stats_now() : 0;
+        dupe_report(dupe_index, confirm_dupes);
+        stats_lap(main_stats, PHASE_OUTPUT, &mark);
+        if (size_filter) {
+            printf(C_YELLOW "Size filter: " C_RESET "%'llu files with a unique size were never opened.\n", scan.size_skipped);
+            if (log_fp) fprintf(log_fp, "Size filter: %'llu files with a unique size were never opened.\n", scan.size_skipped);
         }
+        spill_summary();
+        dupe_free(dupe_index);
+        dupe_index = NULL;
+    }
+    int exit_code = list_failed ? 1 : 0;   // A truncated list is not a complete run
+    if (verify_index) {
+        verify_finish(verify_index);
+        if (verify_index->failed) exit_code = 1;   // Usable as an integrity gate
+        verify_free(verify_index);
+        verify_index = NULL;
+    }
+    if (compare_new) {
+        unsigned long long paths = 0;
+        if (compare_run(compare_old, compare_new, &paths) != 0) exit_code = 1;   // Usable as a sync check
+        files_succeeded = (int)paths;
+        for (size_t i = 0; i < compare_new->count; i++) total_size_bytes += compare_new->entries[i].size;
     }
 
     clock_gettime(CLOCK_MONOTONIC, &end);
     double elapsed = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
 
-    if (recursive_mode) {
+    if (recursive_mode || dupe_mode || files_from || verify_filename || merged || compare_new) {
         double total_mb = total_size_bytes / 1048576.0;
-        printf(C_YELLOW "\nSummary: " C_RESET "%'d files hashed in " C_ORANGE "%.3f" C_RESET " ms (Total: " C_CYAN "%' .2f" C_RESET " MB).\n", 
-               files_succeeded, elapsed, total_mb);
+        const char *verb = merged ? "merged" : compare_new ? "compared" : "hashed";
+        printf(C_YELLOW "\nSummary: " C_RESET "%'d files %s in " C_ORANGE "%.3f" C_RESET " ms (Total: " C_CYAN "%' .2f" C_RESET " MB).\n", 
+               files_succeeded, verb, elapsed, total_mb);
         if (log_fp) {
-            fprintf(log_fp, "\nSummary: %'d files hashed in %.3f ms (Total: %' .2f MB).\n", files_succeeded, elapsed, total_mb);
+            fprintf(log_fp, "\nSummary: %'d files %s in %.3f ms (Total: %' .2f MB).\n", files_succeeded, verb, elapsed, total_mb);
         }
     } else {
         print_separator(max_display_len, C_CYAN, '=');
@@ -463,13 +6225,33 @@ int main(int argc, char *argv[]) {
             fprintf(log_fp, "Summary: %d of %d files hashed in %.3f ms\n", files_succeeded, files_total, elapsed);
         }
     }
-
-    if (log_fp) {
-        printf(C_YELLOW "Log saved to:" C_RESET " %s\n", log_filename);
-        fclose(log_fp);
+    if (shards > 1) {
+        printf(C_YELLOW "Shard: " C_RESET "%u/%u (combine the shard logs with --merge).\n", shard, shards);
+    }
+    if (inode_index && inode_index->links) {
+        printf(C_YELLOW "Hard links: " C_RESET "%'llu paths took the hash of another link to the same file without being opened.\n", inode_index->links);
+        if (log_fp) fprintf(log_fp, "Hard links: %'llu paths took the hash of another link to the same file without being opened.\n", inode_index->links);
     }
+    if (inode_index && inode_index->dirs) {
+        printf(C_YELLOW "Symlinks: " C_RESET "%'llu directories reached a second time were not walked again.\n", inode_index->dirs);
+        if (log_fp) fprintf(log_fp, "Symlinks: %'llu directories reached a second time were not walked again.\n", inode_index->dirs);
+    }
+    inode_free(inode_index);
+    inode_index = NULL;
+    if (merged) verify_free(merged);
+    compare_free(compare_old);
+    compare_free(compare_new);
+    if (pool_ptr && pool.adaptive) {
+        printf(C_YELLOW "Concurrency: " C_RESET "settled at %d of %d workers (--remote).\n", pool.active, pool.max_active);
+        if (log_fp) fprintf(log_fp, "Concurrency: settled at %d of %d workers (--remote).\n", pool.active, pool.max_active);
+    }
+    if (stats_mode != STATS_OFF) stats_report(elapsed);
+
+    if (log_filename && (log_fp || record_fp)) printf(C_YELLOW "Log saved to:" C_RESET " %s\n", log_filename);
+    if (log_fp) fclose(log_fp);
+    if (record_fp) fclose(record_fp);
     
-    return 0;
+    return exit_code;
 
 usage:
     fprintf(stderr, C_YELLOW "GetHash v%s" C_RESET " - High-Speed Media Hasher\n", VERSION);
@@ -479,7 +6261,50 @@ usage:
     fprintf(stderr, "  -i, --ignore        Ignore video file extension. Process files regardless of extension\n");
     fprintf(stderr, "  -l, --log <file>    Save results to a file\n");
     fprintf(stderr, "  -s, --silent        Silent mode. Only show progress bar (requires -l)\n");
-    fprintf(stderr, "  -r, --recursive     Perform the hash on other directories recursively\n\n");
+    fprintf(stderr, "      --progress      Show files/s, MB/s and, once the walk is done, a bar and ETA on stderr\n");
+    fprintf(stderr, "                      (on by default with -s on a terminal)\n");
+    fprintf(stderr, "  -r, --recursive     Perform the hash on other directories recursively\n");
+    fprintf(stderr, "  -L, --follow        Follow symbolic links while walking; each directory is walked once\n");
+    fprintf(stderr, "      --ext <list>    Also hash these extensions, e.g. iso,vob,mxf,r3d,braw\n");
+    fprintf(stderr, "      --exclude-ext <list> Stop hashing these extensions, e.g. ts\n");
+    fprintf(stderr, "  -j, --jobs <N>      Hash with N worker threads in recursive mode (default 1)\n");
+    fprintf(stderr, "  -u, --unordered     With -j, print results as they finish instead of in scan order\n");
+    fprintf(stderr, "      --files-from <f> Hash the newline-separated paths in <f> as they are read (- = stdin)\n");
+    fprintf(stderr, "      --stdin0        Same, with NUL-separated paths from stdin (find -print0)\n");
+    fprintf(stderr, "      --format <f>    Result format: text (default), ndjson or binary (see libgh.h). Records go to\n");
+    fprintf(stderr, "                      the log file, or to stdout without -l (other output then goes to stderr)\n");
+    fprintf(stderr, "      --remote        Tune for NFS/SMB/FUSE: fetch the samples together, no readahead,\n");
+    fprintf(stderr, "                      and grow the worker count up to -j (default %d) while throughput improves\n", REMOTE_JOBS_DEFAULT);
+    fprintf(stderr, "      --pagecache <p> Sample reads: keep (default), drop (leave no pages behind) or direct (O_DIRECT)\n");
+    fprintf(stderr, "      --layout <v>    Sampling layout: v1 (default, head/middle/tail) or v2 (4KB-aligned, 3-16\n");
+    fprintf(stderr, "                      samples by file size)\n");
+    fprintf(stderr, "      --prefetch <K>  Without -j/io_uring: keep K files ahead of the hasher open, their samples\n");
+    fprintf(stderr, "                      already requested (WILLNEED), so reads overlap hashing\n");
+    fprintf(stderr, "      --elevator      HDDs: sort the sample reads of %d files at a time by physical offset\n", ELEVATOR_WINDOW);
+    fprintf(stderr, "                      (FIEMAP, else inode) and read them in one sweep; output order is kept\n");
+    fprintf(stderr, "      --full          Hash the whole content of every file (streamed, mmap on local disks)\n");
+    fprintf(stderr, "  -W, --walk-threads <N> List directories with N threads (fd-relative, d_type-aware walker)\n");
+    fprintf(stderr, "      --io <engine>   I/O engine for recursive mode: sync (default) or uring\n");
+    fprintf(stderr, "      --io-depth <N>  Files kept in flight per io_uring worker (default %d)\n", IO_DEPTH_DEFAULT);
+    fprintf(stderr, "  -d, --dupes         Only report groups of files with the same hash\n");
+    fprintf(stderr, "      --no-size-filter With --dupes, hash every file instead of only those sharing a size\n");
+    fprintf(stderr, "      --mem-limit <size> With --dupes, keep the index within size bytes (e.g. 4G) by spilling sorted runs to $TMPDIR\n");
+    fprintf(stderr, "      --confirm       With --dupes, verify each group with a full-content comparison\n");
+    fprintf(stderr, "      --algo <name>   Hash kernel: fnv1a (default) or vec64 (SIMD, %s on this CPU)\n", gh_vec64_impl());
+    fprintf(stderr, "      --watch         After the scan, keep running and rehash files as they are written or moved in\n");
+    fprintf(stderr, "      --socket <path> With --watch, also stream results to clients of a unix socket\n");
+    fprintf(stderr, "      --stats         Print per-phase time, I/O counters and a latency histogram\n");
+    fprintf(stderr, "      --stats-json    Same as --stats, as one line of JSON\n");
+    fprintf(stderr, "      --cache         Reuse hashes of unchanged files from ~/.cache/gh/fingerprints\n");
+    fprintf(stderr, "      --cache-file <f> Use <f> as the fingerprint cache (implies --cache)\n");
+    fprintf(stderr, "      --cache-prune   Drop cache entries for files this run did not see\n");
+    fprintf(stderr, "      --verify <log>  Rehash the files of a previous text, ndjson or binary log (with -j, default %d\n", VERIFY_JOBS_DEFAULT);
+    fprintf(stderr, "                      workers) and report mismatches and missing files. Exits 1 if anything differs\n");
+    fprintf(stderr, "      --fail-fast     With --verify, stop at the first problem\n");
+    fprintf(stderr, "      --shard <i/N>   Only hash the files of shard i (0 <= i < N), chosen by a hash of the path\n");
+    fprintf(stderr, "                      below the scanned root, so N machines can split one tree\n");
+    fprintf(stderr, "      --merge         Treat the paths as shard logs and combine them into one result sorted by path\n");
+    fprintf(stderr, "      --compare       Treat the two paths as logs and report changed, moved, added and removed files\n\n");
     fprintf(stderr, C_CYAN "Example:\n" C_RESET);
     fprintf(stderr, C_GREEN "  gh " C_ORANGE "-l results.log " C_BLUE "video1.mp4 video2.mkv\n" C_RESET);
     fprintf(stderr, "  Save hash result of 2 video files to 'results.log'.\n\n");
@@ -0,0 +1,1023 @@
+/*
+ * =====================================================================================
+ * libgh: Embeddable sparse media fingerprinting
+ * =====================================================================================
+ *
+ * See libgh.h for the API. Nothing here writes to global state except the
+ * one-time vec64 CPU dispatch and the SIGBUS handler full hashes install on
+ * first use, so every entry point is reentrant.
+ *
+ * COMPILATION:
+ * gcc -O3 -c libgh.c && ar rcs libgh.a libgh.o
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include "libgh.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// FNV-1a Hash Constants for 64-bit hashing
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+#ifndef RWF_DONTCACHE
+#define RWF_DONTCACHE 0x00000080        // Linux 6.14+: uncached buffered reads
+#endif
+
+static const gh_options GH_DEFAULTS = { NULL, GH_PAGECACHE_KEEP, 0, NULL, GH_LAYOUT_V1 };
+
+/* ================= HASH KERNELS ================= */
+
+static unsigned long long fnv1a_hash(unsigned long long hash, const unsigned char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static unsigned long long fnv1a_seed(unsigned long long file_size) {
+    return fnv1a_hash(FNV_OFFSET_BASIS, (unsigned char *)&file_size, sizeof(file_size));
+}
+
+/*
+ * vec64: xxh3-style striped kernel.
+ * Eight 64-bit lanes accumulate (key ^ data).lo32 * (key ^ data).hi32 plus the
+ * neighbouring lane's raw data for every 64-byte stripe; every 16 stripes the
+ * lanes are scrambled. The lanes are folded pairwise with a 64x64->128 multiply
+ * at the end. The SIMD paths below compute exactly the same lanes.
+ */
+#define VEC_STRIPE 64
+#define VEC_STRIPES_PER_BLOCK 16
+#define VEC_PRIME32 0x9E3779B1U
+#define VEC_PRIME64_1 0x9E3779B185EBCA87ULL
+#define VEC_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+
+static const uint64_t VEC_KEY[8] __attribute__((aligned(32))) = {
+    0x2cb0f69f4abea221ULL, 0x9417034723148989ULL, 0xdd555950609dfe03ULL, 0xdbafb150deb12800ULL,
+    0x7e789b2e6c442cb6ULL, 0xf41e5636c7e4f8c4ULL, 0x0959d150f8fba7e4ULL, 0xa97316f13cdb9eeaULL
+};
+static const uint64_t VEC_SCRAMBLE_KEY[8] __attribute__((aligned(32))) = {
+    0x74cd8258f9520068ULL, 0x55c74a62e116868bULL, 0xd2f4c799a2023cbdULL, 0xdf98cb79a37b51b9ULL,
+    0x396f5885524f3905ULL, 0xaf1d56386ca3b276ULL, 0xa9ffbe6b5104e85aULL, 0x6bd0c51b9fd533b3ULL
+};
+
+static inline uint64_t read64le(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static void vec64_stripe_scalar(uint64_t acc[8], const unsigned char *p) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t v = read64le(p + 8 * i);
+        uint64_t k = v ^ VEC_KEY[i];
+        acc[i ^ 1] += v;
+        acc[i] += (k & 0xffffffffULL) * (k >> 32);
+    }
+}
+
+static void vec64_scramble_scalar(uint64_t acc[8]) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= VEC_SCRAMBLE_KEY[i];
+        acc[i] = a * VEC_PRIME32;
+    }
+}
+
+/* Runs nstripes full stripes, scrambling after every 16th. */
+static void vec64_stripes_scalar(uint64_t acc[8], const unsigned char *p, size_t nstripes) {
+    for (size_t s = 0; s < nstripes; s++) {
+        vec64_stripe_scalar(acc, p + s * VEC_STRIPE);
+        if ((s + 1) % VEC_STRIPES_PER_BLOCK == 0) vec64_scramble_scalar(acc);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void vec64_stripes_avx2(uint64_t acc[8], const unsigned char *p, size_t nstripes) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i *)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i *)(acc + 4));
+    const __m256i k0 = _mm256_load_si256((const __m256i *)VEC_KEY);
+    const __m256i k1 = _mm256_load_si256((const __m256i *)(VEC_KEY + 4));
+    const __m256i s0 = _mm256_load_si256((const __m256i *)VEC_SCRAMBLE_KEY);
+    const __m256i s1 = _mm256_load_si256((const __m256i *)(VEC_SCRAMBLE_KEY + 4));
+    const __m256i prime = _mm256_set1_epi32((int)VEC_PRIME32);
+
+    for (size_t s = 0; s < nstripes; s++) {
+        const unsigned char *q = p + s * VEC_STRIPE;
+        __m256i d0 = _mm256_loadu_si256((const __m256i *)q);
+        __m256i d1 = _mm256_loadu_si256((const __m256i *)(q + 32));
+        __m256i x0 = _mm256_xor_si256(d0, k0);
+        __m256i x1 = _mm256_xor_si256(d1, k1);
+        __m256i m0 = _mm256_mul_epu32(x0, _mm256_srli_epi64(x0, 32));
+        __m256i m1 = _mm256_mul_epu32(x1, _mm256_srli_epi64(x1, 32));
+        a0 = _mm256_add_epi64(a0, _mm256_add_epi64(m0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))));
+        a1 = _mm256_add_epi64(a1, _mm256_add_epi64(m1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))));
+
+        if ((s + 1) % VEC_STRIPES_PER_BLOCK == 0) {
+            a0 = _mm256_xor_si256(_mm256_xor_si256(a0, _mm256_srli_epi64(a0, 47)), s0);
+            a1 = _mm256_xor_si256(_mm256_xor_si256(a1, _mm256_srli_epi64(a1, 47)), s1);
+            a0 = _mm256_add_epi64(_mm256_mul_epu32(a0, prime),
+                                  _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a0, 32), prime), 32));
+            a1 = _mm256_add_epi64(_mm256_mul_epu32(a1, prime),
+                                  _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a1, 32), prime), 32));
+        }
+    }
+    _mm256_storeu_si256((__m256i *)acc, a0);
+    _mm256_storeu_si256((__m256i *)(acc + 4), a1);
+}
+#endif
+
+#if defined(__aarch64__)
+static void vec64_stripes_neon(uint64_t acc[8], const unsigned char *p, size_t nstripes) {
+    uint64x2_t a[4], k[4], sk[4];
+    for (int j = 0; j < 4; j++) {
+        a[j] = vld1q_u64(acc + 2 * j);
+        k[j] = vld1q_u64(VEC_KEY + 2 * j);
+        sk[j] = vld1q_u64(VEC_SCRAMBLE_KEY + 2 * j);
+    }
+    const uint32x2_t prime = vdup_n_u32(VEC_PRIME32);
+
+    for (size_t s = 0; s < nstripes; s++) {
+        const unsigned char *q = p + s * VEC_STRIPE;
+        for (int j = 0; j < 4; j++) {
+            uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(q + 16 * j));
+            uint64x2_t x = veorq_u64(d, k[j]);
+            uint64x2_t m = vmull_u32(vmovn_u64(x), vshrn_n_u64(x, 32));
+            a[j] = vaddq_u64(a[j], vaddq_u64(m, vextq_u64(d, d, 1)));
+        }
+        if ((s + 1) % VEC_STRIPES_PER_BLOCK == 0) {
+            for (int j = 0; j < 4; j++) {
+                uint64x2_t x = veorq_u64(veorq_u64(a[j], vshrq_n_u64(a[j], 47)), sk[j]);
+                uint64x2_t lo = vmull_u32(vmovn_u64(x), prime);
+                uint64x2_t hi = vmull_u32(vshrn_n_u64(x, 32), prime);
+                a[j] = vaddq_u64(lo, vshlq_n_u64(hi, 32));
+            }
+        }
+    }
+    for (int j = 0; j < 4; j++) vst1q_u64(acc + 2 * j, a[j]);
+}
+#endif
+
+typedef void (*vec64_stripes_fn)(uint64_t acc[8], const unsigned char *p, size_t nstripes);
+
+static vec64_stripes_fn vec64_pick(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) return vec64_stripes_avx2;
+#elif defined(__aarch64__)
+    return vec64_stripes_neon;
+#endif
+    return vec64_stripes_scalar;
+}
+
+static vec64_stripes_fn vec64_stripes;   // Resolved once by gh_algo_find(), read-only afterwards
+static pthread_once_t vec64_once = PTHREAD_ONCE_INIT;
+
+static void vec64_resolve(void) {
+    vec64_stripes = vec64_pick();
+}
+
+const char *gh_vec64_impl(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (vec64_pick() == vec64_stripes_avx2) return "avx2";
+#elif defined(__aarch64__)
+    return "neon";
+#endif
+    return "scalar";
+}
+
+static inline uint64_t fold64(uint64_t a, uint64_t b) {
+    unsigned __int128 m = (unsigned __int128)a * b;
+    return (uint64_t)m ^ (uint64_t)(m >> 64);
+}
+
+static inline uint64_t vec64_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    return h ^ (h >> 32);
+}
+
+static unsigned long long vec64_update(unsigned long long hash, const unsigned char *data, size_t len) {
+    uint64_t acc[8];
+    for (int i = 0; i < 8; i++) acc[i] = hash ^ VEC_KEY[i];
+
+    size_t nstripes = len / VEC_STRIPE;
+    vec64_stripes(acc, data, nstripes);
+
+    size_t rest = len % VEC_STRIPE;
+    if (rest) {
+        unsigned char last[VEC_STRIPE] = { 0 };
+        memcpy(last, data + nstripes * VEC_STRIPE, rest);
+        vec64_stripe_scalar(acc, last);
+    }
+
+    uint64_t r = ((uint64_t)len * VEC_PRIME64_1) ^ hash;
+    for (int i = 0; i < 8; i += 2) {
+        r += fold64(acc[i] ^ VEC_SCRAMBLE_KEY[i], acc[i + 1] ^ VEC_SCRAMBLE_KEY[i + 1]);
+    }
+    return vec64_avalanche(r);
+}
+
+static unsigned long long vec64_seed(unsigned long long file_size) {
+    return vec64_avalanche(file_size * VEC_PRIME64_2 ^ VEC_PRIME64_1);
+}
+
+static const gh_algo GH_ALGOS[] = {
+    { "fnv1a", 0, fnv1a_seed, fnv1a_hash },
+    { "vec64", 1, vec64_seed, vec64_update },
+    { NULL, 0, NULL, NULL }
+};
+
+const gh_algo *gh_algo_find(const char *name) {
+    pthread_once(&vec64_once, vec64_resolve);
+    for (const gh_algo *a = GH_ALGOS; a->name; a++) {
+        if (strcmp(a->name, name) == 0) return a;
+    }
+    return NULL;
+}
+
+/* ================= SAMPLING ================= */
+
+int gh_sample_offsets(uint64_t file_size, int64_t offsets[GH_SAMPLE_COUNT]) {
+    int n = 0;
+    offsets[n++] = 0;
+    if (file_size > GH_CHUNK_SIZE * 3) offsets[n++] = (int64_t)(file_size / 2);
+    if (file_size > GH_CHUNK_SIZE) offsets[n++] = (int64_t)(file_size - GH_CHUNK_SIZE);
+    return n;
+}
+
+int gh_sample_layout(unsigned layout, uint64_t file_size, int64_t offsets[GH_SAMPLE_MAX]) {
+    if (layout != GH_LAYOUT_V2) return gh_sample_offsets(file_size, offsets);
+
+    // The tail sample starts GH_CHUNK_SIZE before the aligned end, so its short read still covers the last byte
+    uint64_t end = (file_size + GH_LAYOUT_ALIGN - 1) & ~(uint64_t)(GH_LAYOUT_ALIGN - 1);
+    offsets[0] = 0;
+    if (end <= GH_CHUNK_SIZE) return 1;
+    uint64_t span = end - GH_CHUNK_SIZE;
+
+    int n = 3;
+    for (uint64_t step = 512ULL << 20; file_size >= step && n < GH_SAMPLE_MAX; step <<= 1) n++;
+    if ((uint64_t)n - 1 > span / GH_CHUNK_SIZE) n = (int)(span / GH_CHUNK_SIZE) + 1;   // Keep the samples a chunk apart
+    if (n < 2) n = 2;
+
+    uint64_t q = span / (uint64_t)(n - 1), r = span % (uint64_t)(n - 1);
+    for (int i = 1; i < n; i++) {
+        uint64_t off = q * (uint64_t)i + r * (uint64_t)i / (uint64_t)(n - 1);
+        offsets[i] = (int64_t)(off & ~(uint64_t)(GH_LAYOUT_ALIGN - 1));
+    }
+    return n;
+}
+
+unsigned gh_dio_alignment(const struct statx *stx) {
+    if (!(stx->stx_mask & STATX_DIOALIGN)) return GH_DIO_ALIGN_MAX;
+    unsigned align = stx->stx_dio_offset_align;
+    if (stx->stx_dio_mem_align > align) align = stx->stx_dio_mem_align;
+    if (align == 0 || align > GH_DIO_ALIGN_MAX || (align & (align - 1)) != 0) return 0;
+    return align;
+}
+
+size_t gh_dio_window(int64_t off, unsigned align, int64_t *aoff, size_t *skip) {
+    *aoff = off & ~(int64_t)(align - 1);
+    *skip = (size_t)(off - *aoff);
+    return (*skip + GH_CHUNK_SIZE + align - 1) & ~(size_t)(align - 1);
+}
+
+ssize_t gh_dio_trim(ssize_t got, size_t skip) {
+    if (got < 0) return got;
+    if ((size_t)got <= skip) return 0;
+    got -= (ssize_t)skip;
+    return got > GH_CHUNK_SIZE ? GH_CHUNK_SIZE : got;
+}
+
+ssize_t gh_pread_uncached(int fd, unsigned char *buf, int64_t off, int *no_dontcache) {
+    if (!*no_dontcache) {
+        struct iovec iov = { buf, GH_CHUNK_SIZE };
+        ssize_t got = preadv2(fd, &iov, 1, (off_t)off, RWF_DONTCACHE);
+        if (got >= 0 || errno != EOPNOTSUPP) return got;
+        *no_dontcache = 1;
+    }
+    ssize_t got = pread(fd, buf, GH_CHUNK_SIZE, (off_t)off);
+    posix_fadvise(fd, (off_t)off, GH_CHUNK_SIZE, POSIX_FADV_DONTNEED);
+    return got;
+}
+
+static inline uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Charges the time since *mark to *phase when timing is on. */
+static inline void lap(int timing, uint64_t *phase, uint64_t *mark) {
+    if (!timing) return;
+    uint64_t now = clock_ns();
+    *phase += now - *mark;
+    *mark = now;
+}
+
+/* ================= SCRATCH ================= */
+
+struct full_state;
+
+/* Buffers a hashing thread keeps for its next file, so steady-state hashing allocates nothing */
+typedef struct {
+    unsigned char *sample;        // GH_SAMPLE_BUF_SIZE, GH_DIO_ALIGN_MAX aligned
+    struct full_state *full;      // Sample copies of gh_hash_full_path()
+    unsigned char *stream[2];     // GH_FULL_BUF each, GH_DIO_ALIGN_MAX aligned
+} scratch;
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+static void scratch_free(void *arg) {
+    scratch *s = arg;
+    free(s->sample);
+    free(s->full);
+    free(s->stream[0]);
+    free(s->stream[1]);
+    free(s);
+}
+
+static void scratch_init(void) {
+    pthread_key_create(&scratch_key, scratch_free);
+}
+
+/* The calling thread's buffers, released when it exits; NULL if out of memory. */
+static scratch *thread_scratch(void) {
+    pthread_once(&scratch_once, scratch_init);
+    scratch *s = pthread_getspecific(scratch_key);
+    if (!s && (s = calloc(1, sizeof(scratch))) && pthread_setspecific(scratch_key, s) != 0) {
+        free(s);
+        s = NULL;
+    }
+    return s;
+}
+
+static unsigned char *scratch_sample(void) {
+    scratch *s = thread_scratch();
+    if (!s) return NULL;
+    if (!s->sample && posix_memalign((void **)&s->sample, GH_DIO_ALIGN_MAX, GH_SAMPLE_BUF_SIZE) != 0) s->sample = NULL;
+    return s->sample;
+}
+
+/**
+ * hash_open_fd: Shared body of gh_hash_path() and gh_hash_fd(). direct says
+ * whether fd was opened with O_DIRECT; it is cleared again if the filesystem
+ * reports an alignment the sample buffer cannot meet.
+ */
+static unsigned long long hash_open_fd(const gh_options *opt, int fd, int direct, gh_result *res, uint64_t *mark) {
+    int timing = (opt->flags & GH_TIMING) != 0;
+    const gh_algo *algo = opt->algo ? opt->algo : &GH_ALGOS[0];
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) { res->error = errno; return 0; }
+    unsigned long long file_size = (unsigned long long)st.st_size;
+    res->size = file_size;
+    res->dev = (uint64_t)st.st_dev;
+    res->ino = (uint64_t)st.st_ino;
+    res->mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    res->mtime_nsec = st.st_mtim.tv_nsec;
+    lap(timing, &res->open_ns, mark);
+
+    unsigned align = 0;
+    if (direct) {
+        struct statx stx;
+        if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0) align = gh_dio_alignment(&stx);
+        if (!align) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+    }
+    int uncached = opt->pagecache != GH_PAGECACHE_KEEP && !align;
+    int no_dontcache = 0;
+
+    unsigned char *buffer = scratch_sample();
+    if (!buffer) { res->error = ENOMEM; return 0; }
+    unsigned long long hash = algo->seed(file_size);
+    ssize_t bytesRead;
+
+    int64_t offsets[GH_SAMPLE_MAX];
+    int nsamples = gh_sample_layout(opt->layout, file_size, offsets);
+    if (((opt->flags & GH_REMOTE) || (opt->layout == GH_LAYOUT_V2 && !uncached)) && !align) {
+        // Fetch all samples in one round of requests and skip readahead past them
+        posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+        for (int i = 0; i < nsamples; i++) posix_fadvise(fd, (off_t)offsets[i], GH_CHUNK_SIZE, POSIX_FADV_WILLNEED);
+    } else if (uncached) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);   // Readahead pages would stay behind
+    }
+    for (int i = 0; i < nsamples; i++) {
+        size_t skip = 0;
+        if (align) {
+            // Read the enclosing aligned range and hash only the sample inside it
+            int64_t aoff;
+            size_t len = gh_dio_window(offsets[i], align, &aoff, &skip);
+            bytesRead = pread(fd, buffer, len, (off_t)aoff);
+        } else if (uncached) {
+            bytesRead = gh_pread_uncached(fd, buffer, offsets[i], &no_dontcache);
+        } else {
+            bytesRead = pread(fd, buffer, GH_CHUNK_SIZE, (off_t)offsets[i]);
+        }
+        lap(timing, &res->read_ns, mark);
+        if (bytesRead > 0) res->bytes_read += (uint64_t)bytesRead;
+        else if (bytesRead < 0) res->read_errors++;
+        bytesRead = gh_dio_trim(bytesRead, skip);
+        if (bytesRead > 0) hash = algo->update(hash, buffer + skip, (size_t)bytesRead);
+        lap(timing, &res->hash_ns, mark);
+    }
+    res->reads = (unsigned)nsamples;
+    res->hash = hash;
+    return hash;
+}
+
+unsigned long long gh_hash_path(const gh_options *opt, const char *path, gh_result *res) {
+    gh_result local;
+    if (!opt) opt = &GH_DEFAULTS;
+    if (!res) res = &local;
+    memset(res, 0, sizeof(*res));
+    uint64_t mark = (opt->flags & GH_TIMING) ? clock_ns() : 0;
+
+    int direct = opt->pagecache == GH_PAGECACHE_DIRECT;
+    int fd = open(path, O_RDONLY | O_NOATIME | (direct ? O_DIRECT : 0));
+    if (fd == -1 && direct && errno == EINVAL) {
+        direct = 0;   // No O_DIRECT on this filesystem: read through the cache and drop the pages
+        fd = open(path, O_RDONLY | O_NOATIME);
+    }
+    if (fd == -1) { res->error = errno; return 0; }
+
+    unsigned long long hash = hash_open_fd(opt, fd, direct, res, &mark);
+    close(fd);
+    lap((opt->flags & GH_TIMING) != 0, &res->open_ns, &mark);
+    return hash;
+}
+
+unsigned long long gh_hash_fd(const gh_options *opt, int fd, gh_result *res) {
+    gh_result local;
+    if (!opt) opt = &GH_DEFAULTS;
+    if (!res) res = &local;
+    memset(res, 0, sizeof(*res));
+    uint64_t mark = (opt->flags & GH_TIMING) ? clock_ns() : 0;
+
+    // An fd opened with O_DIRECT needs aligned reads whatever the policy says
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1) { res->error = errno; return 0; }
+    int direct = (flags & O_DIRECT) != 0;
+    if (!direct && opt->pagecache == GH_PAGECACHE_DIRECT) direct = fcntl(fd, F_SETFL, flags | O_DIRECT) == 0;
+
+    unsigned long long hash = hash_open_fd(opt, fd, direct, res, &mark);
+    if ((fcntl(fd, F_GETFL) ^ flags) & O_DIRECT) fcntl(fd, F_SETFL, flags);
+    return hash;
+}
+
+/* ================= FULL HASH ================= */
+
+typedef struct full_state {
+    const gh_algo *algo;
+    gh_result *res;
+    int timing;
+    uint64_t *mark;
+    unsigned long long full;
+    int64_t pos;                  // File offset of the next byte fed
+    int nsamples;
+    int64_t offsets[GH_SAMPLE_MAX];
+    size_t lens[GH_SAMPLE_MAX];
+    unsigned char samples[GH_SAMPLE_MAX][GH_CHUNK_SIZE];
+} full_state;
+
+/* Hashes n streamed bytes and copies out whatever part of the sparse samples they hold. */
+static void full_feed(full_state *f, const unsigned char *data, size_t n) {
+    for (int i = 0; i < f->nsamples; i++) {
+        int64_t lo = f->offsets[i] > f->pos ? f->offsets[i] : f->pos;
+        int64_t hi = f->offsets[i] + (int64_t)f->lens[i];
+        if (hi > f->pos + (int64_t)n) hi = f->pos + (int64_t)n;
+        if (lo < hi) memcpy(f->samples[i] + (lo - f->offsets[i]), data + (lo - f->pos), (size_t)(hi - lo));
+    }
+    for (size_t i = 0; i < n; i += GH_FULL_BLOCK) {
+        f->full = f->algo->update(f->full, data + i, n - i < GH_FULL_BLOCK ? n - i : GH_FULL_BLOCK);
+    }
+    f->pos += (int64_t)n;
+}
+
+/*
+ * Touching a mapped page past the end of a file that shrank raises SIGBUS.
+ * While a thread hashes a window, map_guard points at its jump buffer and the
+ * handler returns there; any other SIGBUS goes to the previous handler.
+ */
+static __thread sigjmp_buf *map_guard;
+static __thread const unsigned char *map_lo, *map_hi;
+static struct sigaction map_prev;
+static pthread_once_t map_once = PTHREAD_ONCE_INIT;
+
+static void map_sigbus(int sig, siginfo_t *info, void *uctx) {
+    const unsigned char *addr = info->si_addr;
+    if (map_guard && addr >= map_lo && addr < map_hi) siglongjmp(*map_guard, 1);
+    if (map_prev.sa_flags & SA_SIGINFO) {
+        map_prev.sa_sigaction(sig, info, uctx);
+    } else if (map_prev.sa_handler != SIG_DFL && map_prev.sa_handler != SIG_IGN) {
+        map_prev.sa_handler(sig);
+    } else {
+        signal(SIGBUS, SIG_DFL);   // The faulting access runs again and takes the default action
+    }
+}
+
+static void map_install(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = map_sigbus;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGBUS, &sa, &map_prev);
+}
+
+/**
+ * full_mmap: Hashes the file through GH_FULL_WINDOW mappings, asking for the
+ * next window while the current one is hashed. A window the file no longer
+ * covers, checked before it is mapped and caught by the SIGBUS guard while it
+ * is hashed, ends the hash with a read error. Returns -1 if the first window
+ * cannot be mapped, so the caller can fall back to reads.
+ */
+static int full_mmap(full_state *f, int fd, uint64_t size) {
+    pthread_once(&map_once, map_install);
+    for (uint64_t off = 0; off < size; off += GH_FULL_WINDOW) {
+        size_t len = size - off < GH_FULL_WINDOW ? (size_t)(size - off) : GH_FULL_WINDOW;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < off + len) {
+            f->res->read_errors++;
+            break;
+        }
+        unsigned char *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, (off_t)off);
+        if (map == MAP_FAILED) {
+            if (off == 0) return -1;
+            f->res->read_errors++;
+            break;
+        }
+        sigjmp_buf jump;
+        if (sigsetjmp(jump, 1) != 0) {
+            // Truncated under us: the bytes fed so far stay, the rest is an error
+            map_guard = NULL;
+            munmap(map, len);
+            f->res->read_errors++;
+            break;
+        }
+        madvise(map, len, MADV_SEQUENTIAL);
+        if (off + len < size) posix_fadvise(fd, (off_t)(off + len), GH_FULL_WINDOW, POSIX_FADV_WILLNEED);
+        map_lo = map;
+        map_hi = map + len;
+        map_guard = &jump;
+        full_feed(f, map, len);
+        map_guard = NULL;
+        munmap(map, len);
+        f->res->reads++;
+        f->res->bytes_read += len;
+    }
+    lap(f->timing, &f->res->read_ns, f->mark);   // Page faults and hashing do not separate
+    return 0;
+}
+
+typedef struct {
+    int fd;
+    unsigned align;               // O_DIRECT granularity, 0 for buffered reads
+    int uncached;
+    int no_dontcache;
+    uint64_t size;
+    size_t buf_size;
+    unsigned char *buf[2];
+    ssize_t len[2];               // Bytes in buf[i] once ready[i], -1 on error
+    int ready[2];
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} full_reader;
+
+/* Reads the want bytes at off, short only at an error or an early EOF. */
+static ssize_t full_read(full_reader *r, unsigned char *buf, int64_t off, size_t want) {
+    size_t got = 0;
+    while (got < want) {
+        // O_DIRECT transfers whole aligned blocks; the tail of the file ends the read early
+        size_t len = r->align ? ((want - got + r->align - 1) & ~(size_t)(r->align - 1)) : want - got;
+        ssize_t n;
+        if (r->uncached && !r->no_dontcache) {
+            struct iovec iov = { buf + got, len };
+            n = preadv2(r->fd, &iov, 1, (off_t)(off + (int64_t)got), RWF_DONTCACHE);
+            if (n < 0 && errno == EOPNOTSUPP) { r->no_dontcache = 1; continue; }
+        } else {
+            n = pread(r->fd, buf + got, len, (off_t)(off + (int64_t)got));
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        got += (size_t)n;
+    }
+    if (r->uncached && r->no_dontcache) posix_fadvise(r->fd, (off_t)off, (off_t)got, POSIX_FADV_DONTNEED);
+    return (ssize_t)(got < want ? got : want);
+}
+
+/* Helper thread: fills the buffers in turn, each as soon as the hasher hands it back. */
+static void *full_reader_main(void *arg) {
+    full_reader *r = arg;
+    int k = 0;
+    for (uint64_t off = 0; off < r->size; off += r->buf_size, k ^= 1) {
+        pthread_mutex_lock(&r->lock);
+        while (r->ready[k] && !r->stop) pthread_cond_wait(&r->cond, &r->lock);
+        int stop = r->stop;
+        pthread_mutex_unlock(&r->lock);
+        if (stop) break;
+
+        size_t want = r->size - off < r->buf_size ? (size_t)(r->size - off) : r->buf_size;
+        ssize_t got = full_read(r, r->buf[k], (int64_t)off, want);
+        pthread_mutex_lock(&r->lock);
+        r->len[k] = got;
+        r->ready[k] = 1;
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+        if (got < (ssize_t)want) break;
+    }
+    return NULL;
+}
+
+/**
+ * full_stream: Hashes the file through two buffers. Files that fit in one are
+ * read inline; larger ones get a reader thread so the next buffer is in flight
+ * while the current one is hashed.
+ */
+static int full_stream(full_state *f, int fd, uint64_t size, unsigned align, int uncached) {
+    full_reader r;
+    memset(&r, 0, sizeof(r));
+    r.fd = fd;
+    r.align = align;
+    r.uncached = uncached;
+    r.size = size;
+    r.buf_size = GH_FULL_BUF;
+    int threaded = size > GH_FULL_BUF;
+    if (!threaded) r.buf_size = (size_t)((size + GH_DIO_ALIGN_MAX - 1) & ~(uint64_t)(GH_DIO_ALIGN_MAX - 1));
+    if (r.buf_size == 0) return 0;
+    scratch *s = thread_scratch();
+    if (!s) return -1;
+    for (int i = 0; i < 1 + threaded; i++) {
+        if (!s->stream[i] && posix_memalign((void **)&s->stream[i], GH_DIO_ALIGN_MAX, GH_FULL_BUF) != 0) {
+            s->stream[i] = NULL;
+            return -1;
+        }
+        r.buf[i] = s->stream[i];
+    }
+
+    if (!threaded) {
+        ssize_t got = full_read(&r, r.buf[0], 0, (size_t)size);
+        lap(f->timing, &f->res->read_ns, f->mark);
+        if (got > 0) full_feed(f, r.buf[0], (size_t)got);
+        lap(f->timing, &f->res->hash_ns, f->mark);
+        f->res->reads = 1;
+        f->res->bytes_read = got > 0 ? (uint64_t)got : 0;
+        if (got < (ssize_t)size) f->res->read_errors++;
+        return 0;
+    }
+
+    pthread_mutex_init(&r.lock, NULL);
+    pthread_cond_init(&r.cond, NULL);
+    pthread_t reader;
+    int rc = pthread_create(&reader, NULL, full_reader_main, &r);
+    if (rc == 0) {
+        int k = 0;
+        for (uint64_t off = 0; off < size; off += r.buf_size, k ^= 1) {
+            size_t want = size - off < r.buf_size ? (size_t)(size - off) : r.buf_size;
+            pthread_mutex_lock(&r.lock);
+            while (!r.ready[k]) pthread_cond_wait(&r.cond, &r.lock);
+            ssize_t got = r.len[k];
+            pthread_mutex_unlock(&r.lock);
+            lap(f->timing, &f->res->read_ns, f->mark);
+
+            if (got > 0) full_feed(f, r.buf[k], (size_t)got);
+            lap(f->timing, &f->res->hash_ns, f->mark);
+            f->res->reads++;
+            if (got > 0) f->res->bytes_read += (uint64_t)got;
+            if (got < (ssize_t)want) { f->res->read_errors++; break; }
+
+            pthread_mutex_lock(&r.lock);
+            r.ready[k] = 0;
+            pthread_cond_broadcast(&r.cond);
+            pthread_mutex_unlock(&r.lock);
+        }
+        pthread_mutex_lock(&r.lock);
+        r.stop = 1;
+        pthread_cond_broadcast(&r.cond);
+        pthread_mutex_unlock(&r.lock);
+        pthread_join(reader, NULL);
+    }
+    pthread_cond_destroy(&r.cond);
+    pthread_mutex_destroy(&r.lock);
+    return rc == 0 ? 0 : -1;
+}
+
+unsigned long long gh_hash_full_path(const gh_options *opt, const char *path, gh_result *res) {
+    gh_result local;
+    if (!opt) opt = &GH_DEFAULTS;
+    if (!res) res = &local;
+    memset(res, 0, sizeof(*res));
+    int timing = (opt->flags & GH_TIMING) != 0;
+    uint64_t mark = timing ? clock_ns() : 0;
+
+    int direct = opt->pagecache == GH_PAGECACHE_DIRECT;
+    int fd = open(path, O_RDONLY | O_NOATIME | (direct ? O_DIRECT : 0));
+    if (fd == -1 && direct && errno == EINVAL) {
+        direct = 0;
+        fd = open(path, O_RDONLY | O_NOATIME);
+    }
+    if (fd == -1) { res->error = errno; return 0; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) { res->error = errno; close(fd); return 0; }
+    uint64_t size = (uint64_t)st.st_size;
+    res->size = size;
+    res->dev = (uint64_t)st.st_dev;
+    res->ino = (uint64_t)st.st_ino;
+    res->mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    res->mtime_nsec = st.st_mtim.tv_nsec;
+    lap(timing, &res->open_ns, &mark);
+
+    unsigned align = 0;
+    if (direct) {
+        struct statx stx;
+        if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0) align = gh_dio_alignment(&stx);
+        if (!align) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+    }
+    int uncached = opt->pagecache != GH_PAGECACHE_KEEP && !align;
+
+    scratch *s = thread_scratch();
+    if (s && !s->full) s->full = malloc(sizeof(full_state));   // 256KB of samples: keep it off thread stacks
+    full_state *f = s ? s->full : NULL;
+    if (!f) { res->error = ENOMEM; close(fd); return 0; }
+    f->algo = opt->algo ? opt->algo : &GH_ALGOS[0];
+    f->res = res;
+    f->timing = timing;
+    f->mark = &mark;
+    f->full = f->algo->seed(size);
+    f->pos = 0;
+    f->nsamples = gh_sample_layout(opt->layout, size, f->offsets);
+    for (int i = 0; i < f->nsamples; i++) {
+        uint64_t left = size - (uint64_t)f->offsets[i];
+        f->lens[i] = left < GH_CHUNK_SIZE ? (size_t)left : GH_CHUNK_SIZE;
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    int rc = -1;
+    if (!(opt->flags & (GH_REMOTE | GH_NO_MMAP)) && opt->pagecache == GH_PAGECACHE_KEEP) rc = full_mmap(f, fd, size);
+    if (rc != 0) rc = full_stream(f, fd, size, align, uncached);
+    close(fd);
+
+    unsigned long long full = 0;
+    if (rc == 0) {
+        // Samples the stream never reached (the file shrank) are left out, as a failed pread would be
+        unsigned long long hash = f->algo->seed(size);
+        for (int i = 0; i < f->nsamples; i++) {
+            int64_t got = f->pos - f->offsets[i];
+            if (got > (int64_t)f->lens[i]) got = (int64_t)f->lens[i];
+            if (got > 0) hash = f->algo->update(hash, f->samples[i], (size_t)got);
+        }
+        res->hash = hash;
+        res->full_hash = full = f->full;
+    } else {
+        res->error = ENOMEM;
+    }
+    lap(timing, &res->open_ns, &mark);
+    return full;
+}
+
+/* ================= EXTENSIONS ================= */
+
+static const char *const GH_MEDIA_EXTS[] = {
+    "mp4", "mkv", "avi", "mov", "wmv", "flv", "webm", "m4v", "mpg", "mpeg", "ts", "m2ts"
+};
+
+/* Lowercased bytes of ext in a uint64_t, or 0 if ext is empty or too long. */
+static inline uint64_t ext_pack(const char *ext) {
+    uint64_t key = 0;
+    for (int i = 0; ext[i]; i++) {
+        if (i == GH_EXT_MAX_LEN) return 0;
+        unsigned char c = (unsigned char)ext[i];
+        if (c >= 'A' && c <= 'Z') c |= 0x20;
+        key |= (uint64_t)c << (8 * i);
+    }
+    return key;
+}
+
+static inline unsigned ext_slot(uint64_t key) {
+    return (unsigned)((key * 0x9e3779b97f4a7c15ULL) >> 58);   // Top log2(GH_EXT_SLOTS) bits
+}
+
+static int ext_insert(gh_ext_set *set, uint64_t key) {
+    unsigned i = ext_slot(key);
+    while (set->keys[i] && set->keys[i] != key) i = (i + 1) & (GH_EXT_SLOTS - 1);
+    if (set->keys[i]) return 0;
+    if (set->count == GH_EXT_SLOTS / 2) return -1;   // Keeps probe runs short
+    set->keys[i] = key;
+    set->count++;
+    return 0;
+}
+
+void gh_ext_defaults(gh_ext_set *set) {
+    memset(set, 0, sizeof(*set));
+    for (size_t i = 0; i < sizeof(GH_MEDIA_EXTS) / sizeof(GH_MEDIA_EXTS[0]); i++) ext_insert(set, ext_pack(GH_MEDIA_EXTS[i]));
+}
+
+int gh_ext_add(gh_ext_set *set, const char *ext) {
+    if (*ext == '.') ext++;
+    uint64_t key = ext_pack(ext);
+    return key ? ext_insert(set, key) : -1;
+}
+
+void gh_ext_remove(gh_ext_set *set, const char *ext) {
+    if (*ext == '.') ext++;
+    uint64_t key = ext_pack(ext);
+    if (!key) return;
+    // Rebuild without it; linear probing cannot just clear a slot
+    gh_ext_set old = *set;
+    memset(set, 0, sizeof(*set));
+    for (unsigned i = 0; i < GH_EXT_SLOTS; i++) {
+        if (old.keys[i] && old.keys[i] != key) ext_insert(set, old.keys[i]);
+    }
+}
+
+int gh_ext_match(const gh_ext_set *set, const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (!dot) return 0;
+    uint64_t key = ext_pack(dot + 1);
+    if (!key) return 0;
+    for (unsigned i = ext_slot(key);; i = (i + 1) & (GH_EXT_SLOTS - 1)) {
+        if (set->keys[i] == key) return 1;
+        if (set->keys[i] == 0) return 0;
+    }
+}
+
+static gh_ext_set media_exts;
+static pthread_once_t media_exts_once = PTHREAD_ONCE_INIT;
+
+static void media_exts_init(void) {
+    gh_ext_defaults(&media_exts);
+}
+
+int gh_is_media_file(const char *name) {
+    pthread_once(&media_exts_once, media_exts_init);
+    return gh_ext_match(&media_exts, name);
+}
+
+/* ================= WALKER ================= */
+
+/* Directories the walk is inside of, so a followed link back up is noticed */
+typedef struct walk_frame {
+    dev_t dev;
+    ino_t ino;
+    const struct walk_frame *up;
+} walk_frame;
+
+typedef struct {
+    char *path;            // The entry being looked at: the root, extended by one name per level
+    size_t len, cap;
+    const gh_ext_set *exts;
+    int follow;
+    gh_visit_fn visit;
+    void *user;
+} walk_state;
+
+/* Appends "/name" to w->path; the caller truncates it back to len afterwards. */
+static int walk_push(walk_state *w, const char *name) {
+    size_t n = strlen(name), need = w->len + 1 + n + 1;
+    if (need > w->cap) {
+        size_t cap = w->cap * 2;
+        while (cap < need) cap *= 2;
+        char *path = realloc(w->path, cap);
+        if (!path) return -1;
+        w->path = path;
+        w->cap = cap;
+    }
+    w->path[w->len++] = '/';
+    memcpy(w->path + w->len, name, n + 1);
+    w->len += n;
+    return 0;
+}
+
+static int walk_path(walk_state *w, const walk_frame *up) {
+    struct stat st;
+    if ((w->follow ? stat(w->path, &st) : lstat(w->path, &st)) != 0) return GH_WALK_CONTINUE;
+
+    if (S_ISDIR(st.st_mode)) {
+        for (const walk_frame *f = up; f; f = f->up) {
+            if (f->dev == st.st_dev && f->ino == st.st_ino) return GH_WALK_CONTINUE;   // A link to an ancestor
+        }
+        int rc = w->visit(w->path, &st, w->user);
+        if (rc != GH_WALK_CONTINUE) return rc == GH_WALK_STOP ? GH_WALK_STOP : GH_WALK_CONTINUE;
+        DIR *dir = opendir(w->path);
+        if (!dir) return GH_WALK_CONTINUE;
+        walk_frame here = { st.st_dev, st.st_ino, up };
+        size_t len = w->len;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            // Entries the filter rejects are never stat'ed, unless only lstat can tell a directory
+            unsigned char type = entry->d_type;
+            if (type != DT_DIR && type != DT_UNKNOWN && !(w->follow && type == DT_LNK) &&
+                (type != DT_REG || (w->exts && !gh_ext_match(w->exts, entry->d_name)))) continue;
+            if (walk_push(w, entry->d_name) != 0) continue;
+            int sub = walk_path(w, &here);
+            w->len = len;
+            w->path[len] = '\0';
+            if (sub == GH_WALK_STOP) { rc = GH_WALK_STOP; break; }
+        }
+        closedir(dir);
+        return rc;
+    }
+    if (!S_ISREG(st.st_mode)) return GH_WALK_CONTINUE;
+    if (w->exts && !gh_ext_match(w->exts, w->path)) return GH_WALK_CONTINUE;   // The root, a link, or an entry without d_type
+    return w->visit(w->path, &st, w->user) == GH_WALK_STOP ? GH_WALK_STOP : GH_WALK_CONTINUE;
+}
+
+/* One path buffer for the whole walk; each level appends its name and truncates it again. */
+static int walk_root(const char *path, const gh_ext_set *exts, int follow, gh_visit_fn visit, void *user) {
+    walk_state w = { NULL, strlen(path), 256, exts, follow, visit, user };
+    while (w.cap < w.len + 1) w.cap *= 2;
+    if (!(w.path = malloc(w.cap))) return GH_WALK_CONTINUE;
+    memcpy(w.path, path, w.len + 1);
+    int rc = walk_path(&w, NULL);
+    free(w.path);
+    return rc;
+}
+
+int gh_walk(const char *path, gh_visit_fn visit, void *user) {
+    return walk_root(path, NULL, 0, visit, user);
+}
+
+int gh_walk_ext(const char *path, const gh_ext_set *exts, gh_visit_fn visit, void *user) {
+    return walk_root(path, exts, 0, visit, user);
+}
+
+int gh_walk_follow(const char *path, const gh_ext_set *exts, gh_visit_fn visit, void *user) {
+    return walk_root(path, exts, 1, visit, user);
+}
+
+/* ================= BATCH ================= */
+
+typedef struct {
+    const gh_options *opt;
+    gh_callback cb;
+    void *user;
+    size_t hashed;
+} many_state;
+
+static int many_hash(many_state *m, const char *path) {
+    gh_result res;
+    unsigned long long hash = (m->opt->flags & GH_FULL) ? gh_hash_full_path(m->opt, path, &res)
+                                                        : gh_hash_path(m->opt, path, &res);
+    if (hash != 0) m->hashed++;
+    return m->cb && m->cb(path, &res, m->user) != 0 ? GH_WALK_STOP : GH_WALK_CONTINUE;
+}
+
+static int many_visit(const char *path, const struct stat *st, void *arg) {
+    many_state *m = arg;
+    if (S_ISDIR(st->st_mode)) return GH_WALK_CONTINUE;
+    return many_hash(m, path);   // gh_walk_ext() already applied the extension filter
+}
+
+size_t gh_hash_many(const gh_options *opt, const char *const *paths, size_t n, gh_callback cb, void *user) {
+    many_state m = { opt ? opt : &GH_DEFAULTS, cb, user, 0 };
+    for (size_t i = 0; i < n; i++) {
+        struct stat st;
+        int rc;
+        if ((m.opt->flags & GH_RECURSIVE) && lstat(paths[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+            const gh_ext_set *exts = NULL;
+            if (!(m.opt->flags & GH_ALL_FILES)) {
+                if (!(exts = m.opt->exts)) {
+                    pthread_once(&media_exts_once, media_exts_init);
+                    exts = &media_exts;
+                }
+            }
+            rc = gh_walk_ext(paths[i], exts, many_visit, &m);
+        } else {
+            rc = many_hash(&m, paths[i]);
+        }
+        if (rc == GH_WALK_STOP) break;
+    }
+    return m.hashed;
+}
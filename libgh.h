@@ -0,0 +1,331 @@
+/*
+ * =====================================================================================
+ * libgh: Embeddable sparse media fingerprinting
+ * =====================================================================================
+ *
+ * The hashing core of gh as a library. A fingerprint is the file size plus
+ * 16KB samples from the head, middle and tail of the file (layout v1; v2
+ * takes more, block-aligned ones on large files), fed to a hash kernel.
+ * Results are identical to the gh command line tool.
+ *
+ * The library keeps no global state: every setting travels in a gh_options
+ * and every outcome comes back in a gh_result, so all functions may be called
+ * from any number of threads at once. Each calling thread keeps its aligned
+ * sample buffers for its next file; they are freed when the thread exits.
+ *
+ *   gh_options opt = { gh_algo_find("fnv1a"), GH_PAGECACHE_KEEP, 0, NULL, GH_LAYOUT_V1 };
+ *   gh_result res;
+ *   if (gh_hash_path(&opt, "movie.mkv", &res)) printf("%016llx\n", res.hash);
+ *
+ * COMPILATION:
+ * gcc -O3 -c libgh.c && ar rcs libgh.a libgh.o                   (static)
+ * gcc -O3 -fPIC -shared -o libgh.so libgh.c -pthread              (shared)
+ * =====================================================================================
+ */
+
+#ifndef LIBGH_H
+#define LIBGH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GH_CHUNK_SIZE 16384             // 16KB sample size per block
+#define GH_SAMPLE_COUNT 3               // Head, Middle and Tail
+#define GH_SAMPLE_MAX 16                // Most samples a layout takes (v2 on files of 2TB and up)
+#define GH_LAYOUT_V1 1                  // Head, middle and tail at exact offsets (the default)
+#define GH_LAYOUT_V2 2                  // GH_LAYOUT_ALIGN aligned samples, more of them on large files
+#define GH_LAYOUT_ALIGN 4096            // v2 sample alignment, the block size of common local filesystems
+#define GH_LAYOUT_V2_ID 0x40000000U     // gh_algo.id bit that marks v2 fingerprints in caches and logs
+#define GH_DIO_ALIGN_MAX 4096           // Largest O_DIRECT alignment GH_PAGECACHE_DIRECT handles
+#define GH_SAMPLE_BUF_SIZE (GH_CHUNK_SIZE + GH_DIO_ALIGN_MAX)  // One sample widened to aligned bounds
+#define GH_EXT_MAX_LEN 8                // Longest extension (without the dot) a gh_ext_set holds
+#define GH_EXT_SLOTS 64                 // Table size; a set holds up to half as many extensions
+#define GH_FULL_BLOCK (1 << 20)         // Full digests feed the kernel 1MB at a time
+#define GH_FULL_BUF (8 << 20)           // Read size of each of the two full-hash buffers
+#define GH_FULL_WINDOW (64 << 20)       // mmap window of a full hash
+#define GH_FULL_ID 0x80000000U          // gh_algo.id bit that marks full digests in caches and logs
+
+/* ================= OPTIONS ================= */
+
+typedef struct {
+    const char *name;
+    uint32_t id;                                            // Stable id, stored in caches and logs
+    unsigned long long (*seed)(unsigned long long file_size);
+    unsigned long long (*update)(unsigned long long hash, const unsigned char *data, size_t len);
+} gh_algo;
+
+enum { GH_PAGECACHE_KEEP, GH_PAGECACHE_DROP, GH_PAGECACHE_DIRECT };
+
+enum {
+    GH_REMOTE = 1 << 0,       // No readahead, WILLNEED hints for the samples (NFS/SMB/FUSE)
+    GH_RECURSIVE = 1 << 1,    // gh_hash_many(): walk directories
+    GH_ALL_FILES = 1 << 2,    // gh_hash_many(): hash walked files regardless of extension
+    GH_TIMING = 1 << 3,       // Fill the *_ns fields of gh_result
+    GH_FULL = 1 << 4,         // gh_hash_many(): full digests (gh_hash_full_path)
+    GH_NO_MMAP = 1 << 5       // Full hashes: read() even on local disks (files that may shrink meanwhile)
+};
+
+/*
+ * A set of file extensions, compiled once for constant-time lookups: each
+ * extension is packed, lowercased, into the bytes of a uint64_t and stored in
+ * an open-addressing table, so a lookup is one multiply and usually one
+ * compare. Plain data: copy it, share it read-only between threads.
+ */
+typedef struct {
+    uint64_t keys[GH_EXT_SLOTS];   // Packed extensions, 0 = empty
+    unsigned count;
+} gh_ext_set;
+
+typedef struct {
+    const gh_algo *algo;      // NULL for fnv1a
+    int pagecache;            // GH_PAGECACHE_*
+    unsigned flags;           // GH_* bits
+    const gh_ext_set *exts;   // gh_hash_many(): extensions of walked files, NULL for the video defaults
+    unsigned layout;          // GH_LAYOUT_*, 0 for v1
+} gh_options;
+
+/* ================= RESULTS ================= */
+
+typedef struct {
+    unsigned long long hash;  // 0 when the file could not be opened or stat'ed
+    int error;                // errno of that failure
+    int read_errors;          // Samples whose read failed (they are left out of the hash)
+    unsigned long long full_hash;  // gh_hash_full_path() digest, 0 otherwise
+    uint64_t size;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    long mtime_nsec;
+    unsigned reads;           // Sample reads issued
+    uint64_t bytes_read;      // Bytes transferred, including O_DIRECT alignment padding
+    uint64_t open_ns;         // open, fstat and close (GH_TIMING only)
+    uint64_t read_ns;
+    uint64_t hash_ns;
+} gh_result;
+
+/* ================= HASHING ================= */
+
+/**
+ * gh_algo_find: Looks up a kernel ("fnv1a" or "vec64") by name. Returns NULL
+ * for unknown names.
+ */
+const gh_algo *gh_algo_find(const char *name);
+
+/**
+ * gh_vec64_impl: "avx2", "neon" or "scalar", whichever vec64 runs on this CPU.
+ */
+const char *gh_vec64_impl(void);
+
+/**
+ * gh_hash_path: Opens, fingerprints and closes one file. Returns the hash,
+ * or 0 with res->error set. opt and res may be NULL.
+ */
+unsigned long long gh_hash_path(const gh_options *opt, const char *path, gh_result *res);
+
+/**
+ * gh_hash_fd: Fingerprints an open descriptor with pread, leaving its file
+ * offset alone. With GH_PAGECACHE_DIRECT, O_DIRECT is set on the open file
+ * description for the duration of the call.
+ */
+unsigned long long gh_hash_fd(const gh_options *opt, int fd, gh_result *res);
+
+/**
+ * gh_hash_full_path: Streams the whole file through the kernel and returns its
+ * full-content digest, also stored in res->full_hash. res->hash receives the
+ * sparse fingerprint of the same bytes, identical to gh_hash_path(). The digest
+ * is algo->seed(size) followed by algo->update() over consecutive GH_FULL_BLOCK
+ * blocks, whatever the I/O path: local files are mmap'd with MADV_SEQUENTIAL,
+ * while GH_REMOTE, GH_NO_MMAP and the DROP/DIRECT page cache policies read into
+ * two aligned buffers, one filled by a helper thread while the other is hashed.
+ * A file that shrinks while it is read counts as a read error. To catch that on
+ * a mapping, the first mmap'd hash installs a SIGBUS handler that passes every
+ * fault outside its windows on to the handler it replaced.
+ */
+unsigned long long gh_hash_full_path(const gh_options *opt, const char *path, gh_result *res);
+
+/**
+ * gh_callback: Receives every file gh_hash_many() tried, failures included
+ * (res->hash == 0). Return nonzero to stop the batch.
+ */
+typedef int (*gh_callback)(const char *path, const gh_result *res, void *user);
+
+/**
+ * gh_hash_many: Fingerprints n paths in order. With GH_RECURSIVE, directories
+ * are walked depth-first in readdir order, and the files found in them are
+ * filtered by opt->exts (gh_is_media_file() if NULL) unless GH_ALL_FILES is
+ * set. Listed files are always hashed. Returns the number of files hashed
+ * successfully.
+ */
+size_t gh_hash_many(const gh_options *opt, const char *const *paths, size_t n, gh_callback cb, void *user);
+
+/* ================= EXTENSIONS ================= */
+
+/**
+ * gh_is_media_file: 1 if the name ends in a common video extension (the set
+ * gh_ext_defaults() builds).
+ */
+int gh_is_media_file(const char *name);
+
+/**
+ * gh_ext_defaults: Resets set to the common video extensions (mp4, mkv, avi,
+ * mov, wmv, flv, webm, m4v, mpg, mpeg, ts, m2ts).
+ */
+void gh_ext_defaults(gh_ext_set *set);
+
+/**
+ * gh_ext_add: Adds one extension, with or without the leading dot, in any
+ * case. Returns -1 if it is empty, longer than GH_EXT_MAX_LEN or the set is
+ * full.
+ */
+int gh_ext_add(gh_ext_set *set, const char *ext);
+
+/**
+ * gh_ext_remove: Removes one extension if present.
+ */
+void gh_ext_remove(gh_ext_set *set, const char *ext);
+
+/**
+ * gh_ext_match: 1 if the part of name after its last dot is in set.
+ */
+int gh_ext_match(const gh_ext_set *set, const char *name);
+
+/* ================= WALKER ================= */
+
+enum { GH_WALK_CONTINUE, GH_WALK_SKIP, GH_WALK_STOP };
+
+/**
+ * gh_visit_fn: Called for every directory (before its entries) and regular
+ * file. Symlinks (unless gh_walk_follow() follows them) and special files
+ * are not reported. Return GH_WALK_SKIP from a directory to leave it out,
+ * GH_WALK_STOP to end the walk. path lives in a buffer the walk reuses, so
+ * copy it to keep it past the call.
+ */
+typedef int (*gh_visit_fn)(const char *path, const struct stat *st, void *user);
+
+/**
+ * gh_walk: Depth-first traversal of path without following symlinks.
+ * Unreadable directories are skipped. Returns GH_WALK_STOP if a visitor
+ * ended the walk, GH_WALK_CONTINUE otherwise.
+ */
+int gh_walk(const char *path, gh_visit_fn visit, void *user);
+
+/**
+ * gh_walk_ext: gh_walk() that only reports files whose name matches exts
+ * (all files if NULL). Entries are filtered on their directory entry name and
+ * type, so rejected files are never stat'ed (unless the filesystem leaves
+ * d_type unknown).
+ */
+int gh_walk_ext(const char *path, const gh_ext_set *exts, gh_visit_fn visit, void *user);
+
+/**
+ * gh_walk_follow: gh_walk_ext() that follows symlinks, to files and to
+ * directories, and reports what they point to under the link's path. A
+ * directory that is already on the path from the root (a link cycle) is not
+ * entered again; one reached twice by other routes is, unless the visitor
+ * returns GH_WALK_SKIP for a (st_dev, st_ino) it has seen.
+ */
+int gh_walk_follow(const char *path, const gh_ext_set *exts, gh_visit_fn visit, void *user);
+
+/* ================= CUSTOM I/O ================= */
+/*
+ * Building blocks for callers that schedule their own reads (io_uring, network
+ * fetches). Hash with algo->seed(size), then algo->update() for each sample in
+ * gh_sample_layout() order. A sample is the GH_CHUNK_SIZE bytes at its offset,
+ * fewer where the file ends.
+ */
+
+/**
+ * gh_sample_offsets: Layout v1: Head, Middle (files > 48KB) and Tail (files >
+ * 16KB) offsets. Returns the number of samples.
+ */
+int gh_sample_offsets(uint64_t file_size, int64_t offsets[GH_SAMPLE_COUNT]);
+
+/**
+ * gh_sample_layout: Sample offsets of a GH_LAYOUT_* version (0 = v1). Layout
+ * v2 spreads evenly spaced samples from the head to the last GH_CHUNK_SIZE
+ * bytes, every offset aligned to GH_LAYOUT_ALIGN so a sample touches no more
+ * blocks than it must. Files under 512MB get 3; 512MB and every doubling
+ * after it add one, up to GH_SAMPLE_MAX. Returns the number of samples.
+ */
+int gh_sample_layout(unsigned layout, uint64_t file_size, int64_t offsets[GH_SAMPLE_MAX]);
+
+struct statx;
+
+/**
+ * gh_dio_alignment: Offset/length/memory granularity for O_DIRECT reads of a
+ * file statx'ed with STATX_DIOALIGN. Filesystems that do not report it get
+ * GH_DIO_ALIGN_MAX, which every common block size divides. Returns 0 when the
+ * file cannot be read with O_DIRECT into a GH_DIO_ALIGN_MAX aligned buffer.
+ */
+unsigned gh_dio_alignment(const struct statx *stx);
+
+/**
+ * gh_dio_window: Widens the GH_CHUNK_SIZE sample at off to aligned bounds.
+ * Sets *aoff to the aligned start and *skip to where the sample begins inside
+ * the read, and returns the aligned length (at most GH_SAMPLE_BUF_SIZE).
+ */
+size_t gh_dio_window(int64_t off, unsigned align, int64_t *aoff, size_t *skip);
+
+/**
+ * gh_dio_trim: Number of sample bytes in a widened read that returned got
+ * bytes, i.e. what a plain pread of GH_CHUNK_SIZE at the sample offset would
+ * have returned.
+ */
+ssize_t gh_dio_trim(ssize_t got, size_t skip);
+
+/**
+ * gh_pread_uncached: Reads one sample without leaving it in the page cache.
+ * RWF_DONTCACHE (Linux 6.14+) only drops the pages this read brought in.
+ * Without it the sample is read normally and dropped with POSIX_FADV_DONTNEED,
+ * which also evicts those 16KB if they were cached before. *no_dontcache
+ * remembers a refusal for the rest of the file.
+ */
+ssize_t gh_pread_uncached(int fd, unsigned char *buf, int64_t off, int *no_dontcache);
+
+/* ================= BINARY RECORDS ================= */
+/*
+ * Layout of `gh --format binary`, meant to be mmap'd and walked in place. A
+ * gh_record_header is followed by records back to back. Each record is a
+ * gh_record, then path_len path bytes and a NUL, padded so the next record
+ * starts 8-byte aligned. Step with rec = (const gh_record *)((const char *)rec + rec->length).
+ * Integers are in the byte order of the machine that wrote the file; check
+ * byte_order against GH_RECORD_BYTE_ORDER.
+ */
+
+#define GH_RECORD_MAGIC "GHRECS\0\0"    // 8 bytes
+#define GH_RECORD_VERSION 1
+#define GH_RECORD_BYTE_ORDER 0x01020304U
+
+typedef struct {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t header_size;     // Offset of the first record
+    uint32_t format_version;
+    uint32_t algo_id;         // gh_algo.id
+    char algo[16];            // gh_algo.name, NUL-padded
+    char version[16];         // Version of the gh that wrote the file
+} gh_record_header;
+
+typedef struct {
+    uint32_t length;          // Whole record including the padded path
+    uint32_t path_len;
+    uint64_t hash;
+    uint64_t size;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_ns;         // Nanoseconds since the epoch
+    uint32_t group;           // --dupes: 1-based duplicate class, 0 otherwise
+    uint32_t reserved;
+} gh_record;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif